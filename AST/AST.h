@@ -17,6 +17,7 @@ public:
 
 	SourcePosition* position;
 	RuntimeEntity*  entity;
+	static long nodeCount; // number of AST nodes created so far
 	
 	AST(SourcePosition* thePosition);	
 	SourcePosition* getPosition();
@@ -27,10 +28,13 @@ public:
 	}
 };
 
+long AST::nodeCount = 0;
+
 AST::AST(SourcePosition* thePosition):Object("AST")
 {
 	position = thePosition;
 	entity = NULL;
+	nodeCount++;
 }
 
 SourcePosition* AST::getPosition() 
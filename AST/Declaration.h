@@ -1,6 +1,7 @@
 #include <stdio.h> 
 #include <stdlib.h> 
 #include <string>
+#include <vector>
 #include "AST.h"
 #include "../SourcePosition.h"
 
@@ -15,9 +16,26 @@ class Declaration : public AST {
 public:
   
 	bool duplicated;
+	unsigned long textHash;  // fingerprint of the declaration's source text
+
+	// Declarations from enclosing scopes that this declaration refers to.
+	vector<Declaration*> dependencies;
+
+	// Declarations named inside this one, and declarations nested in it
+	// that are elaborated whenever it is; see Checker::markReachable.
+	vector<Declaration*> uses;
+	vector<Declaration*> locals;
+
+	int reachedIn;  // number of the last check that found it reachable
+	int usedIn;     // number of the last check that found it named
+	bool passed;    // true iff named as a func or proc actual parameter
 
 	Declaration (SourcePosition* thePosition):AST(thePosition) {
 		duplicated = false;
+		textHash = 0;
+		reachedIn = 0;
+		usedIn = 0;
+		passed = false;
 	}
 
 	string class_type(){
@@ -16,9 +16,21 @@ class VarDeclaration : public Declaration {
 		Identifier *I;
 		TypeDenoter *T;
 
+		// Set by the checker: the let the variable is declared in, as an
+		// index into the lets enclosing it, and the first and last commands
+		// of that let's body naming it (firstUse > lastUse if none does).
+		// A variable named in the let's declarations is pinned.
+		int letDepth;
+		int firstUse, lastUse;
+		bool pinned;
+
 	VarDeclaration (Identifier* iAST, TypeDenoter* tAST, SourcePosition* thePosition):Declaration(thePosition) {
 		I = iAST;
 		T = tAST;
+		letDepth = -1;
+		firstUse = 0;
+		lastUse = -1;
+		pinned = true;
 	}
   
 	Object* visit(Visitor* v, Object* o) {
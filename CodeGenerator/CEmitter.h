@@ -0,0 +1,823 @@
+#ifndef _CEMITTER
+#define _CEMITTER
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "../TAM/Instruction.h"
+#include "../TAM/Machine.h"
+#include "Relocator.h"
+
+using namespace std;
+
+// Translates the object program in the TAM code store into C, to be
+// compiled with an optimizing C compiler and linked with the runtime in
+// Runtime/tam_runtime.c into a standalone executable.
+//
+// Each routine becomes a C function, from its entry to the next routine's
+// entry, taking its frame's LB and returning the ST it leaves; the main
+// program becomes tam_run. Jumps within a routine become gotos, and a
+// computed jump or call a switch over the addresses it can go to. Frames
+// in the data store, the runtime's tam_data, are laid out as the
+// interpreter lays them out.
+//
+// A routine whose frame can't be reached from elsewhere (it never gives
+// away an address in it, nor uses it as a static link) and whose stack
+// height is known at every instruction keeps its whole frame in C locals:
+// its arguments in am1, am2 ..., from LB - 1 down, and the words from
+// LB + 3 up, local variables and the stack above them, in f3, f4 ....
+// Only the words a call passes or returns go through the data store.
+//
+// Any other routine keeps its frame in the data store, but within a run
+// of straight-line code the words it pushes are held in C locals, s0,
+// s1 ..., and only written to the data store where control leaves the
+// run or the data store is needed.
+//
+// The primitives that do input, output or storage allocation are done by
+// tam_primitive in the runtime.
+
+class CEmitter {
+
+	Machine* mach;
+	FILE* out;
+	int end;
+	string failure;
+
+	vector<bool> target;                // address -> true iff jumped to
+	vector<int> entries;                // routine entries, in address order
+	map<int, int> arguments, results;   // routine entry -> words its RETURNs pop and push, or -1
+	map<int, vector<int> > jumpTables;  // routine entry -> the jump table entries in it
+
+	string routines;     // the C functions translated so far
+	bool calling;        // true iff a CALLI has been translated
+
+	// The routine being translated.
+	string body;
+	int entry;
+	bool measured;       // true iff the stack height is known at each instruction
+	bool framed;         // true iff the frame is held in C locals
+	vector<int> height;  // address -> ST - LB there, if measured, or -1 if not reached
+	int argWords, frameWords;
+	int h;               // ST - LB, if measured
+	int depth;           // words pushed in s0 ... s(depth - 1), if not framed
+	int maxDepth;
+	set<int> slots;      // the frame words, LB + at, whose C locals are named
+
+	void print (const char* format, ...);
+	void line (const char* format, ...);
+	string number (int n);
+	string display (int r);
+	bool isFrameRegister (int r);
+	string slot (int at);
+	string word (int r, int d);
+	string value (int r, int d);
+	string stackTop ();
+	void push (string expr);
+	string top (int k);
+	void drop (int k);
+	void need (int k);
+	void flush ();
+	void toStore (int from, int count);
+	void fromStore (int from, int count);
+	void dispatch (string addr, vector<int>& targets, bool calling);
+	bool isPrimitiveCall (int addr, int p);
+	int primitiveEffect (int addr, int p, int& consumed);
+	bool findRoutines ();
+	bool isPrivate (int from, int to);
+	bool measure (int from, int to);
+	int emitPrimitive (int addr, int p, bool singleWords);
+	int emitInstruction (int addr);
+	void emitRoutine (int from, int to);
+
+public:
+	int routinesFramed;  // routines whose frames were held in C locals by the last write
+
+	CEmitter (Machine* mach);
+
+	// Writes the code from CB up to end, as C, into the named file;
+	// returns "" or why it can't be done.
+	string write (string cName, int end);
+};
+
+
+CEmitter::CEmitter (Machine* mach) {
+	this->mach = mach;
+	out = NULL;
+	end = 0;
+	entry = 0;
+	measured = framed = false;
+	argWords = frameWords = 0;
+	h = depth = maxDepth = 0;
+	routinesFramed = 0;
+	calling = false;
+}
+
+// Appends to the translated routines.
+void CEmitter::print (const char* format, ...) {
+	char text[512];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, sizeof text, format, args);
+	va_end(args);
+	routines += text;
+}
+
+void CEmitter::line (const char* format, ...) {
+	char text[512];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, sizeof text, format, args);
+	va_end(args);
+	body += "\t";
+	body += text;
+	body += "\n";
+}
+
+string CEmitter::number (int n) {
+	char text[16];
+	sprintf(text, "%d", n);
+	return text;
+}
+
+// The C expression for content(r), for a register pointing into the
+// data store.
+string CEmitter::display (int r) {
+	if (r == mach->LBr)
+		return "lb";
+	if (r >= mach->L1r && r <= mach->L6r) {
+		string link = "lb";
+		for (int level = mach->LBr; level < r; level++)
+			link = "data[" + link + "]";
+		return link;
+	}
+	if (r == mach->STr)
+		return stackTop();
+	if (r == mach->HTr)
+		return "tam_HT";
+	if (r == mach->HBr)
+		return "tam_HB";
+	return "0";  // SB
+}
+
+// True iff r addresses the frame of the routine being translated.
+bool CEmitter::isFrameRegister (int r) {
+	return r == mach->LBr || (entry == mach->CB && r == mach->SBr);
+}
+
+// The C local for the word at LB + at, in a frame held in C locals.
+string CEmitter::slot (int at) {
+	slots.insert(at);
+	if (at < 0)
+		return "am" + number(-at);
+	frameWords = max(frameWords, at + 1);
+	return "f" + number(at);
+}
+
+// The C lvalue for the data word d[r]. Unless the stack height is known,
+// the stack must be flushed first for ST or the frame's own register.
+string CEmitter::word (int r, int d) {
+	if (framed && r == mach->STr)
+		return slot(h + d);
+	if (framed && r == mach->LBr && (d < 0 || d >= mach->linkDataSize))
+		return slot(d);
+	if (measured && !framed && isFrameRegister(r) && d >= h - depth && d < h)
+		return "s" + number(d - (h - depth));
+	string base = display(r);
+	if (base == "0")
+		return "data[" + number(d) + "]";
+	return "data[" + base + (d < 0 ? " - " : " + ") + number(d < 0 ? -d : d) + "]";
+}
+
+// The C expression for d + content(r).
+string CEmitter::value (int r, int d) {
+	if (r == mach->CBr)
+		return number(d + mach->CB);
+	if (r == mach->CTr)
+		return number(d + end);
+	if (r == mach->PBr)
+		return number(d + mach->PB);
+	if (r == mach->PTr)
+		return number(d + mach->PT);
+	string base = display(r);
+	if (base == "0")
+		return number(d);
+	return base + (d < 0 ? " - " : " + ") + number(d < 0 ? -d : d);
+}
+
+// The C expression for ST, with the words held in s0 ... counted.
+string CEmitter::stackTop () {
+	if (framed)
+		return "lb + " + number(h);
+	return depth == 0 ? "st" : "st + " + number(depth);
+}
+
+void CEmitter::push (string expr) {
+	line("if (%s + 1 > tam_HT) tam_fail(2);", stackTop().c_str());
+	if (framed)
+		line("%s = %s;", slot(h).c_str(), expr.c_str());
+	else {
+		line("s%d = %s;", depth++, expr.c_str());
+		maxDepth = max(maxDepth, depth);
+	}
+	h++;
+}
+
+// The C local for the k-th word from the top of the stack; need(k) must
+// have been called.
+string CEmitter::top (int k) {
+	return framed ? slot(h - k) : "s" + number(depth - k);
+}
+
+void CEmitter::drop (int k) {
+	h -= k;
+	if (!framed)
+		depth -= k;
+}
+
+// Makes sure the top k words of the stack are held in C locals.
+void CEmitter::need (int k) {
+	if (framed || depth >= k)
+		return;
+	flush();
+	for (int i = 0; i < k; i++)
+		line("s%d = data[st - %d];", i, k - i);
+	line("st -= %d;", k);
+	depth = k;
+	maxDepth = max(maxDepth, depth);
+}
+
+// Writes the words held in s0 ... onto the stack in the data store.
+void CEmitter::flush () {
+	if (framed)
+		return;
+	for (int i = 0; i < depth; i++)
+		line("data[st + %d] = s%d;", i, i);
+	if (depth > 0)
+		line("st += %d;", depth);
+	depth = 0;
+}
+
+// In a frame held in C locals, writes the count words from LB + from to
+// the data store, or reads them back.
+void CEmitter::toStore (int from, int count) {
+	for (int i = from; i < from + count; i++)
+		line("data[lb + %d] = %s;", i, slot(i).c_str());
+}
+
+void CEmitter::fromStore (int from, int count) {
+	for (int i = from; i < from + count; i++)
+		line("%s = data[lb + %d];", slot(i).c_str(), i);
+}
+
+// Goes to, or calls, the code address addr, one of targets.
+void CEmitter::dispatch (string addr, vector<int>& targets, bool calling) {
+	line("switch (%s) {", addr.c_str());
+	for (int i = 0; i < (signed) targets.size(); i++)
+		if (calling)
+			line("case %d: st = r%d(st); break;", targets[i], targets[i]);
+		else
+			line("case %d: goto L%d;", targets[i], targets[i]);
+	line("default: tam_fail(3);");
+	line("}");
+}
+
+bool CEmitter::isPrimitiveCall (int addr, int p) {
+	Instruction* instr = &mach->code[addr];
+	return instr->op == mach->CALLop && instr->r == mach->PBr && instr->d == p;
+}
+
+// The change in the stack height made by the call of primitive p at addr,
+// with the words it takes from the stack in consumed, or -1000 if that is
+// not known: eq and ne take a size pushed by the LOADL just before.
+int CEmitter::primitiveEffect (int addr, int p, int& consumed) {
+	if (p == mach->eqDisplacement || p == mach->neDisplacement) {
+		Instruction* before = &mach->code[addr - 1];
+		if (addr - 1 < entry || target[addr] || before->op != mach->LOADLop || before->d < 0)
+			return -1000;
+		consumed = 2 * before->d + 1;
+		return 1 - consumed;
+	}
+	int pushed = 1;
+	if (p == mach->idDisplacement || p == mach->geteolDisplacement || p == mach->puteolDisplacement)
+		consumed = pushed = 0;
+	else if (p == mach->eolDisplacement || p == mach->eofDisplacement)
+		consumed = 0;
+	else if (p == mach->notDisplacement || p == mach->succDisplacement || p == mach->predDisplacement ||
+		p == mach->negDisplacement || p == mach->newDisplacement)
+		consumed = 1;
+	else if (p == mach->getDisplacement || p == mach->putDisplacement || p == mach->getintDisplacement ||
+		p == mach->putintDisplacement || p == mach->disposeDisplacement)
+		consumed = 1, pushed = 0;
+	else if (p >= mach->andDisplacement && p <= mach->gtDisplacement)
+		consumed = 2;
+	else
+		return -1000;
+	return pushed - consumed;
+}
+
+// Finds where the routines start, and checks that each jump stays in
+// the routine it is in.
+bool CEmitter::findRoutines () {
+	Relocator* relocator = new Relocator(mach);
+	set<int> starts;
+	starts.insert(mach->CB);
+	target.assign(end + 1, false);
+	for (int addr = mach->CB; addr < end; addr++) {
+		Instruction* instr = &mach->code[addr];
+		if (instr->r != mach->CBr || instr->d < mach->CB || instr->d >= end)
+			continue;
+		if (relocator->isRoutineAddress(instr))
+			starts.insert(instr->d);
+		else if (relocator->isCodeAddress(instr))
+			target[instr->d] = true;
+	}
+	entries.assign(starts.begin(), starts.end());
+
+	for (int k = 0; k < (signed) entries.size(); k++) {
+		int from = entries[k], to = (k + 1 < (signed) entries.size()) ? entries[k + 1] : end;
+		Instruction* last = &mach->code[to - 1];
+		if (last->op != mach->JUMPop && last->op != mach->JUMPIop && last->op != mach->RETURNop &&
+			last->op != mach->HALTop) {
+			failure = "the code at " + number(from) + " runs on into another routine";
+			return false;
+		}
+		arguments[from] = results[from] = -2;
+		for (int addr = from; addr < to; addr++) {
+			Instruction* instr = &mach->code[addr];
+			bool jump = (instr->op == mach->JUMPop || instr->op == mach->JUMPIFop) && instr->r == mach->CBr;
+			if (jump && (instr->d < from || instr->d >= to)) {
+				failure = "the jump at " + number(addr) + " leaves its routine";
+				return false;
+			}
+			if (relocator->isJumpTable(instr))
+				for (int e = 0; e < instr->n; e++) {
+					if (instr->d + e < from || instr->d + e >= to) {
+						failure = "the jump table at " + number(instr->d) + " leaves its routine";
+						return false;
+					}
+					target[instr->d + e] = true;
+					jumpTables[from].push_back(instr->d + e);
+				}
+			if (instr->op == mach->RETURNop) {
+				bool first = (arguments[from] == -2);
+				arguments[from] = (first || arguments[from] == instr->d) ? instr->d : -1;
+				results[from] = (first || results[from] == instr->n) ? instr->n : -1;
+			}
+		}
+	}
+	return true;
+}
+
+// True iff the frame of the routine from .. to - 1 can't be reached from
+// outside it: no address in it is taken, and it is not a static link.
+bool CEmitter::isPrivate (int from, int to) {
+	if (from == mach->CB)
+		return false;  // the main program's frame holds the global variables
+	argWords = 0;
+	for (int addr = from; addr < to; addr++) {
+		Instruction* instr = &mach->code[addr];
+		if (instr->r == mach->LBr && instr->op != mach->LOADop && instr->op != mach->STOREop)
+			return false;
+		if ((instr->op == mach->CALLop && instr->r == mach->CBr && instr->n == mach->LBr) ||
+			(instr->op == mach->LOADAop && instr->r == mach->STr) || instr->op == mach->CALLIop)
+			return false;
+		if (instr->r == mach->LBr && instr->d < 0)
+			argWords = max(argWords, -instr->d);
+		if (instr->op == mach->RETURNop)
+			argWords = max(argWords, instr->d);
+	}
+	return true;
+}
+
+// Finds the stack height, ST - LB, at each instruction of the routine
+// from .. to - 1 that can be reached; returns false if it can't be known
+// there, or differs with the way the instruction is reached.
+bool CEmitter::measure (int from, int to) {
+	int base = (from == mach->CB) ? 0 : mach->linkDataSize;
+	height.assign(end + 1, -1);
+	height[from] = base;
+	vector<int> work(1, from);
+	while (!work.empty()) {
+		int addr = work.back();
+		work.pop_back();
+		Instruction* instr = &mach->code[addr];
+		int op = instr->op, n = instr->n, r = instr->r, d = instr->d;
+		int at = height[addr], consumed = 0;
+		bool fallsThrough = true;
+		vector<int> next;
+		if (op == mach->LOADop)
+			at += n;
+		else if (op == mach->LOADAop || op == mach->LOADLop)
+			at += 1;
+		else if (op == mach->LOADIop)
+			at += n - 1;
+		else if (op == mach->STOREop)
+			at -= n;
+		else if (op == mach->STOREIop)
+			at -= n + 1;
+		else if (op == mach->CALLop && r == mach->PBr) {
+			int change = primitiveEffect(addr, d, consumed);
+			if (change == -1000)
+				return false;
+			at += change;
+		}
+		else if (op == mach->CALLop && r == mach->CBr && arguments[d] >= 0 && results[d] >= 0)
+			at += results[d] - arguments[d];
+		else if (op == mach->PUSHop)
+			at += d;
+		else if (op == mach->POPop)
+			at -= d;
+		else if (op == mach->JUMPIFop && r == mach->CBr) {
+			at -= 1;
+			next.push_back(d);
+		}
+		else if (op == mach->JUMPop && r == mach->CBr) {
+			next.push_back(d);
+			fallsThrough = false;
+		}
+		else if (op == mach->JUMPIop && !jumpTables[from].empty()) {
+			next = jumpTables[from];
+			at -= 1;
+			fallsThrough = false;
+		}
+		else if (op == mach->RETURNop || op == mach->HALTop)
+			fallsThrough = false;
+		else
+			return false;
+		if (fallsThrough)
+			next.push_back(addr + 1);
+
+		for (int i = 0; i < (signed) next.size(); i++) {
+			int s = next[i];
+			if (s < from || s >= to || at < base)
+				return false;
+			if (height[s] == -1) {
+				height[s] = at;
+				work.push_back(s);
+			}
+			else if (height[s] != at)
+				return false;
+		}
+	}
+	return true;
+}
+
+// Emits the call of the primitive routine at displacement p by the
+// instruction at addr, and returns the number of instructions used: a
+// following JUMPIF on the result of a comparison is taken as well.
+// singleWords is true iff eq and ne compare values of one word.
+int CEmitter::emitPrimitive (int addr, int p, bool singleWords) {
+	static const char* relations[] = {"<", "<=", ">=", ">", "==", "!="};
+	int relation = -1;
+	if (p >= mach->ltDisplacement && p <= mach->gtDisplacement)
+		relation = p - mach->ltDisplacement;
+	else if (singleWords && (p == mach->eqDisplacement || p == mach->neDisplacement))
+		relation = (p == mach->eqDisplacement) ? 4 : 5;
+
+	Instruction* next = (addr + 1 < end && !target[addr + 1]) ? &mach->code[addr + 1] : NULL;
+	if (relation >= 0 && next != NULL && next->op == mach->JUMPIFop && next->r == mach->CBr &&
+		(next->n == mach->trueRep || next->n == mach->falseRep)) {
+		need(2);
+		string left = top(2), right = top(1);
+		drop(2);
+		flush();
+		line("if (%s(%s %s %s)) goto L%d;", next->n == mach->trueRep ? "" : "!", left.c_str(),
+			relations[relation], right.c_str(), next->d);
+		return 2;
+	}
+
+	string x, y;
+	if (p == mach->idDisplacement)
+		;
+	else if (p == mach->notDisplacement) {
+		need(1);
+		x = top(1);
+		line("%s = (%s == %d) ? %d : %d;", x.c_str(), x.c_str(), mach->trueRep, mach->falseRep, mach->trueRep);
+	}
+	else if (p == mach->andDisplacement || p == mach->orDisplacement) {
+		need(2);
+		x = top(2), y = top(1);
+		line("%s = (%s == %d %s %s == %d) ? %d : %d;", x.c_str(), x.c_str(), mach->trueRep,
+			p == mach->andDisplacement ? "&&" : "||", y.c_str(), mach->trueRep, mach->trueRep, mach->falseRep);
+		drop(1);
+	}
+	else if (p == mach->succDisplacement || p == mach->predDisplacement || p == mach->negDisplacement) {
+		need(1);
+		x = top(1);
+		if (p == mach->negDisplacement)
+			line("%s = -%s;", x.c_str(), x.c_str());
+		else {
+			line("%s %s 1;", x.c_str(), p == mach->succDisplacement ? "+=" : "-=");
+			line("if (%s < %d || %s > %d) tam_fail(5);", x.c_str(), -mach->maxintRep, x.c_str(), mach->maxintRep);
+		}
+	}
+	else if (p >= mach->addDisplacement && p <= mach->multDisplacement) {
+		need(2);
+		x = top(2), y = top(1);
+		line("%s %s %s;", x.c_str(), p == mach->addDisplacement ? "+=" : p == mach->subDisplacement ? "-=" : "*=",
+			y.c_str());
+		line("if (%s < %d || %s > %d) tam_fail(5);", x.c_str(), -mach->maxintRep, x.c_str(), mach->maxintRep);
+		drop(1);
+	}
+	else if (p == mach->divDisplacement || p == mach->modDisplacement) {
+		need(2);
+		x = top(2), y = top(1);
+		line("if (%s == 0) tam_fail(6);", y.c_str());
+		line("%s %s %s;", x.c_str(), p == mach->divDisplacement ? "/=" : "%=", y.c_str());
+		drop(1);
+	}
+	else if (relation >= 0) {
+		need(2);
+		x = top(2), y = top(1);
+		line("%s = (%s %s %s) ? %d : %d;", x.c_str(), x.c_str(), relations[relation], y.c_str(),
+			mach->trueRep, mach->falseRep);
+		drop(1);
+	}
+	else if (framed) {
+		int consumed = 0;
+		int change = primitiveEffect(addr, p, consumed);
+		toStore(h - consumed, consumed);
+		line("tam_primitive(%d, lb + %d);", p, h);
+		h += change;
+		fromStore(h - consumed - change, consumed + change);
+	}
+	else {
+		flush();
+		line("st = tam_primitive(%d, st);", p);
+	}
+	return 1;
+}
+
+// Emits the instruction at addr, and returns the number of instructions
+// used.
+int CEmitter::emitInstruction (int addr) {
+	Instruction* instr = &mach->code[addr];
+	int op = instr->op, n = instr->n, r = instr->r, d = instr->d;
+
+	if (op == mach->LOADop) {
+		// The words are found from ST as it is before the first is pushed.
+		int at = h;
+		if (r == mach->STr || (!measured && isFrameRegister(r)))
+			flush();
+		for (int i = 0; i < n; i++)
+			if (r != mach->STr)
+				push(word(r, d + i));
+			else if (framed)
+				push(slot(at + d + i));
+			else
+				push("data[st + " + number(d + i) + "]");
+	}
+	else if (op == mach->LOADAop) {
+		// A word whose address is taken must be in the data store.
+		if (r == mach->STr || (isFrameRegister(r) && (!measured || d >= h - depth)))
+			flush();
+		push(value(r, d));
+	}
+	else if (op == mach->LOADIop) {
+		if (!measured)
+			flush();
+		need(1);
+		line("a = %s;", top(1).c_str());
+		drop(1);
+		for (int i = 0; i < n; i++)
+			push("data[a + " + number(i) + "]");
+	}
+	else if (op == mach->LOADLop) {
+		if (d == 1 && addr + 1 < end && !target[addr + 1] &&
+			(isPrimitiveCall(addr + 1, mach->eqDisplacement) || isPrimitiveCall(addr + 1, mach->neDisplacement))) {
+			// Equality of single words needs no call of the runtime.
+			line("if (%s + 1 > tam_HT) tam_fail(2);", stackTop().c_str());
+			return emitPrimitive(addr + 1, mach->code[addr + 1].d, true) + 1;
+		}
+		push(number(d));
+	}
+	else if (op == mach->STOREop) {
+		if (r == mach->STr && !framed) {
+			flush();
+			for (int i = 0; i < n; i++)
+				line("data[st + %d] = data[st - %d];", d + i, n - i);
+			line("st -= %d;", n);
+		}
+		else {
+			if (!measured && isFrameRegister(r))
+				flush();
+			need(n);
+			int at = h;
+			for (int i = 0; i < n; i++)
+				line("%s = %s;", r == mach->STr ? slot(at + d + i).c_str() : word(r, d + i).c_str(),
+					top(n - i).c_str());
+			drop(n);
+		}
+	}
+	else if (op == mach->STOREIop) {
+		if (!measured)
+			flush();
+		need(n + 1);
+		line("a = %s;", top(1).c_str());
+		for (int i = 0; i < n; i++)
+			line("data[a + %d] = %s;", i, top(n + 1 - i).c_str());
+		drop(n + 1);
+	}
+	else if (op == mach->CALLop) {
+		if (r == mach->PBr)
+			return emitPrimitive(addr, d, false);
+		flush();
+		if (r != mach->CBr || d < mach->CB || d >= end)
+			line("tam_fail(4);");
+		else if (framed) {
+			toStore(h - arguments[d], arguments[d]);
+			line("if (lb + %d > tam_HT) tam_fail(2);", h + 3);
+			line("data[lb + %d] = %s;", h, value(n, 0).c_str());
+			line("data[lb + %d] = lb;", h + 1);
+			line("data[lb + %d] = %d;", h + 2, addr + 1);
+			line("r%d(lb + %d);", d, h);
+			h += results[d] - arguments[d];
+			fromStore(h - results[d], results[d]);
+		}
+		else {
+			line("if (st + 3 > tam_HT) tam_fail(2);");
+			line("data[st] = %s;", value(n, 0).c_str());
+			line("data[st + 1] = lb;");
+			line("data[st + 2] = %d;", addr + 1);
+			line("st = r%d(st);", d);
+		}
+	}
+	else if (op == mach->CALLIop) {
+		flush();
+		line("st -= 2;");
+		line("a = data[st + 1];");
+		line("if (a >= %d)", mach->PB);
+		line("\tst = tam_primitive(a - %d, st);", mach->PB);
+		line("else {");
+		line("data[st + 1] = lb;");
+		line("data[st + 2] = %d;", addr + 1);
+		line("st = tam_call(a, st);");
+		line("}");
+		calling = true;
+	}
+	else if (op == mach->RETURNop) {
+		if (entry == mach->CB)
+			line("tam_fail(3);");
+		else {
+			need(n);
+			for (int i = 0; i < n; i++)
+				line("data[lb - %d] = %s;", d - i, top(n - i).c_str());
+			line("return lb - %d;", d - n);
+			drop(n);
+			flush();
+		}
+	}
+	else if (op == mach->PUSHop) {
+		flush();
+		line("if (%s + %d > tam_HT) tam_fail(2);", stackTop().c_str(), d);
+		if (framed)
+			h += d;
+		else
+			line("st += %d;", d);
+	}
+	else if (op == mach->POPop) {
+		if (d == 0)
+			;
+		else if (framed || depth >= n + d) {
+			for (int i = 0; i < n; i++)
+				line("%s = %s;", top(n + d - i).c_str(), top(n - i).c_str());
+			drop(d);
+		}
+		else {
+			flush();
+			for (int i = 0; i < n; i++)
+				line("data[st - %d] = data[st - %d];", n + d - i, n - i);
+			line("st -= %d;", d);
+		}
+	}
+	else if (op == mach->JUMPop) {
+		flush();
+		if (r == mach->CBr)
+			line("goto L%d;", d);
+		else {
+			line("a = %s;", value(r, d).c_str());
+			dispatch("a", jumpTables[entry], false);
+		}
+	}
+	else if (op == mach->JUMPIop) {
+		need(1);
+		line("a = %s;", top(1).c_str());
+		drop(1);
+		flush();
+		dispatch("a", jumpTables[entry], false);
+	}
+	else if (op == mach->JUMPIFop) {
+		need(1);
+		string s = top(1);
+		drop(1);
+		flush();
+		if (r == mach->CBr)
+			line("if (%s == %d) goto L%d;", s.c_str(), n, d);
+		else
+			line("if (%s == %d) tam_fail(3);", s.c_str(), n);
+	}
+	else if (op == mach->HALTop) {
+		flush();
+		line("exit(0);");
+	}
+	else
+		line("tam_fail(4);");
+	return 1;
+}
+
+void CEmitter::emitRoutine (int from, int to) {
+	entry = from;
+	body = "";
+	depth = maxDepth = 0;
+	slots.clear();
+	frameWords = mach->linkDataSize;
+	measured = measure(from, to);
+	framed = measured && isPrivate(from, to);
+	if (framed)
+		routinesFramed++;
+
+	for (int addr = from; addr < to; ) {
+		if (measured && height[addr] < 0) {
+			addr++;  // never reached
+			continue;
+		}
+		if (target[addr]) {
+			flush();
+			body += "L" + number(addr) + ":;\n";
+		}
+		h = measured ? height[addr] : 0;
+		addr += emitInstruction(addr);
+	}
+
+	if (from == mach->CB)
+		print("void tam_run (void) {\n\tlong lb = 0, st = 0, a;\n");
+	else
+		print("static long r%d (long lb) {\n\tlong st = lb + %d, a;\n", from, mach->linkDataSize);
+	print("\tint* data = tam_data;\n");
+	for (int i = 0; i < maxDepth; i++)
+		print("\tlong s%d;\n", i);
+	// Only the frame words the body names get locals.
+	if (framed) {
+		for (int i = 1; i <= argWords; i++)
+			if (slots.count(-i) > 0)
+				print("\tlong am%d = data[lb - %d];\n", i, i);
+		for (int i = mach->linkDataSize; i < frameWords; i++)
+			if (slots.count(i) > 0)
+				print("\tlong f%d = 0;\n", i);
+	}
+	print("\t(void) lb;\n\t(void) st;\n\t(void) a;\n");
+	routines += body;
+	if (from != mach->CB)
+		print("\treturn st;\n");
+	print("}\n\n");
+}
+
+string CEmitter::write (string cName, int end) {
+	this->end = end;
+	failure = "";
+	jumpTables.clear();
+	arguments.clear();
+	results.clear();
+	routinesFramed = 0;
+	routines = "";
+	calling = false;
+	if (end <= mach->CB)
+		return "there is no code";
+	if (!findRoutines())
+		return failure;
+	out = fopen(cName.c_str(), "w");
+	if (out == NULL)
+		return "can't write " + cName;
+
+	fprintf(out, "/* Translated from TAM code by the Triangle compiler. */\n\n");
+	fprintf(out, "#include <stdlib.h>\n\n");
+	fprintf(out, "extern int tam_data[];\n");
+	fprintf(out, "extern long tam_HB, tam_HT;\n");
+	fprintf(out, "extern void tam_fail (int status);\n");
+	fprintf(out, "extern long tam_primitive (long d, long st);\n\n");
+	for (int k = 1; k < (signed) entries.size(); k++)
+		fprintf(out, "static long r%d (long lb);\n", entries[k]);
+	fprintf(out, "\n");
+
+	for (int k = 0; k < (signed) entries.size(); k++)
+		emitRoutine(entries[k], (k + 1 < (signed) entries.size()) ? entries[k + 1] : end);
+
+	// The routines that a closure can stand for, if a CALLI was translated.
+	if (calling) {
+		vector<int> closures(entries.begin() + 1, entries.end());
+		fprintf(out, "static long tam_call (long addr, long st) {\n");
+		body = "";
+		dispatch("addr", closures, true);
+		fprintf(out, "%s\treturn st;\n}\n\n", body.c_str());
+	}
+	fputs(routines.c_str(), out);
+	fclose(out);
+	return "";
+}
+
+
+#endif
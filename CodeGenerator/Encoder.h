@@ -16,9 +16,14 @@
 #include "KnownAddress.h"
 #include "KnownRoutine.h"
 #include "KnownValue.h"
+#include "LayoutTable.h"
+#include "ObjectUnit.h"
 #include "ObjectAddress.h"
 #include "PrimitiveRoutine.h"
+#include "RoutineJob.h"
 #include "RuntimeEntity.h"
+#include "Segment.h"
+#include "StackDepth.h"
 #include "TypeRepresentation.h"
 #include "UnknownAddress.h"
 #include "UnknownRoutine.h"
@@ -26,7 +31,9 @@
 #include "../ContextualAnalyzer/Checker.h"
 
 #include "../StdEnvironment.h"
+#include <atomic>
 #include <string>
+#include <thread>
 
 using namespace std;
 
@@ -39,6 +46,66 @@ bool tableDetailsReqd;
 int nextInstrAddr;
 StdEnvironment* getvarz;
 Machine* mach;
+LayoutTable* layouts;
+Checker* checker;
+int routinesPruned;  // unreachable routines left out of the object program
+
+// The routine whose body is being generated, the address of its body and
+// the size of its arguments; and the calls of it in tail position there.
+Declaration* tailRoutine;
+int tailEntry;
+int tailArgsSize;
+vector<AST*> tailCalls;
+
+// (level, displacement) of every word of a variable whose address is
+// passed as a var argument or computed for indexing, and so may be
+// changed by STOREI.
+set<pair<int, int> > exposedWords;
+
+// Displacements decided by allocateVariables for variables about to be
+// declared, and the frame words saved by letting variables share them.
+map<Declaration*, int> variableSlots;
+int wordsShared;
+
+// Nested routines are compiled as if declared at level 0 when they need
+// no enclosing routine's frame but for at most maxLiftedParameters
+// declarations in it, which are passed as extra arguments (-1 turns
+// lifting off). liftedFree holds those declarations of each lifted
+// routine.
+int maxLiftedParameters;
+map<Declaration*, vector<Declaration*> > liftedFree;
+int routinesLifted;
+
+// The code of the main program (segment 0) and of each routine, and the
+// segment being generated.
+vector<Segment*> segments;
+int currentSegment;
+
+// The main encoder leaves the code of each routine declared in the main
+// program to a job, and once the main program is done has jobs workers
+// take the jobs in turn, each on a thread of its own. A worker is a copy
+// of the encoder that shares its machine, checker and layout table.
+int jobs;
+Encoder* parent;  // the main encoder, in a worker; else NULL
+vector<RoutineJob*> routineJobs;
+atomic<int> nextJob;
+
+// Separate compilation. A module has no main program; the routines and
+// constants it declares in exportedDeclarations are exported under their
+// names. Routines in importedDeclarations belong to other units: they are
+// not generated, and calls of them are left for the linker of units.
+bool compilingModule;
+set<Declaration*> exportedDeclarations;
+set<Declaration*> importedDeclarations;
+vector<int> exportSegments;
+vector<string> exportNames;
+vector<string> exportSignatures;
+// The values of the constants exported, and of those imported, which are
+// compiled into the code instead of being linked.
+vector<string> exportConstantNames;
+vector<int> exportConstantValues;
+vector<string> importConstantNames;
+vector<int> importConstantValues;
 // Commands	
 
   Object* visitAssignCommand(Object* obj, Object* o);
@@ -139,6 +206,7 @@ Machine* mach;
 
 
   Encoder(ErrorReporter* reporter,Checker* check_it);
+  Encoder(Encoder* parent);
 
   // Generates code to run a program.
   // showingTable is true iff entity description details
@@ -160,23 +228,147 @@ Machine* mach;
 
   void saveObjectProgram(string objectName);
 
+  // Saves the code, not yet linked with other units, in the named .tamo
+  // file.
+  void saveObjectUnit(string objectName);
+
+  // Reports the declarations of a module that would need storage of
+  // their own, which modules can't have.
+  void checkModuleDeclarations(Declaration* D);
+
   static void writeTableDetails(AST* ast) ;
 
   // OBJECT CODE
 
   // Implementation notes:
-  // Object code is generated directly into the TAM Code Store, starting at CB.
-  // The address of the next instruction is held in nextInstrAddr.
+  // Object code is generated into segments, one for the main program and
+  // one for each routine, each starting at 0. The address in the current
+  // segment of the next instruction is held in nextInstrAddr. Once the
+  // program has been generated, link places the segments one after the
+  // other in the TAM Code Store, starting at CB, and nextInstrAddr is the
+  // end of the code there.
+  // The walk of the main program decides the entities of the declarations
+  // there, routines included, before any routine is generated; a worker
+  // then decorates only the nodes within the routines it generates, but
+  // for the representations of types, which are shared between routines
+  // and decided under the layout table's lock.
   
 
   // Appends an instruction, with the given fields, to the object code.
   void emit (int op, int n, int r, int d) ;
 
+  // Appends an instruction whose operand is the code address of the
+  // routine at address. Until linking, the displacement of a known
+  // routine's address is the number of its segment.
+  void emitRoutine (int op, int n, ObjectAddress* address) ;
+
   // Patches the d-field of the instruction at address addr.
   void patch (int addr, int d) ;
 
+  // Starts generating the given routine into a new segment, and returns
+  // the segment that was being generated, to be resumed by endSegment.
+  int beginSegment (Declaration* routine) ;
+  void endSegment (int outer) ;
+
+  // Generates a routine declared in the given frame into a segment of its
+  // own; in the main encoder, only makes the segment and a job to fill it.
+  Object* encodeRoutineDeclaration (Declaration* routine, Frame* frame) ;
+
+  // Generates the code of a routine compiled at level.
+  void encodeRoutine (Declaration* routine, int level) ;
+
+  // Generates the routines of routineJobs on jobs threads, then puts the
+  // segments of their nested routines after them, renumbered in the order
+  // the routines were declared, as if generated in a single walk.
+  void encodeDeferredRoutines () ;
+
+  // Generates the routines of the jobs this worker takes.
+  void work (int worker) ;
+
+  // Places the segments in the code store and relocates their code
+  // addresses.
+  void link () ;
+
+  // CASE COMMANDS
+
+  // True iff the sorted labels fill enough of their range to be
+  // dispatched through a jump table, and the range fits in the n-field
+  // that carries the table's length.
+  bool caseTableDense(vector<int>& labels);
+
+  // Generate the dispatch on the selector (kept at displacement selector
+  // in the current frame) to the arms of a case command. Each jump to an
+  // arm is recorded in jumpAddrs, with the arm number in jumpArms, to be
+  // patched once the arms have been generated; arm elseArm is the else.
+
+  void encodeCaseTable(vector<int>& labels, vector<int>& arms, int elseArm, int selector,
+                       Frame* frame, vector<int>& jumpAddrs, vector<int>& jumpArms);
+  void encodeCaseTree(vector<int>& labels, vector<int>& arms, int low, int high, int elseArm,
+                      int selector, Frame* frame, vector<int>& jumpAddrs, vector<int>& jumpArms);
+  void emitCaseJump(int op, int n, int arm, vector<int>& jumpAddrs, vector<int>& jumpArms);
+
+  // TAIL CALLS
+
+  // Generates the body of a routine whose arguments take argsSize words,
+  // with self calls in tail position compiled as jumps.
+  Object* encodeRoutineBody(Declaration* routine, AST* body, int argsSize, Frame* frame);
+
+  // Makes an imported routine known by its name.
+  Object* encodeImportedRoutine(Declaration* routine);
+
+  // The kinds and sizes of a routine's parameters, and the size of its
+  // result, as a string that the linker of units compares between the
+  // unit exporting the routine and each unit importing it; e.g. "(c1,v2)1".
+  string routineSignature(Declaration* routine);
+  string parametersSignature(FormalParameterSequence* FPS);
+
+  // Records in tailCalls the calls of tailRoutine in tail position in a
+  // routine body.
+  void findTailCalls(AST* body);
+
+  // True iff the arguments stay valid once the frame at level is reused,
+  // i.e. no argument is the address of one of its local variables.
+  bool tailArgumentsSafe(ActualParameterSequence* APS, int level);
+
+  // Generates a self tail call: the arguments replace the routine's own,
+  // the rest of the frame is popped and control goes back to the start of
+  // the body, using no more stack space. Returns false, generating
+  // nothing, if the call must be an ordinary one.
+  bool encodeTailCall(AST* call, ActualParameterSequence* APS, Frame* frame);
+
+  // LAMBDA LIFTING
+
+  // Returns the level to compile a routine declared at frame->level at:
+  // 0 if it can be lifted, recording the declarations it names from the
+  // frames of enclosing routines in liftedFree, else frame->level.
+  int routineLevel(Declaration* routine, Frame* frame);
+
+  // Binds the declarations passed to a lifted routine to its extra
+  // parameters, which are last, in its body at level, saving their
+  // entities in outer. Returns the size of the extra parameters.
+  int bindLiftedParameters(Declaration* routine, int level, vector<RuntimeEntity*>& outer);
+  void unbindLiftedParameters(Declaration* routine, vector<RuntimeEntity*>& outer);
+
+  // Generates code to push the extra arguments of a lifted routine.
+  void encodeLiftedArguments(Declaration* routine, Frame* frame);
+
+  // STORAGE SHARING
+
+  // Places the variables declared by D, a let command's declarations, in
+  // one area of the frame, where two of them share words if the let's
+  // body names them in disjoint runs of its top-level commands. Pushes the
+  // area and returns its size, or returns 0 if no words would be shared.
+  int allocateVariables(Declaration* D, Frame* frame);
+
   // DATA REPRESENTATION
 
+  // Returns the size of a type, deciding its layout on first use only.
+  int typeSize(TypeDenoter* T);
+
+  // Lays out an array or record type, sharing the representation of an
+  // equal type that has already been laid out.
+  int layoutType(TypeDenoter* T);
+
   int characterValuation(string spelling);  
   // REGISTERS
 
@@ -208,6 +400,11 @@ Machine* mach;
   // the variable is addressed at run-time.
 
   void encodeFetchAddress (Vname* V, Frame* frame);
+
+  // Records the words of the variable named by V, whose root is at
+  // address, or declared by decl, in exposedWords.
+  void exposeVariable (Vname* V, ObjectAddress* address);
+  void exposeVariable (AST* decl, ObjectAddress* address);
 };
 
 Object* Encoder::visitAssignCommand(Object* obj, Object* o) {
@@ -221,6 +418,8 @@ Object* Encoder::visitAssignCommand(Object* obj, Object* o) {
 Object* Encoder::visitCallCommand(Object* obj, Object* o) {
 	  CallCommand* ast = (CallCommand*)obj;
     Frame* frame = (Frame*) o;
+    if (encodeTailCall(ast, ast->APS, frame))
+      return NULL;
     Integer* argsSize = (Integer*) ast->APS->visit(this, frame);
     ast->I->visit(this, new Frame(frame->level, argsSize));
     return NULL;
@@ -252,7 +451,8 @@ Object* Encoder::visitIfCommand(Object* obj, Object* o) {
 Object* Encoder::visitLetCommand(Object* obj, Object* o) {
 	  LetCommand* ast = (LetCommand*)obj;
     Frame* frame = (Frame*) o;
-    int extraSize = ((Integer*) ast->D->visit(this, frame))->value;
+    int areaSize = allocateVariables(ast->D, frame);
+    int extraSize = areaSize + ((Integer*) ast->D->visit(this, new Frame(frame, areaSize)))->value;
     ast->C->visit(this, new Frame(frame, extraSize));
     if (extraSize > 0)
 		  emit(mach->POPop, 0, 0, extraSize);
@@ -300,56 +500,77 @@ Object* Encoder::visitForCommand(Object* obj, Object* o){
     ForCommand* ast = (ForCommand*) obj;
     Frame* frame = (Frame*) o;
 
-    
-    ast->D->visit(this, frame);
-    int loopAddr = nextInstrAddr;
-    emit(mach->LOADop, 1, mach->LBr, 0);
-    ast->E2->visit(this,frame);
-    emit(mach->CALLop, mach->LBr, mach->PBr, mach->gtDisplacement);
-    int patchAddr = nextInstrAddr;
-    emit(mach->JUMPIFop, mach->trueRep, mach->CBr, 0);
-    
-    ast->C->visit(this, frame);
+    // The control variable and the upper bound occupy the next two
+    // words of the frame; the bound is evaluated once, before the loop.
+    int r = displayRegister(frame->level, frame->level);
+    int control = frame->size;
+    int bound = frame->size + 1;
 
-    emit(mach->LOADop, 1, mach->LBr, 0);
-    emit(mach->CALLop, mach->LBr, mach->PBr, mach->succDisplacement);
-    emit(mach->STOREop, 1, mach->LBr, 0);
-    
-    emit(mach->JUMPop, 0, mach->CBr, loopAddr);
+    ast->E1->visit(this, frame);
+    ast->D->entity = new UnknownValue(mach->integerSize, frame->level, control);
+    writeTableDetails(ast->D);
+    ast->E2->visit(this, new Frame(frame, 1));
 
-    patch(patchAddr, nextInstrAddr);
+    int jumpAddr = nextInstrAddr;
+    emit(mach->JUMPop, 0, mach->CBr, 0);
+    int loopAddr = nextInstrAddr;
+    ast->C->visit(this, new Frame(frame, 2));
+    emit(mach->LOADop, 1, r, control);
+    emit(mach->CALLop, mach->SBr, mach->PBr, mach->succDisplacement);
+    emit(mach->STOREop, 1, r, control);
+    patch(jumpAddr, nextInstrAddr);
+    emit(mach->LOADop, 1, r, control);
+    emit(mach->LOADop, 1, r, bound);
+    emit(mach->CALLop, mach->SBr, mach->PBr, mach->leDisplacement);
+    emit(mach->JUMPIFop, mach->trueRep, mach->CBr, loopAddr);
+    emit(mach->POPop, 0, 0, 2);
     return NULL;
 }
 
 Object* Encoder::visitCaseCommand(Object* obj, Object* o){
     CaseCommand* ast = (CaseCommand*) obj;
     Frame* frame = (Frame*) o;
-    
-    int endPatches[ast->size];
-    
-    for(int i = 0; i < ast->size; i++){
-      // ast->IL[i]->visit(this,frame);
-      ast->E->visit(this, frame);
-      int ilVal = atoi(ast->IL[i]->spelling.c_str());
-      emit(mach->LOADLop, 0, 0, ilVal);
-      emit(mach->LOADLop, 0, 0, 1);
-      emit(mach->CALLop, mach->LBr, mach->PBr, mach->eqDisplacement);
-      int localPatch = nextInstrAddr;
-      emit(mach->JUMPIFop, mach->falseRep, mach->CBr, 0);
-      ast->C[i]->visit(this,frame);
-      endPatches[i] = nextInstrAddr;
-      emit(mach->JUMPop, 0, mach->CBr, 0);
-      patch(localPatch, nextInstrAddr);
-    }
 
-   
-    ast->C[ast->size]->visit(this,frame);
+    // The selector is evaluated once and kept on the stack while the
+    // arm is chosen; the arms run with it still there.
+    ast->E->visit(this, frame);
+    int selector = frame->size;
+    Frame* armFrame = new Frame(frame, 1);
+
+    // Labels in increasing order, each with the first arm it selects.
+    vector<int> labels, arms;
+    for (int i = 0; i < ast->size; i++) {
+      int value = atoi(ast->IL[i]->spelling.c_str());
+      int k = 0;
+      while (k < (signed) labels.size() && labels[k] < value)
+        k++;
+      if (k == (signed) labels.size() || labels[k] != value) {
+        labels.insert(labels.begin() + k, value);
+        arms.insert(arms.begin() + k, i);
+      }
+    }
 
-    // int endAddr = nextInstrAddr;
-    for (int i = 0; i < ast->size; i++){
-      patch(endPatches[i], nextInstrAddr);
+    vector<int> jumpAddrs, jumpArms;
+    if (!labels.empty() && caseTableDense(labels))
+      encodeCaseTable(labels, arms, ast->size, selector, frame, jumpAddrs, jumpArms);
+    else
+      encodeCaseTree(labels, arms, 0, (signed) labels.size() - 1, ast->size, selector, frame, jumpAddrs, jumpArms);
+
+    vector<int> armAddrs, endPatches;
+    for (int i = 0; i <= ast->size; i++) {
+      armAddrs.push_back(nextInstrAddr);
+      ast->C[i]->visit(this, armFrame);
+      if (i < ast->size) {
+        endPatches.push_back(nextInstrAddr);
+        emit(mach->JUMPop, 0, mach->CBr, 0);
+      }
     }
-    
+    for (int i = 0; i < (signed) endPatches.size(); i++)
+      patch(endPatches[i], nextInstrAddr);
+    for (int i = 0; i < (signed) jumpAddrs.size(); i++)
+      patch(jumpAddrs[i], armAddrs[jumpArms[i]]);
+
+    emit(mach->POPop, 0, 0, 1);
     return NULL;
 }
 
@@ -378,6 +599,8 @@ Object* Encoder::visitCallExpression(Object* obj, Object* o) {
 	  CallExpression* ast = (CallExpression*)obj;
     Frame* frame = (Frame*) o;
     Integer* valSize = (Integer*) ast->type->visit(this, NULL);
+    if (encodeTailCall(ast, ast->APS, frame))
+      return valSize;
     Integer* argsSize = (Integer*) ast->APS->visit(this, frame);
     ast->I->visit(this, new Frame(frame->level, argsSize));
     return valSize;
@@ -483,54 +706,26 @@ Object* Encoder::visitConstDeclaration(Object* obj, Object* o) {
       ast->entity = new UnknownValue(valSize, frame->level, frame->size);
       extraSize = valSize;
     }
+    if (exportedDeclarations.count(ast) > 0) {
+      exportConstantNames.push_back(checker->declaredName(ast));
+      exportConstantValues.push_back(((KnownValue*) ast->entity)->value);
+    }
+    else if (importedDeclarations.count(ast) > 0) {
+      importConstantNames.push_back(checker->declaredName(ast));
+      importConstantValues.push_back(((KnownValue*) ast->entity)->value);
+    }
     writeTableDetails(ast);
     return new Integer(extraSize);
   }
 
 Object* Encoder::visitFuncDeclaration(Object* obj, Object* o) {
 	FuncDeclaration* ast = (FuncDeclaration*)obj;
-  Frame* frame = (Frame*) o;
-  int jumpAddr = nextInstrAddr;
-  int argsSize = 0;
-	int valSize = 0;
-
-	emit(mach->JUMPop, 0, mach->CBr, 0);
-	ast->entity = new KnownRoutine(mach->closureSize, frame->level, nextInstrAddr);
-    writeTableDetails(ast);
-
-	if (frame->level == mach->maxRoutineLevel)
-    reporter->reportRestriction("can't nest routines more than 7 deep");
-  else {
-    Frame* frame1 = new Frame(frame->level + 1, 0);
-    argsSize = ((Integer*) ast->FPS->visit(this, frame1))->value;
-    Frame* frame2 = new Frame(frame->level + 1, mach->linkDataSize);
-    valSize = ((Integer*) ast->E->visit(this, frame2))->value;
-  }
-	emit(mach->RETURNop, valSize, 0, argsSize);
-  patch(jumpAddr, nextInstrAddr);
-  return new Integer(0);
+    return encodeRoutineDeclaration(ast, (Frame*) o);
   }
 
 Object* Encoder::visitProcDeclaration(Object* obj, Object* o) {
 	ProcDeclaration* ast = (ProcDeclaration*)obj;
-    Frame* frame = (Frame*) o;
-    int jumpAddr = nextInstrAddr;
-    int argsSize = 0;
-
-	emit(mach->JUMPop, 0, mach->CBr, 0);
-	ast->entity = new KnownRoutine (mach->closureSize, frame->level,nextInstrAddr);
-    writeTableDetails(ast);
-	if (frame->level == mach->maxRoutineLevel)
-      reporter->reportRestriction("can't nest routines so deeply");
-    else {
-      Frame* frame1 = new Frame(frame->level + 1, 0);
-      argsSize = ((Integer*) ast->FPS->visit(this, frame1))->value;
-	  Frame* frame2 = new Frame(frame->level + 1, mach->linkDataSize);
-      ast->C->visit(this, frame2);
-    }
-	emit(mach->RETURNop, 0, 0, argsSize);
-    patch(jumpAddr, nextInstrAddr);
-    return new Integer(0);
+    return encodeRoutineDeclaration(ast, (Frame*) o);
   }
 
 Object* Encoder::visitSequentialDeclaration(Object* obj, Object* o) {
@@ -562,7 +757,14 @@ Object* Encoder::visitVarDeclaration(Object* obj, Object* o) {
     Frame* frame = (Frame*) o;
     int extraSize;
 
-    extraSize = ((Integer*) ast->T->visit(this, NULL))->value;
+    if (variableSlots.count(ast) > 0) {
+      // Already pushed, in the area of its let command.
+      ast->entity = new KnownAddress(mach->addressSize, frame->level, variableSlots[ast]);
+      variableSlots.erase(ast);
+      writeTableDetails(ast);
+      return new Integer(0);
+    }
+    extraSize = typeSize(ast->T);
 	  emit(mach->PUSHop, 0, 0, extraSize);
 	  ast->entity = new KnownAddress(mach->addressSize, frame->level, frame->size);
     writeTableDetails(ast);
@@ -575,7 +777,7 @@ Object* Encoder::visitInitVarDeclaration(Object* obj, Object* o){
 
   int extraSize;
 
-  extraSize = ((Integer*) ast->T->visit(this, NULL))->value;
+  extraSize = typeSize(ast->T);
   emit(mach->PUSHop, 0, 0, extraSize);
   ast->entity = new KnownAddress(mach->addressSize, frame->level, frame->size);
   writeTableDetails(ast);
@@ -588,52 +790,12 @@ Object* Encoder::visitInitVarDeclaration(Object* obj, Object* o){
 
 Object* Encoder::visitUserUnaryOperatorDeclaration(Object* obj, Object* o){
   UserUnaryOperatorDeclaration* ast = (UserUnaryOperatorDeclaration*) obj;
-  Frame* frame = (Frame*) o;
-
-  int jumpAddr = nextInstrAddr;
-  int argsSize = 0;
-	int valSize = 0;
-
-	emit(mach->JUMPop, 0, mach->CBr, 0);
-	ast->entity = new KnownRoutine(mach->closureSize, frame->level, nextInstrAddr);
-    writeTableDetails(ast);
-
-	if (frame->level == mach->maxRoutineLevel)
-    reporter->reportRestriction("can't nest routines more than 7 deep");
-  else {
-    Frame* frame1 = new Frame(frame->level + 1, 0);
-    argsSize = ((Integer*) ast->FPS->visit(this, frame1))->value;
-    Frame* frame2 = new Frame(frame->level + 1, mach->linkDataSize);
-    valSize = ((Integer*) ast->E->visit(this, frame2))->value;
-  }
-	emit(mach->RETURNop, valSize, 0, argsSize);
-  patch(jumpAddr, nextInstrAddr);
-  return new Integer(0);
+  return encodeRoutineDeclaration(ast, (Frame*) o);
 }
 
 Object* Encoder::visitUserBinaryOperatorDeclaration(Object* obj, Object* o){
   UserBinaryOperatorDeclaration* ast = (UserBinaryOperatorDeclaration*) obj;
-  Frame* frame = (Frame*) o;
-
-  int jumpAddr = nextInstrAddr;
-  int argsSize = 0;
-	int valSize = 0;
-
-	emit(mach->JUMPop, 0, mach->CBr, 0);
-	ast->entity = new KnownRoutine(mach->closureSize, frame->level, nextInstrAddr);
-    writeTableDetails(ast);
-
-	if (frame->level == mach->maxRoutineLevel)
-    reporter->reportRestriction("can't nest routines more than 7 deep");
-  else {
-    Frame* frame1 = new Frame(frame->level + 1, 0);
-    argsSize = ((Integer*) ast->FPS->visit(this, frame1))->value;
-    Frame* frame2 = new Frame(frame->level + 1, mach->linkDataSize);
-    valSize = ((Integer*) ast->E->visit(this, frame2))->value;
-  }
-	emit(mach->RETURNop, valSize, 0, argsSize);
-  patch(jumpAddr, nextInstrAddr);
-  return new Integer(0);
+  return encodeRoutineDeclaration(ast, (Frame*) o);
 }
 
 // Array Aggregates
@@ -672,7 +834,7 @@ Object* Encoder::visitSingleRecordAggregate(Object* obj,Object* o) {
 Object* Encoder::visitConstFormalParameter(Object* obj, Object* o) {
 	  ConstFormalParameter* ast = (ConstFormalParameter*)obj;
     Frame* frame = (Frame*) o;
-    int valSize = ((Integer*) ast->T->visit(this, NULL))->value;
+    int valSize = typeSize(ast->T);
     ast->entity = new UnknownValue (valSize, frame->level, -frame->size - valSize);
     writeTableDetails(ast);
     return new Integer(valSize);
@@ -760,7 +922,7 @@ Object* Encoder::visitFuncActualParameter(Object* obj, Object* o) {
       ObjectAddress* address = ((KnownRoutine*) ast->I->decl->entity)->address;
       // static link, code address
 	  emit(mach->LOADAop, 0, displayRegister(frame->level, address->level), 0);
-	  emit(mach->LOADAop, 0, mach->CBr, address->displacement);
+	  emitRoutine(mach->LOADAop, 0, address);
 		}
 	else if (ast->I->decl->entity->class_type() == "UNKNOWNROUTINE") {
       ObjectAddress* address = ((UnknownRoutine*) ast->I->decl->entity)->address;
@@ -782,7 +944,7 @@ Object* Encoder::visitProcActualParameter(Object* obj, Object* o) {
       ObjectAddress* address = ((KnownRoutine*) ast->I->decl->entity)->address;
       // static link, code address
 	  emit(mach->LOADAop, 0, displayRegister(frame->level, address->level), 0);
-	  emit(mach->LOADAop, 0, mach->CBr, address->displacement);
+	  emitRoutine(mach->LOADAop, 0, address);
 		}
 	else if (ast->I->decl->entity->class_type() == "UNKNOWNROUTINE") {
       ObjectAddress* address = ((UnknownRoutine*) ast->I->decl->entity)->address;
@@ -847,20 +1009,12 @@ Object* Encoder::visitAnyTypeDenoter(Object* obj, Object* o) {
 
 Object* Encoder::visitArrayTypeDenoter(Object* obj, Object* o) {
 	ArrayTypeDenoter* ast = (ArrayTypeDenoter*)obj;
-    int typeSize;
-    if (ast->entity == NULL) {
-      int elemSize = ((Integer*) ast->T->visit(this, NULL))->value;
-      typeSize = (atoi(ast->IL->spelling.c_str())) * elemSize;
-      ast->entity = new TypeRepresentation(typeSize);
-      writeTableDetails(ast);
-		}
-	else
-      typeSize = ast->entity->size;
-    return new Integer(typeSize);
+    return new Integer(layoutType(ast));
   }
 
 Object* Encoder::visitBoolTypeDenoter(Object* obj, Object* o) {
 	BoolTypeDenoter* ast = (BoolTypeDenoter*)obj;
+    lock_guard<recursive_mutex> guard(layouts->lock);
     if (ast->entity == NULL) {
 		ast->entity = new TypeRepresentation(mach->booleanSize);
       writeTableDetails(ast);
@@ -870,6 +1024,7 @@ Object* Encoder::visitBoolTypeDenoter(Object* obj, Object* o) {
 
 Object* Encoder::visitCharTypeDenoter(Object* obj, Object* o) {
 	CharTypeDenoter* ast = (CharTypeDenoter*)obj;
+    lock_guard<recursive_mutex> guard(layouts->lock);
     if (ast->entity == NULL) {
 		ast->entity = new TypeRepresentation(mach->characterSize);
       writeTableDetails(ast);
@@ -889,6 +1044,7 @@ Object* Encoder::visitSimpleTypeDenoter(Object* obj,Object* o) {
 
 Object* Encoder::visitIntTypeDenoter(Object* obj, Object* o) {
 	IntTypeDenoter* ast = (IntTypeDenoter*)obj;
+    lock_guard<recursive_mutex> guard(layouts->lock);
     if (ast->entity == NULL) {
 		ast->entity = new TypeRepresentation(mach->integerSize);
       writeTableDetails(ast);
@@ -898,15 +1054,7 @@ Object* Encoder::visitIntTypeDenoter(Object* obj, Object* o) {
 
 Object* Encoder::visitRecordTypeDenoter(Object* obj, Object* o) {
 	RecordTypeDenoter* ast = (RecordTypeDenoter*)obj;
-    int typeSize;
-    if (ast->entity == NULL) {
-		typeSize = ((Integer*) ast->FT->visit(this, new Integer(0)))->value;
-		ast->entity = new TypeRepresentation(typeSize);
-		writeTableDetails(ast);
-		}
-	else
-      typeSize = ast->entity->size;
-    return new Integer(typeSize);
+    return new Integer(layoutType(ast));
   }
 
 
@@ -916,7 +1064,7 @@ Object* Encoder::visitMultipleFieldTypeDenoter(Object* obj,Object* o) {
     int fieldSize;
 
     if (ast->entity == NULL) {
-      fieldSize = ((Integer*) ast->T->visit(this, NULL))->value;
+      fieldSize = typeSize(ast->T);
       ast->entity = new Field (fieldSize, offset);
       writeTableDetails(ast);
 		} 
@@ -934,7 +1082,7 @@ Object* Encoder::visitSingleFieldTypeDenoter(Object* obj,Object* o) {
     int fieldSize;
 
     if (ast->entity == NULL) {
-      fieldSize = ((Integer*) ast->T->visit(this, NULL))->value;
+      fieldSize = typeSize(ast->T);
       ast->entity = new Field (fieldSize, offset);
       writeTableDetails(ast);
 		}
@@ -956,12 +1104,19 @@ Object* Encoder::visitIdentifier(Object* obj, Object* o) {
     Frame* frame = (Frame*) o;
     if (ast->decl->entity->class_type() == "KNOWNROUTINE") {
       ObjectAddress* address = ((KnownRoutine*) ast->decl->entity)->address;
-	  emit(mach->CALLop, displayRegister(frame->level, address->level),mach->CBr, address->displacement);
+      encodeLiftedArguments((Declaration*) ast->decl, frame);
+	  emitRoutine(mach->CALLop, displayRegister(frame->level, address->level), address);
 		}
 	else if (ast->decl->entity->class_type() == "UNKNOWNROUTINE") {
       ObjectAddress* address = ((UnknownRoutine*) ast->decl->entity)->address;
 	  emit(mach->LOADop, mach->closureSize, displayRegister(frame->level,address->level), address->displacement);
-	  emit(mach->CALLIop, 0, 0, 0);
+      // The machine ignores a CALLI's operands; they carry the sizes of
+      // the result and arguments, so that the passes over the object code
+      // know how the call changes the stack.
+      int resultSize = 0;
+      if (ast->decl->class_type() == "FUNCFORMALPARAMETER")
+        resultSize = typeSize(((FuncFormalParameter*) ast->decl)->T);
+	  emit(mach->CALLIop, resultSize, 0, frame->size);
 		}
 	else if (ast->decl->entity->class_type() == "PRIMITIVEROUTINE") {
       int displacement = ((PrimitiveRoutine*) ast->decl->entity)->displacement;
@@ -988,7 +1143,8 @@ Object* Encoder::visitOperator(Object* obj, Object* o) {
 
   if (ast->decl->entity->class_type() == "KNOWNROUTINE") {
       ObjectAddress* address = ((KnownRoutine*) ast->decl->entity)->address;
-	    emit(mach->CALLop, displayRegister (frame->level, address->level),mach->CBr, address->displacement);
+      encodeLiftedArguments((Declaration*) ast->decl, frame);
+	    emitRoutine(mach->CALLop, displayRegister (frame->level, address->level), address);
 		}
 	else if (ast->decl->entity->class_type() == "UnknownRoutine") {
       ObjectAddress* address = ((UnknownRoutine*) ast->decl->entity)->address;
@@ -1039,7 +1195,7 @@ Object* Encoder::visitSubscriptVname(Object* obj, Object* o) {
     baseObject = (RuntimeEntity*) ast->V->visit(this, frame);
     ast->offset = ast->V->offset;
     ast->indexed = ast->V->indexed;
-    elemSize = ((Integer*) ast->type->visit(this, NULL))->value;
+    elemSize = typeSize(ast->type);
 
     if (ast->E->class_type() == "INTEGEREXPRESSION") {
       IntegerLiteral* IL = ((IntegerExpression*) ast->E)->IL;
@@ -1076,12 +1232,50 @@ Encoder::Encoder (ErrorReporter* reporter,Checker* check_std) {
 	mach=new Machine();
 	
 	getvarz = check_std->getvariables;
-	nextInstrAddr = mach->CB;
+	checker = check_std;
+	nextInstrAddr = 0;
+	segments.push_back(new Segment());
+	currentSegment = 0;
+	compilingModule = false;
+	layouts = new LayoutTable();
+	routinesPruned = 0;
+	wordsShared = 0;
+	maxLiftedParameters = 3;
+	routinesLifted = 0;
+	tailRoutine = NULL;
+	tailEntry = 0;
+	tailArgsSize = 0;
+	jobs = 1;
+	parent = NULL;
 	
   elaborateStdEnvironment();
 	
 }
 
+// A worker of the main encoder parent, with the segments parent has made
+// so far; the standard environment is parent's.
+Encoder::Encoder (Encoder* parent) {
+	this->parent = parent;
+	reporter = parent->reporter;
+	mach = parent->mach;
+	getvarz = parent->getvarz;
+	checker = parent->checker;
+	layouts = parent->layouts;
+	tableDetailsReqd = parent->tableDetailsReqd;
+	nextInstrAddr = 0;
+	segments = parent->segments;
+	currentSegment = 0;
+	compilingModule = parent->compilingModule;
+	routinesPruned = 0;
+	wordsShared = 0;
+	maxLiftedParameters = parent->maxLiftedParameters;
+	routinesLifted = 0;
+	tailRoutine = NULL;
+	tailEntry = 0;
+	tailArgsSize = 0;
+	jobs = 1;
+}
+
 
 // Generates code to run a program.
 // showingTable is true iff entity description details
@@ -1090,7 +1284,10 @@ void Encoder::encodeRun (Program* theAST, bool showingTable) {
     tableDetailsReqd = showingTable;
     //startCodeGeneration();
     theAST->visit(this, new Frame (0, 0));
-	emit(mach->HALTop, 0, 0, 0);
+	if (!compilingModule)
+	  emit(mach->HALTop, 0, 0, 0);
+	encodeDeferredRoutines();
+	link();
   }
 
   // Decides run-time representation of a standard constant.
@@ -1168,12 +1365,87 @@ void Encoder::saveObjectProgram(string objectName) {
 	
 	//objectStreadddm.open("something.txt");
 
-  int addr;
-   
-	addr = mach->CB;
-	for (addr = mach->CB; addr < nextInstrAddr; addr++)
-		mach->code[addr]->write(objectStream);
+  // The whole file is packed into one buffer and written at once.
+	int count = nextInstrAddr - mach->CB;
+	vector<int> wide;
+	for (int addr = mach->CB; addr < nextInstrAddr; addr++)
+		if (mach->code[addr].isWide())
+			wide.push_back(addr);
+	StackDepth* stackDepth = new StackDepth(mach);
+	if (count > 0)
+		stackDepth->analyze(nextInstrAddr);
+	int routines = stackDepth->entries.size();
+	int size = Instruction::headerSize + 4 * count + 8 * wide.size() + 8 * routines;
+	vector<unsigned char> bytes(size);
+	Instruction::putWord(&bytes[0], Instruction::objectMagic);
+	Instruction::putWord(&bytes[4], Instruction::objectVersion);
+	Instruction::putWord(&bytes[8], count);
+	Instruction::putWord(&bytes[12], 0);  // execution starts at CB
+	Instruction::putWord(&bytes[16], wide.size());
+	Instruction::putWord(&bytes[20], routines);
+	unsigned char* next = &bytes[Instruction::headerSize];
+	for (int addr = mach->CB; addr < nextInstrAddr; addr++, next += 4)
+		mach->code[addr].encode(next);
+	for (int w = 0; w < (signed) wide.size(); w++, next += 8) {
+		Instruction::putWord(next, wide[w] - mach->CB);
+		Instruction::putWord(next + 4, mach->code[wide[w]].d);
+	}
+	for (int k = 0; k < routines; k++, next += 8) {
+		Instruction::putWord(next, stackDepth->entries[k] - mach->CB);
+		Instruction::putWord(next + 4, stackDepth->depths[k]);
+	}
+	objectStream.write((char*) &bytes[0], size);
 	}
+
+void Encoder::saveObjectUnit(string objectName) {
+    ObjectUnit* unit = new ObjectUnit();
+    unit->hasMain = !compilingModule;
+    unit->code.assign(mach->code.begin() + mach->CB, mach->code.begin() + nextInstrAddr);
+    for (int k = 0; k < (signed) segments.size(); k++) {
+      Segment* segment = segments[k];
+      if (segment->symbol != "")
+        continue;
+      for (int i = 0; i < (signed) segment->relocations.size(); i++) {
+        int addr = segment->address + segment->relocations[i] - mach->CB;
+        Segment* target = segments[segment->targets[i]];
+        if (target->symbol == "")
+          unit->relocated.push_back(addr);
+        else {
+          unit->importAddrs.push_back(addr);
+          unit->importNames.push_back(target->symbol);
+          unit->importSignatures.push_back(target->signature);
+        }
+      }
+    }
+    for (int e = 0; e < (signed) exportSegments.size(); e++) {
+      unit->exportAddrs.push_back(segments[exportSegments[e]]->address - mach->CB);
+      unit->exportNames.push_back(exportNames[e]);
+      unit->exportSignatures.push_back(exportSignatures[e]);
+    }
+    unit->constantNames = exportConstantNames;
+    unit->constantValues = exportConstantValues;
+    unit->importedConstantNames = importConstantNames;
+    unit->importedConstantValues = importConstantValues;
+    unit->exposedWords = exposedWords;
+    unit->write(objectName);
+  }
+
+void Encoder::checkModuleDeclarations(Declaration* D) {
+    vector<Declaration*> decls;
+    checker->topLevelDeclarations(D, decls);
+    for (int i = 0; i < (signed) decls.size(); i++) {
+      string kind = decls[i]->class_type();
+      if (kind == "VARDECLARATION" || kind == "INITVARDECLARATION")
+        reporter->reportError("a module can't declare variable %", checker->declaredName(decls[i]),
+                              decls[i]->position);
+      else if (kind == "CONSTDECLARATION") {
+        string value = ((ConstDeclaration*) decls[i])->E->class_type();
+        if (value != "INTEGEREXPRESSION" && value != "CHARACTEREXPRESSION")
+          reporter->reportError("constant % of a module must be a literal", checker->declaredName(decls[i]),
+                                decls[i]->position);
+      }
+    }
+  }
       
 
   void Encoder::writeTableDetails(AST* ast) {
@@ -1191,32 +1463,651 @@ void Encoder::saveObjectProgram(string objectName) {
 
   // Appends an instruction, with the given fields, to the object code.
   void Encoder::emit (int op, int n, int r, int d) {
-    Instruction* nextInstr = new Instruction();
     if (n > 255) {
         reporter->reportRestriction("length of operand can't exceed 255 words");
         n = 255; // to allow code generation to continue
     }
-    nextInstr->op = op;
-    nextInstr->n = n;
-    nextInstr->r = r;
-    nextInstr->d = d;
-    if (nextInstrAddr == mach->PB)
-      reporter->reportRestriction("too many instructions for code segment");
-    else {
-		mach->code[nextInstrAddr] = nextInstr;
-        nextInstrAddr = nextInstrAddr + 1;
+    Segment* segment = segments[currentSegment];
+    Instruction nextInstr;
+    nextInstr.op = op;
+    nextInstr.n = n;
+    nextInstr.r = r;
+    nextInstr.d = d;
+    if (r == mach->CBr && (op == mach->JUMPop || op == mach->JUMPIFop || op == mach->CALLop || op == mach->LOADAop)) {
+      // A code address in this segment, unless emitRoutine says otherwise.
+      segment->relocations.push_back(nextInstrAddr);
+      segment->targets.push_back(currentSegment);
     }
+    segment->code.push_back(nextInstr);
+    nextInstrAddr = nextInstrAddr + 1;
+  }
+
+  void Encoder::emitRoutine (int op, int n, ObjectAddress* address) {
+    emit(op, n, mach->CBr, 0);
+    segments[currentSegment]->targets.back() = address->displacement;
   }
 
   // Patches the d-field of the instruction at address addr.
   void Encoder::patch (int addr, int d) {
-	  mach->code[addr]->d = d;
+	  segments[currentSegment]->code[addr].d = d;
+  }
+
+  int Encoder::beginSegment (Declaration* routine) {
+    int outer = currentSegment;
+    currentSegment = segments.size();
+    segments.push_back(new Segment());
+    if (exportedDeclarations.count(routine) > 0) {
+      exportSegments.push_back(currentSegment);
+      exportNames.push_back(checker->declaredName(routine));
+      exportSignatures.push_back(routineSignature(routine));
+    }
+    nextInstrAddr = 0;
+    return outer;
+  }
+
+  void Encoder::endSegment (int outer) {
+    currentSegment = outer;
+    nextInstrAddr = segments[outer]->code.size();
+  }
+
+  Object* Encoder::encodeRoutineDeclaration (Declaration* routine, Frame* frame) {
+    if (!checker->isReachable(routine)) {
+      routinesPruned++;
+      return new Integer(0);
+    }
+    if (importedDeclarations.count(routine) > 0)
+      return encodeImportedRoutine(routine);
+    int level = routineLevel(routine, frame);
+    int outerSegment = beginSegment(routine);
+    routine->entity = new KnownRoutine(mach->closureSize, level, currentSegment);
+    writeTableDetails(routine);
+    if (parent == NULL)
+      routineJobs.push_back(new RoutineJob(routine, currentSegment));
+    else
+      encodeRoutine(routine, level);
+    endSegment(outerSegment);
+    return new Integer(0);
+  }
+
+  void Encoder::encodeRoutine (Declaration* routine, int level) {
+    string kind = routine->class_type();
+    FormalParameterSequence* FPS;
+    AST* body;
+    if (kind == "FUNCDECLARATION") {
+      FPS = ((FuncDeclaration*) routine)->FPS;
+      body = ((FuncDeclaration*) routine)->E;
+    } else if (kind == "PROCDECLARATION") {
+      FPS = ((ProcDeclaration*) routine)->FPS;
+      body = ((ProcDeclaration*) routine)->C;
+    } else if (kind == "USERUNARYOPERATORDECLARATION") {
+      FPS = ((UserUnaryOperatorDeclaration*) routine)->FPS;
+      body = ((UserUnaryOperatorDeclaration*) routine)->E;
+    } else {
+      FPS = ((UserBinaryOperatorDeclaration*) routine)->FPS;
+      body = ((UserBinaryOperatorDeclaration*) routine)->E;
+    }
+
+    int argsSize = 0;
+    int valSize = 0;
+    if (level == mach->maxRoutineLevel)
+      reporter->reportRestriction(kind == "PROCDECLARATION" ? "can't nest routines so deeply"
+                                                           : "can't nest routines more than 7 deep");
+    else {
+      vector<RuntimeEntity*> outer;
+      int extraSize = bindLiftedParameters(routine, level + 1, outer);
+      Frame* frame1 = new Frame(level + 1, extraSize);
+      argsSize = extraSize + ((Integer*) FPS->visit(this, frame1))->value;
+      Frame* frame2 = new Frame(level + 1, mach->linkDataSize);
+      // Only functions and procedures have their self tail calls made jumps.
+      Object* result;
+      if (kind == "FUNCDECLARATION" || kind == "PROCDECLARATION")
+        result = encodeRoutineBody(routine, body, argsSize, frame2);
+      else
+        result = body->visit(this, frame2);
+      if (kind != "PROCDECLARATION")
+        valSize = ((Integer*) result)->value;
+      unbindLiftedParameters(routine, outer);
+    }
+    emit(mach->RETURNop, valSize, 0, argsSize);
+  }
+
+  void Encoder::work (int worker) {
+    for (int j = parent->nextJob++; j < (signed) parent->routineJobs.size(); j = parent->nextJob++) {
+      RoutineJob* job = parent->routineJobs[j];
+      reporter = job->reporter;
+      job->worker = worker;
+      job->firstNested = segments.size();
+      currentSegment = job->segment;
+      nextInstrAddr = 0;
+      encodeRoutine(job->routine, 0);
+      job->endNested = segments.size();
+    }
+  }
+
+  // Jobs are numbered in the order their routines were declared, as are
+  // their segments, so that the segments can be put back in the order of
+  // a single walk: each job's segment followed by those of the routines
+  // nested in it, which are numbered by the worker that generated them.
+  void Encoder::encodeDeferredRoutines () {
+    int count = routineJobs.size();
+    if (count == 0)
+      return;
+    vector<Encoder*> workers;
+    for (int w = 0; w < jobs && w < count; w++)
+      workers.push_back(new Encoder(this));
+    nextJob = 0;
+    vector<thread> threads;
+    for (int w = 1; w < (signed) workers.size(); w++)
+      threads.push_back(thread(&Encoder::work, workers[w], w));
+    workers[0]->work(0);
+    for (int t = 0; t < (signed) threads.size(); t++)
+      threads[t].join();
+
+    int given = segments.size();
+    vector<Segment*> placed;
+    vector<int> number(given);                         // main encoder's number -> place
+    vector<vector<int> > workerNumber(workers.size());  // worker's number -> place
+    vector<int> numbering;                             // place -> worker that made it, or -1
+    int j = 0;
+    for (int k = 0; k < given; k++) {
+      number[k] = placed.size();
+      placed.push_back(segments[k]);
+      if (j < count && routineJobs[j]->segment == k) {
+        RoutineJob* job = routineJobs[j++];
+        Encoder* worker = workers[job->worker];
+        workerNumber[job->worker].resize(worker->segments.size());
+        numbering.push_back(job->worker);
+        for (int n = job->firstNested; n < job->endNested; n++) {
+          workerNumber[job->worker][n] = placed.size();
+          placed.push_back(worker->segments[n]);
+          numbering.push_back(job->worker);
+        }
+      } else
+        numbering.push_back(-1);
+    }
+    for (int k = 0; k < (signed) placed.size(); k++) {
+      vector<int>& targets = placed[k]->targets;
+      for (int i = 0; i < (signed) targets.size(); i++)
+        targets[i] = (targets[i] < given) ? number[targets[i]] : workerNumber[numbering[k]][targets[i]];
+    }
+    for (int e = 0; e < (signed) exportSegments.size(); e++)
+      exportSegments[e] = number[exportSegments[e]];
+    segments = placed;
+    currentSegment = number[currentSegment];
+    nextInstrAddr = segments[currentSegment]->code.size();
+
+    for (int w = 0; w < (signed) workers.size(); w++) {
+      routinesPruned += workers[w]->routinesPruned;
+      wordsShared += workers[w]->wordsShared;
+      routinesLifted += workers[w]->routinesLifted;
+      exposedWords.insert(workers[w]->exposedWords.begin(), workers[w]->exposedWords.end());
+    }
+    for (j = 0; j < count; j++)
+      routineJobs[j]->reporter->release();
+    routineJobs.clear();
+  }
+
+  // The main program comes first, so that execution starts at CB, then
+  // the routines in the order they were declared.
+  void Encoder::link () {
+    int addr = mach->CB;
+    for (int k = 0; k < (signed) segments.size(); k++)
+      if (segments[k]->symbol == "") {
+        segments[k]->address = addr;
+        addr += segments[k]->code.size();
+      }
+    mach->setCodeSize(addr - mach->CB);
+    for (int k = 0; k < (signed) segments.size(); k++) {
+      Segment* segment = segments[k];
+      if (segment->symbol != "")
+        continue;
+      // Calls of routines of other units are left for the linker of units.
+      for (int i = 0; i < (signed) segment->relocations.size(); i++)
+        if (segments[segment->targets[i]]->symbol == "")
+          segment->code[segment->relocations[i]].d += segments[segment->targets[i]]->address;
+      copy(segment->code.begin(), segment->code.end(), mach->code.begin() + segment->address);
+    }
+    nextInstrAddr = addr;
+  }
+
+  // CASE COMMANDS
+
+bool Encoder::caseTableDense(vector<int>& labels) {
+    int range = labels.back() - labels.front() + 1;
+    return labels.size() >= 4 && range <= 2 * (signed) labels.size() && range <= 255;
+  }
+
+  // Checks the selector against the label range, then jumps indirectly
+  // through a table of JUMPs, one per value in the range. The LOADA of
+  // the table carries the table's length in its n-field so that the
+  // passes over the object code keep the table intact.
+
+void Encoder::encodeCaseTable(vector<int>& labels, vector<int>& arms, int elseArm, int selector,
+                              Frame* frame, vector<int>& jumpAddrs, vector<int>& jumpArms) {
+    int r = displayRegister(frame->level, frame->level);
+    int low = labels.front();
+    int high = labels.back();
+
+    emit(mach->LOADop, 1, r, selector);
+    emit(mach->LOADLop, 0, 0, low);
+    emit(mach->CALLop, mach->SBr, mach->PBr, mach->ltDisplacement);
+    emitCaseJump(mach->JUMPIFop, mach->trueRep, elseArm, jumpAddrs, jumpArms);
+    emit(mach->LOADop, 1, r, selector);
+    emit(mach->LOADLop, 0, 0, high);
+    emit(mach->CALLop, mach->SBr, mach->PBr, mach->gtDisplacement);
+    emitCaseJump(mach->JUMPIFop, mach->trueRep, elseArm, jumpAddrs, jumpArms);
+
+    emit(mach->LOADop, 1, r, selector);
+    if (low != 0) {
+      emit(mach->LOADLop, 0, 0, low);
+      emit(mach->CALLop, mach->SBr, mach->PBr, mach->subDisplacement);
+    }
+    int tableAddr = nextInstrAddr;
+    emit(mach->LOADAop, high - low + 1, mach->CBr, 0);
+    emit(mach->CALLop, mach->SBr, mach->PBr, mach->addDisplacement);
+    emit(mach->JUMPIop, 0, 0, 0);
+    patch(tableAddr, nextInstrAddr);
+
+    int k = 0;
+    for (int value = low; value <= high; value++) {
+      if (labels[k] == value)
+        emitCaseJump(mach->JUMPop, 0, arms[k++], jumpAddrs, jumpArms);
+      else
+        emitCaseJump(mach->JUMPop, 0, elseArm, jumpAddrs, jumpArms);
+    }
+  }
+
+  // Binary search on labels[low..high]; a few labels are tested in turn.
+
+void Encoder::encodeCaseTree(vector<int>& labels, vector<int>& arms, int low, int high, int elseArm,
+                             int selector, Frame* frame, vector<int>& jumpAddrs, vector<int>& jumpArms) {
+    int r = displayRegister(frame->level, frame->level);
+
+    if (high - low < 3) {
+      for (int k = low; k <= high; k++) {
+        emit(mach->LOADop, 1, r, selector);
+        emit(mach->LOADLop, 0, 0, labels[k]);
+        emit(mach->LOADLop, 0, 0, 1);
+        emit(mach->CALLop, mach->SBr, mach->PBr, mach->eqDisplacement);
+        emitCaseJump(mach->JUMPIFop, mach->trueRep, arms[k], jumpAddrs, jumpArms);
+      }
+      emitCaseJump(mach->JUMPop, 0, elseArm, jumpAddrs, jumpArms);
+      return;
+    }
+
+    int mid = (low + high) / 2;
+    emit(mach->LOADop, 1, r, selector);
+    emit(mach->LOADLop, 0, 0, labels[mid]);
+    emit(mach->CALLop, mach->SBr, mach->PBr, mach->ltDisplacement);
+    int lowerAddr = nextInstrAddr;
+    emit(mach->JUMPIFop, mach->trueRep, mach->CBr, 0);
+    encodeCaseTree(labels, arms, mid, high, elseArm, selector, frame, jumpAddrs, jumpArms);
+    patch(lowerAddr, nextInstrAddr);
+    encodeCaseTree(labels, arms, low, mid - 1, elseArm, selector, frame, jumpAddrs, jumpArms);
+  }
+
+void Encoder::emitCaseJump(int op, int n, int arm, vector<int>& jumpAddrs, vector<int>& jumpArms) {
+    jumpAddrs.push_back(nextInstrAddr);
+    jumpArms.push_back(arm);
+    emit(op, n, mach->CBr, 0);
+  }
+
+  // TAIL CALLS
+
+Object* Encoder::encodeRoutineBody(Declaration* routine, AST* body, int argsSize, Frame* frame) {
+    Declaration* outerRoutine = tailRoutine;
+    int outerEntry = tailEntry;
+    int outerArgsSize = tailArgsSize;
+    vector<AST*> outerCalls = tailCalls;
+
+    tailRoutine = routine;
+    tailEntry = nextInstrAddr;
+    tailArgsSize = argsSize;
+    tailCalls.clear();
+    findTailCalls(body);
+    Object* result = body->visit(this, frame);
+
+    tailRoutine = outerRoutine;
+    tailEntry = outerEntry;
+    tailArgsSize = outerArgsSize;
+    tailCalls = outerCalls;
+    return result;
+  }
+
+Object* Encoder::encodeImportedRoutine(Declaration* routine) {
+    Segment* segment = new Segment();
+    segment->symbol = checker->declaredName(routine);
+    segment->signature = routineSignature(routine);
+    segments.push_back(segment);
+    routine->entity = new KnownRoutine(mach->closureSize, 0, segments.size() - 1);
+    writeTableDetails(routine);
+    return new Integer(0);
+  }
+
+string Encoder::routineSignature(Declaration* routine) {
+    string kind = routine->class_type();
+    FormalParameterSequence* FPS;
+    TypeDenoter* T = NULL;
+    if (kind == "FUNCDECLARATION") {
+      FPS = ((FuncDeclaration*) routine)->FPS;
+      T = ((FuncDeclaration*) routine)->T;
+    }
+    else if (kind == "USERUNARYOPERATORDECLARATION") {
+      FPS = ((UserUnaryOperatorDeclaration*) routine)->FPS;
+      T = ((UserUnaryOperatorDeclaration*) routine)->T;
+    }
+    else if (kind == "USERBINARYOPERATORDECLARATION") {
+      FPS = ((UserBinaryOperatorDeclaration*) routine)->FPS;
+      T = ((UserBinaryOperatorDeclaration*) routine)->T;
+    }
+    else
+      FPS = ((ProcDeclaration*) routine)->FPS;
+
+    char result[16] = "";
+    if (T != NULL)
+      sprintf(result, "%d", typeSize(T));
+    return "(" + parametersSignature(FPS) + ")" + result;
+  }
+
+  // Each parameter is c (constant), v (variable), r (result) or u (value-
+  // result) with the size of its type, or p or f with the signature of the
+  // routine it stands for.
+string Encoder::parametersSignature(FormalParameterSequence* FPS) {
+    string kind = FPS->class_type();
+    FormalParameter* FP;
+    string rest = "";
+    if (kind == "MULTIPLEFORMALPARAMETERSEQUENCE") {
+      FP = ((MultipleFormalParameterSequence*) FPS)->FP;
+      rest = "," + parametersSignature(((MultipleFormalParameterSequence*) FPS)->FPS);
+    }
+    else if (kind == "SINGLEFORMALPARAMETERSEQUENCE")
+      FP = ((SingleFormalParameterSequence*) FPS)->FP;
+    else
+      return "";
+
+    kind = FP->class_type();
+    char param[16];
+    if (kind == "CONSTFORMALPARAMETER")
+      sprintf(param, "c%d", typeSize(((ConstFormalParameter*) FP)->T));
+    else if (kind == "VARFORMALPARAMETER")
+      sprintf(param, "v%d", typeSize(((VarFormalParameter*) FP)->T));
+    else if (kind == "RESULTFORMALPARAMETER")
+      sprintf(param, "r%d", typeSize(((ResultFormalParameter*) FP)->T));
+    else if (kind == "VALUERESULTFORMALPARAMETER")
+      sprintf(param, "u%d", typeSize(((ValueResultFormalParameter*) FP)->T));
+    else if (kind == "PROCFORMALPARAMETER")
+      return "p(" + parametersSignature(((ProcFormalParameter*) FP)->FPS) + ")" + rest;
+    else {
+      FuncFormalParameter* func = (FuncFormalParameter*) FP;
+      sprintf(param, "%d", typeSize(func->T));
+      return "f(" + parametersSignature(func->FPS) + ")" + param + rest;
+    }
+    return param + rest;
+  }
+
+void Encoder::findTailCalls(AST* body) {
+    string kind = body->class_type();
+    if (kind == "CALLEXPRESSION") {
+      if (((CallExpression*) body)->I->decl == tailRoutine)
+        tailCalls.push_back(body);
+    }
+    else if (kind == "CALLCOMMAND") {
+      if (((CallCommand*) body)->I->decl == tailRoutine)
+        tailCalls.push_back(body);
+    }
+    else if (kind == "IFEXPRESSION") {
+      findTailCalls(((IfExpression*) body)->E2);
+      findTailCalls(((IfExpression*) body)->E3);
+    }
+    else if (kind == "LETEXPRESSION")
+      findTailCalls(((LetExpression*) body)->E);
+    else if (kind == "IFCOMMAND") {
+      findTailCalls(((IfCommand*) body)->C1);
+      findTailCalls(((IfCommand*) body)->C2);
+    }
+    else if (kind == "LETCOMMAND")
+      findTailCalls(((LetCommand*) body)->C);
+    else if (kind == "SEQUENTIALCOMMAND")
+      findTailCalls(((SequentialCommand*) body)->C2);
+  }
+
+bool Encoder::tailArgumentsSafe(ActualParameterSequence* APS, int level) {
+    ActualParameter* AP;
+    if (APS->class_type() == "EMPTYACTUALPARAMETERSEQUENCE")
+      return true;
+    else if (APS->class_type() == "SINGLEACTUALPARAMETERSEQUENCE")
+      AP = ((SingleActualParameterSequence*) APS)->AP;
+    else {
+      AP = ((MultipleActualParameterSequence*) APS)->AP;
+      if (!tailArgumentsSafe(((MultipleActualParameterSequence*) APS)->APS, level))
+        return false;
+    }
+
+    if (AP->class_type() == "CONSTACTUALPARAMETER")
+      return true;
+    if (AP->class_type() != "VARACTUALPARAMETER")
+      return false;
+    Vname* V = ((VarActualParameter*) AP)->V;
+    while (V->class_type() != "SIMPLEVNAME")
+      V = (V->class_type() == "DOTVNAME") ? ((DotVname*) V)->V : ((SubscriptVname*) V)->V;
+    RuntimeEntity* entity = ((Declaration*) ((SimpleVname*) V)->I->decl)->entity;
+    return entity->class_type() != "KNOWNADDRESS" || ((KnownAddress*) entity)->address->level != level;
+  }
+
+bool Encoder::encodeTailCall(AST* call, ActualParameterSequence* APS, Frame* frame) {
+    if (find(tailCalls.begin(), tailCalls.end(), call) == tailCalls.end() ||
+        !tailArgumentsSafe(APS, frame->level))
+      return false;
+
+    APS->visit(this, frame);
+    encodeLiftedArguments(tailRoutine, frame);
+    if (tailArgsSize > 0)
+      emit(mach->STOREop, tailArgsSize, mach->LBr, -tailArgsSize);
+    if (frame->size > mach->linkDataSize)
+      emit(mach->POPop, 0, 0, frame->size - mach->linkDataSize);
+    emit(mach->JUMPop, 0, mach->CBr, tailEntry);
+    return true;
+  }
+
+  // LAMBDA LIFTING
+
+int Encoder::routineLevel(Declaration* routine, Frame* frame) {
+    if (maxLiftedParameters < 0 || frame->level == 0)
+      return frame->level;
+
+    // What the routine names, and what the lifted routines it calls are
+    // passed, from outside it.
+    vector<Declaration*> named = routine->dependencies;
+    for (int i = 0; i < (signed) routine->dependencies.size(); i++)
+      if (liftedFree.count(routine->dependencies[i]) > 0) {
+        vector<Declaration*>& free = liftedFree[routine->dependencies[i]];
+        named.insert(named.end(), free.begin(), free.end());
+      }
+
+    vector<Declaration*> free;
+    for (int i = 0; i < (signed) named.size(); i++) {
+      RuntimeEntity* entity = named[i]->entity;
+      if (named[i] == routine || entity == NULL)
+        continue;
+      string kind = entity->class_type();
+      ObjectAddress* address = NULL;
+      if (kind == "KNOWNADDRESS")
+        address = ((KnownAddress*) entity)->address;
+      else if (kind == "UNKNOWNADDRESS")
+        address = ((UnknownAddress*) entity)->address;
+      else if (kind == "UNKNOWNVALUE")
+        address = ((UnknownValue*) entity)->address;
+      else if (kind == "UNKNOWNROUTINE")
+        address = ((UnknownRoutine*) entity)->address;
+      else if (kind == "KNOWNROUTINE" && ((KnownRoutine*) entity)->address->level > 0)
+        return frame->level;  // it would need the routine's static link
+      if (address != NULL && address->level > 0 &&
+          find(free.begin(), free.end(), named[i]) == free.end())
+        free.push_back(named[i]);
+    }
+
+    // A closure of the routine could not pass extra arguments.
+    if ((signed) free.size() > maxLiftedParameters || (!free.empty() && routine->passed))
+      return frame->level;
+    if (!free.empty())
+      liftedFree[routine] = free;
+    routinesLifted++;
+    return 0;
+  }
+
+int Encoder::bindLiftedParameters(Declaration* routine, int level, vector<RuntimeEntity*>& outer) {
+    if (liftedFree.count(routine) == 0)
+      return 0;
+    vector<Declaration*>& free = liftedFree[routine];
+    int extraSize = 0;
+    for (int i = 0; i < (signed) free.size(); i++) {
+      string kind = free[i]->entity->class_type();
+      if (kind == "UNKNOWNVALUE")
+        extraSize += free[i]->entity->size;
+      else if (kind == "UNKNOWNROUTINE")
+        extraSize += mach->closureSize;
+      else
+        extraSize += mach->addressSize;
+    }
+
+    int displacement = -extraSize;
+    for (int i = 0; i < (signed) free.size(); i++) {
+      RuntimeEntity* entity = free[i]->entity;
+      string kind = entity->class_type();
+      outer.push_back(entity);
+      if (kind == "UNKNOWNVALUE") {
+        free[i]->entity = new UnknownValue(entity->size, level, displacement);
+        displacement += entity->size;
+      }
+      else if (kind == "UNKNOWNROUTINE") {
+        free[i]->entity = new UnknownRoutine(mach->closureSize, level, displacement);
+        displacement += mach->closureSize;
+      }
+      else {
+        // Variables are passed by reference.
+        free[i]->entity = new UnknownAddress(mach->addressSize, level, displacement);
+        displacement += mach->addressSize;
+      }
+    }
+    return extraSize;
+  }
+
+void Encoder::unbindLiftedParameters(Declaration* routine, vector<RuntimeEntity*>& outer) {
+    for (int i = 0; i < (signed) outer.size(); i++)
+      liftedFree[routine][i]->entity = outer[i];
+  }
+
+void Encoder::encodeLiftedArguments(Declaration* routine, Frame* frame) {
+    if (liftedFree.count(routine) == 0)
+      return;
+    vector<Declaration*>& free = liftedFree[routine];
+    for (int i = 0; i < (signed) free.size(); i++) {
+      RuntimeEntity* entity = free[i]->entity;
+      string kind = entity->class_type();
+      if (kind == "KNOWNADDRESS") {
+        ObjectAddress* address = ((KnownAddress*) entity)->address;
+        exposeVariable(free[i], address);
+        emit(mach->LOADAop, 0, displayRegister(frame->level, address->level), address->displacement);
+      }
+      else if (kind == "UNKNOWNADDRESS") {
+        ObjectAddress* address = ((UnknownAddress*) entity)->address;
+        emit(mach->LOADop, mach->addressSize, displayRegister(frame->level, address->level), address->displacement);
+      }
+      else if (kind == "UNKNOWNVALUE") {
+        ObjectAddress* address = ((UnknownValue*) entity)->address;
+        emit(mach->LOADop, entity->size, displayRegister(frame->level, address->level), address->displacement);
+      }
+      else {
+        ObjectAddress* address = ((UnknownRoutine*) entity)->address;
+        emit(mach->LOADop, mach->closureSize, displayRegister(frame->level, address->level), address->displacement);
+      }
+    }
+  }
+
+  // STORAGE SHARING
+
+int Encoder::allocateVariables(Declaration* D, Frame* frame) {
+    vector<Declaration*> decls;
+    vector<VarDeclaration*> vars;
+    checker->topLevelDeclarations(D, decls);
+    for (int i = 0; i < (signed) decls.size(); i++)
+      if (decls[i]->class_type() == "VARDECLARATION")
+        vars.push_back((VarDeclaration*) decls[i]);
+    if (vars.size() < 2)
+      return 0;
+
+    // First fit, in order of declaration, avoiding the words of every
+    // variable already placed whose run of commands overlaps.
+    vector<int> offsets;
+    int areaSize = 0;
+    int total = 0;
+    for (int i = 0; i < (signed) vars.size(); i++) {
+      VarDeclaration* var = vars[i];
+      int size = typeSize(var->T);
+      int offset = 0;
+      bool moved = true;
+      while (moved) {
+        moved = false;
+        for (int k = 0; k < i; k++) {
+          VarDeclaration* other = vars[k];
+          bool overlaps = var->pinned || other->pinned ||
+            (var->firstUse <= var->lastUse && other->firstUse <= other->lastUse &&
+             var->firstUse <= other->lastUse && other->firstUse <= var->lastUse);
+          int otherSize = typeSize(other->T);
+          if (overlaps && offset < offsets[k] + otherSize && offsets[k] < offset + size) {
+            offset = offsets[k] + otherSize;
+            moved = true;
+          }
+        }
+      }
+      offsets.push_back(offset);
+      areaSize = max(areaSize, offset + size);
+      total += size;
+    }
+    if (areaSize == total)
+      return 0;
+
+    emit(mach->PUSHop, 0, 0, areaSize);
+    for (int i = 0; i < (signed) vars.size(); i++)
+      variableSlots[vars[i]] = frame->size + offsets[i];
+    wordsShared += total - areaSize;
+    return areaSize;
   }
 
   // DATA REPRESENTATION
 
 
   
+int Encoder::typeSize (TypeDenoter* T) {
+    lock_guard<recursive_mutex> guard(layouts->lock);
+    if (T->entity != NULL)
+      return T->entity->size;
+    return ((Integer*) T->visit(this, NULL))->value;
+  }
+
+int Encoder::layoutType (TypeDenoter* T) {
+    lock_guard<recursive_mutex> guard(layouts->lock);
+    if (T->entity != NULL)
+      return T->entity->size;
+
+    TypeDenoter* canon = layouts->find(T);
+    if (canon != NULL) {
+      layouts->share(canon, T);
+      return T->entity->size;
+    }
+
+    int size;
+    if (T->class_type() == "ARRAYTYPEDENOTER") {
+      ArrayTypeDenoter* array = (ArrayTypeDenoter*) T;
+      size = atoi(array->IL->spelling.c_str()) * typeSize(array->T);
+    } else
+      size = ((Integer*) ((RecordTypeDenoter*) T)->FT->visit(this, new Integer(0)))->value;
+    T->entity = new TypeRepresentation(size);
+    layouts->enter(T);
+    writeTableDetails(T);
+    return size;
+  }
+
   int Encoder::characterValuation (string spelling) {
   // Returns the machine representation of the given character literal.
 	  int temp = (int)spelling.at(1);
@@ -1257,6 +2148,7 @@ void Encoder::encodeStore(Vname* V, Frame* frame, int valSize) {
 	if (baseObject->class_type() == "KNOWNADDRESS") {
       ObjectAddress* address = ((KnownAddress*) baseObject)->address;
       if (V->indexed) {
+        exposeVariable(V, address);
         emit(mach->LOADAop, 0, displayRegister(frame->level, address->level),
              address->displacement + V->offset);
         emit(mach->CALLop, mach->SBr, mach->PBr, mach->addDisplacement);
@@ -1306,6 +2198,7 @@ void Encoder::encodeFetch(Vname* V, Frame* frame, int valSize) {
                               ((UnknownValue*) baseObject)->address :
                               ((KnownAddress*) baseObject)->address;
       if (V->indexed) {
+		  exposeVariable(V, address);
 		  emit(mach->LOADAop, 0, displayRegister(frame->level, address->level),
              address->displacement + V->offset);
 		  emit(mach->CALLop, mach->SBr, mach->PBr, mach->addDisplacement);
@@ -1340,6 +2233,7 @@ void Encoder::encodeFetch(Vname* V, Frame* frame, int valSize) {
     // If indexed = true, code will have been generated to load an index value.
 	if (baseObject->class_type() == "KNOWNADDRESS") {
 		ObjectAddress* address = ((KnownAddress*) baseObject)->address;
+		exposeVariable(V, address);
 		emit(mach->LOADAop, 0, displayRegister(frame->level, address->level),
            address->displacement + V->offset);
       if (V->indexed)
@@ -1360,6 +2254,22 @@ void Encoder::encodeFetch(Vname* V, Frame* frame, int valSize) {
     }
   }
 
+void Encoder::exposeVariable (Vname* V, ObjectAddress* address) {
+    while (V->class_type() != "SIMPLEVNAME")
+      V = (V->class_type() == "DOTVNAME") ? ((DotVname*) V)->V : ((SubscriptVname*) V)->V;
+    exposeVariable(((SimpleVname*) V)->I->decl, address);
+  }
+
+void Encoder::exposeVariable (AST* decl, ObjectAddress* address) {
+    int size = 1;
+    if (decl->class_type() == "VARDECLARATION")
+      size = typeSize(((VarDeclaration*) decl)->T);
+    else if (decl->class_type() == "INITVARDECLARATION")
+      size = typeSize(((InitVarDeclaration*) decl)->T);
+    for (int i = 0; i < size; i++)
+      exposedWords.insert(make_pair(address->level, address->displacement + i));
+  }
+
 
 
 
@@ -0,0 +1,218 @@
+#ifndef _FLOWGRAPH
+#define _FLOWGRAPH
+
+#include <vector>
+#include "../TAM/Instruction.h"
+#include "../TAM/Machine.h"
+#include "Relocator.h"
+
+using namespace std;
+
+// A maximal run of instructions that control enters only at the first
+// and leaves only after the last.
+
+class BasicBlock {
+
+public:
+	int start;  // address of the first instruction
+	int end;    // address after the last instruction
+	bool reached;
+	vector<int> successors;  // indices of the blocks control can pass to
+
+	BasicBlock (int start, int end) {
+		this->start = start;
+		this->end = end;
+		reached = false;
+	}
+};
+
+
+// Control-flow optimization of the object code in the TAM code store.
+//
+// Jumps whose target is another unconditional jump are threaded straight
+// to the final target, and a jump to a HALT or RETURN becomes a copy of
+// it. The code is then split into basic blocks; blocks that cannot be
+// reached from CB, or from a routine entry that is called or whose
+// address is taken, are deleted and the code store is compacted. Every
+// entry of a jump table is taken to be reachable from the code that
+// loads the table's address.
+
+class FlowGraph {
+
+	Machine* mach;
+	Relocator* relocator;
+
+	bool endsBlock (Instruction* instr);
+	int finalTarget (int addr, int end);
+	bool thread (int end);
+	void build (int end);
+	int blockAt (int addr);
+	void reach (int block);
+	bool removeUnreachable ();
+
+public:
+	vector<BasicBlock*> blocks;
+	int threaded;  // jumps retargeted by the last optimize
+	int removed;   // instructions removed by the last optimize
+
+	FlowGraph (Machine* mach);
+
+	// Optimizes the code from CB up to end, repeating until nothing
+	// changes, and returns the new end of the code.
+	int optimize (int end);
+};
+
+
+FlowGraph::FlowGraph (Machine* mach) {
+	this->mach = mach;
+	relocator = new Relocator(mach);
+	threaded = 0;
+	removed = 0;
+}
+
+bool FlowGraph::endsBlock (Instruction* instr) {
+	return instr->op == mach->JUMPop || instr->op == mach->JUMPIFop || instr->op == mach->JUMPIop ||
+		instr->op == mach->RETURNop || instr->op == mach->HALTop;
+}
+
+// Follows a chain of unconditional jumps starting at addr. A chain longer
+// than the code is a cycle, which is left alone.
+
+int FlowGraph::finalTarget (int addr, int end) {
+	int steps = 0;
+	while (addr >= mach->CB && addr < end && steps < end) {
+		Instruction* instr = &mach->code[addr];
+		if (instr->op != mach->JUMPop || instr->r != mach->CBr)
+			break;
+		addr = instr->d;
+		steps++;
+	}
+	return steps < end ? addr : -1;
+}
+
+bool FlowGraph::thread (int end) {
+	bool changed = false;
+	for (int addr = mach->CB; addr < end; addr++) {
+		Instruction* instr = &mach->code[addr];
+		if (!relocator->isCodeAddress(instr) || relocator->isJumpTable(instr))
+			continue;
+		int target = finalTarget(instr->d, end);
+		if (target < 0)
+			continue;
+		if (target != instr->d) {
+			instr->d = target;
+			threaded++;
+			changed = true;
+		}
+		if (instr->op == mach->JUMPop && target < end) {
+			Instruction* to = &mach->code[target];
+			if (to->op == mach->HALTop || to->op == mach->RETURNop) {
+				instr->op = to->op;
+				instr->n = to->n;
+				instr->r = to->r;
+				instr->d = to->d;
+				threaded++;
+				changed = true;
+			}
+		}
+	}
+	return changed;
+}
+
+void FlowGraph::build (int end) {
+	vector<bool> leader(end + 1, false);
+	leader[mach->CB] = true;
+	for (int addr = mach->CB; addr < end; addr++) {
+		Instruction* instr = &mach->code[addr];
+		if (relocator->isCodeAddress(instr) && instr->d >= mach->CB && instr->d < end)
+			leader[instr->d] = true;
+		if (endsBlock(instr))
+			leader[addr + 1] = true;
+	}
+
+	blocks.clear();
+	int start = mach->CB;
+	for (int addr = mach->CB + 1; addr <= end; addr++)
+		if (leader[addr] || addr == end) {
+			blocks.push_back(new BasicBlock(start, addr));
+			start = addr;
+		}
+
+	for (int b = 0; b < (signed) blocks.size(); b++) {
+		BasicBlock* block = blocks[b];
+		for (int addr = block->start; addr < block->end; addr++) {
+			Instruction* instr = &mach->code[addr];
+			if (relocator->isCodeAddress(instr) && blockAt(instr->d) >= 0)
+				block->successors.push_back(blockAt(instr->d));
+			if (relocator->isJumpTable(instr))
+				for (int entry = 1; entry < instr->n; entry++)
+					if (blockAt(instr->d + entry) >= 0)
+						block->successors.push_back(blockAt(instr->d + entry));
+		}
+		Instruction* last = &mach->code[block->end - 1];
+		if (!endsBlock(last) || last->op == mach->JUMPIFop)
+			if (b + 1 < (signed) blocks.size())
+				block->successors.push_back(b + 1);
+	}
+}
+
+int FlowGraph::blockAt (int addr) {
+	int low = 0, high = (signed) blocks.size() - 1;
+	while (low <= high) {
+		int mid = (low + high) / 2;
+		if (addr < blocks[mid]->start)
+			high = mid - 1;
+		else if (addr >= blocks[mid]->end)
+			low = mid + 1;
+		else
+			return mid;
+	}
+	return -1;
+}
+
+void FlowGraph::reach (int block) {
+	vector<int> work;
+	work.push_back(block);
+	while (!work.empty()) {
+		BasicBlock* b = blocks[work.back()];
+		work.pop_back();
+		if (b->reached)
+			continue;
+		b->reached = true;
+		for (int i = 0; i < (signed) b->successors.size(); i++)
+			work.push_back(b->successors[i]);
+	}
+}
+
+bool FlowGraph::removeUnreachable () {
+	bool changed = false;
+	if (!blocks.empty())
+		reach(0);
+	for (int b = 0; b < (signed) blocks.size(); b++)
+		if (!blocks[b]->reached) {
+			for (int addr = blocks[b]->start; addr < blocks[b]->end; addr++)
+				relocator->remove(addr);
+			changed = true;
+		}
+	return changed;
+}
+
+int FlowGraph::optimize (int end) {
+	int start = end;
+	bool changed = true;
+	threaded = 0;
+
+	while (changed) {
+		changed = thread(end);
+		build(end);
+		if (removeUnreachable()) {
+			end = relocator->compact(end);
+			changed = true;
+		}
+	}
+	removed = start - end;
+	return end;
+}
+
+
+#endif
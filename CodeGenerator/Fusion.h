@@ -0,0 +1,138 @@
+#ifndef _FUSION
+#define _FUSION
+
+#include <vector>
+#include "../TAM/Instruction.h"
+#include "../TAM/Machine.h"
+#include "Relocator.h"
+
+using namespace std;
+
+// Superinstruction formation over the object code in the TAM code store.
+//
+// Sequences that occur often in generated code, such as a load followed
+// by a call of an arithmetic or relational primitive, or a comparison
+// followed by a conditional jump, are each replaced by one FUSED
+// instruction standing for the whole sequence (see Machine), so that the
+// interpreter dispatches once where it dispatched two or three times.
+// The code is scanned from left to right, trying the three-instruction
+// patterns before the two-instruction ones; a sequence is only fused when
+// no jump lands inside it. This is the last pass over the code: none of
+// the other passes knows the FUSED instruction.
+
+class Fusion {
+
+	Machine* mach;
+	Relocator* relocator;
+
+	// Addresses of instructions that control can enter other than by
+	// falling through from the instruction before.
+	vector<bool> target;
+
+	bool isPureCall (Instruction* instr);
+	bool isWordLoad (Instruction* instr);
+	bool fitsByte (int d);
+	void findTargets (int end);
+	void fuse (int addr, int kind, int r, int d, int length);
+
+public:
+	int fused;  // superinstructions formed by the last optimize
+
+	Fusion (Machine* mach);
+
+	// Fuses the code from CB up to end and returns the new end of the code.
+	int optimize (int end);
+};
+
+
+Fusion::Fusion (Machine* mach) {
+	this->mach = mach;
+	relocator = new Relocator(mach);
+	fused = 0;
+}
+
+// True iff instr calls a primitive from not to ne, which only works on
+// the stack.
+bool Fusion::isPureCall (Instruction* instr) {
+	return instr->op == mach->CALLop && instr->r == mach->PBr &&
+		instr->d >= mach->notDisplacement && instr->d <= mach->neDisplacement;
+}
+
+bool Fusion::isWordLoad (Instruction* instr) {
+	return instr->op == mach->LOADop && instr->n == 1 && instr->r != mach->CBr;
+}
+
+bool Fusion::fitsByte (int d) {
+	return d >= -128 && d <= 127;
+}
+
+void Fusion::findTargets (int end) {
+	target.assign(end + 1, false);
+	target[mach->CB] = true;
+	for (int addr = mach->CB; addr < end; addr++) {
+		Instruction* instr = &mach->code[addr];
+		if (relocator->isCodeAddress(instr) && instr->d >= mach->CB && instr->d <= end)
+			target[instr->d] = true;
+		if (relocator->isJumpTable(instr))
+			for (int entry = 0; entry < instr->n && instr->d + entry < end; entry++)
+				target[instr->d + entry] = true;
+	}
+}
+
+// Rewrites the length instructions at addr as one FUSED instruction.
+void Fusion::fuse (int addr, int kind, int r, int d, int length) {
+	Instruction* instr = &mach->code[addr];
+	instr->op = mach->FUSEDop;
+	instr->n = kind;
+	instr->r = r;
+	instr->d = d;
+	for (int i = 1; i < length; i++)
+		relocator->remove(addr + i);
+	fused++;
+}
+
+int Fusion::optimize (int end) {
+	fused = 0;
+	findTargets(end);
+	for (int addr = mach->CB; addr < end; addr++) {
+		Instruction* first = &mach->code[addr];
+		Instruction* second = (addr + 1 < end && !target[addr + 1]) ? &mach->code[addr + 1] : NULL;
+		Instruction* third = (second != NULL && addr + 2 < end && !target[addr + 2]) ? &mach->code[addr + 2] : NULL;
+
+		if (third != NULL && isWordLoad(first) && isWordLoad(second) && first->r == second->r &&
+			fitsByte(first->d) && fitsByte(second->d) && isPureCall(third)) {
+			fuse(addr, mach->loadLoadCallKind + third->d, first->r, first->d * 256 + (second->d & 0xFF), 3);
+			addr += 2;
+		}
+		else if (third != NULL && first->op == mach->LOADAop && first->r != mach->CBr &&
+			second->op == mach->CALLop && second->r == mach->PBr && second->d == mach->addDisplacement &&
+			third->op == mach->LOADIop && third->n == 1) {
+			fuse(addr, mach->indexLoadKind, first->r, first->d, 3);
+			addr += 2;
+		}
+		else if (second != NULL && isWordLoad(first) && isPureCall(second)) {
+			fuse(addr, mach->loadCallKind + second->d, first->r, first->d, 2);
+			addr++;
+		}
+		else if (second != NULL && first->op == mach->LOADLop && isPureCall(second)) {
+			fuse(addr, mach->literalCallKind + second->d, 0, first->d, 2);
+			addr++;
+		}
+		else if (second != NULL && isPureCall(first) && second->op == mach->JUMPIFop &&
+			second->r == mach->CBr && (second->n == 0 || second->n == 1)) {
+			fuse(addr, mach->callJumpKind + 32 * second->n + first->d, mach->CBr, second->d, 2);
+			addr++;
+		}
+		else if (second != NULL && isWordLoad(first) && isWordLoad(second) && first->r == second->r &&
+			fitsByte(first->d) && fitsByte(second->d)) {
+			fuse(addr, mach->loadLoadKind, first->r, first->d * 256 + (second->d & 0xFF), 2);
+			addr++;
+		}
+	}
+	if (fused > 0)
+		end = relocator->compact(end);
+	return end;
+}
+
+
+#endif
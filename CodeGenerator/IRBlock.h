@@ -0,0 +1,29 @@
+#ifndef _IRBLOCK
+#define _IRBLOCK
+
+#include <vector>
+#include "IRInstruction.h"
+
+using namespace std;
+
+// A basic block of IR instructions. Control enters at the first
+// instruction and leaves after the last, either by the jump there or by
+// falling through to the block named by fallthrough.
+
+class IRBlock {
+
+public:
+	int address;     // address of the block in the code it was built from
+	int entryDepth;  // words above the frame base on entry
+	vector<IRInstruction*> instructions;
+	int fallthrough; // block that follows when control falls through, or -1
+
+	IRBlock (int address) {
+		this->address = address;
+		entryDepth = -1;
+		fallthrough = -1;
+	}
+};
+
+
+#endif
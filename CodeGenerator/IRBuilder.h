@@ -0,0 +1,411 @@
+#ifndef _IRBUILDER
+#define _IRBUILDER
+
+#include <string>
+#include <vector>
+#include "../TAM/Instruction.h"
+#include "../TAM/Machine.h"
+#include "IRProgram.h"
+
+using namespace std;
+
+// Builds the IR of the object program held in the TAM code store.
+//
+// The code is split into routines (the main program, and every address
+// that is called or whose closure is taken) and basic blocks. The stack
+// depth on entry to each block is found by following the stack effect of
+// each instruction; then each block is translated by simulating its
+// stack, so that every word pushed becomes a virtual register.
+//
+// Code whose stack effect cannot be known statically is not translated:
+// build then returns NULL and failure says why.
+
+class IRBuilder {
+
+	Machine* mach;
+	IRProgram* program;
+	int end;
+
+	vector<int> blockAt;    // address -> block starting there, or -1
+	vector<int> blockEnd;   // block -> address after its last instruction
+	vector<int> routineAt;  // address -> routine entered there, or -1
+	vector<bool> inTable;   // address -> true iff a jump table entry
+
+	bool fail (string reason);
+	bool isTerminator (Instruction* instr);
+	bool findRoutines ();
+	void findBlocks ();
+	bool assignBlocks ();
+	bool successors (int b, vector<int>& succ);
+	bool stackEffect (int addr, int& pops, int& pushes);
+	bool computeDepths (IRRoutine* routine);
+	void findLevels ();
+	bool translate (int b);
+
+public:
+	string failure;
+
+	IRBuilder (Machine* mach);
+
+	// Builds the IR of the code from CB up to end.
+	IRProgram* build (int end);
+};
+
+
+IRBuilder::IRBuilder (Machine* mach) {
+	this->mach = mach;
+	program = NULL;
+	end = 0;
+}
+
+bool IRBuilder::fail (string reason) {
+	failure = reason;
+	return false;
+}
+
+bool IRBuilder::isTerminator (Instruction* instr) {
+	return instr->op == mach->JUMPop || instr->op == mach->JUMPIFop || instr->op == mach->JUMPIop ||
+		instr->op == mach->RETURNop || instr->op == mach->HALTop;
+}
+
+IRProgram* IRBuilder::build (int end) {
+	this->end = end;
+	program = new IRProgram();
+	failure = "";
+
+	if (!findRoutines())
+		return NULL;
+	findBlocks();
+	if (!assignBlocks())
+		return NULL;
+	for (int k = 0; k < (signed) program->routines.size(); k++)
+		if (!computeDepths(program->routines[k]))
+			return NULL;
+	findLevels();
+	for (int k = 0; k < (signed) program->routines.size(); k++) {
+		IRRoutine* routine = program->routines[k];
+		for (int i = 0; i < (signed) routine->blocks.size(); i++)
+			if (!translate(routine->blocks[i]))
+				return NULL;
+	}
+	return program;
+}
+
+// Routines are entered at CB and at every address called or taken as a
+// closure. Jump tables are marked so that they are not made into blocks.
+
+bool IRBuilder::findRoutines () {
+	vector<bool> entry(end + 1, false);
+	inTable.assign(end + 1, false);
+	routineAt.assign(end + 1, -1);
+	entry[mach->CB] = true;
+
+	for (int addr = mach->CB; addr < end; addr++) {
+		Instruction* instr = &mach->code[addr];
+		if (instr->op == mach->CALLop && instr->r != mach->CBr && instr->r != mach->PBr)
+			return fail("call relative to an unexpected register");
+		if ((instr->op == mach->CALLop && instr->r == mach->CBr) ||
+			(instr->op == mach->LOADAop && instr->r == mach->CBr && instr->n == 0)) {
+			if (instr->d < mach->CB || instr->d >= end)
+				return fail("code address out of range");
+			entry[instr->d] = true;
+		}
+		if (instr->op == mach->LOADAop && instr->r == mach->CBr && instr->n > 0)
+			for (int i = 0; i < instr->n; i++) {
+				int at = instr->d + i;
+				if (at >= end || mach->code[at].op != mach->JUMPop || mach->code[at].r != mach->CBr)
+					return fail("malformed jump table");
+				inTable[at] = true;
+			}
+	}
+
+	for (int addr = mach->CB; addr < end; addr++)
+		if (entry[addr]) {
+			routineAt[addr] = program->routines.size();
+			program->routines.push_back(new IRRoutine(addr, addr == mach->CB));
+		}
+	return true;
+}
+
+void IRBuilder::findBlocks () {
+	vector<bool> leader(end + 1, false);
+	for (int addr = mach->CB; addr < end; addr++) {
+		Instruction* instr = &mach->code[addr];
+		if (routineAt[addr] >= 0)
+			leader[addr] = true;
+		if ((instr->op == mach->JUMPop || instr->op == mach->JUMPIFop) && instr->r == mach->CBr &&
+			instr->d >= mach->CB && instr->d < end)
+			leader[instr->d] = true;
+		if (isTerminator(instr))
+			leader[addr + 1] = true;
+	}
+
+	blockAt.assign(end + 1, -1);
+	blockEnd.clear();
+	int current = -1;
+	for (int addr = mach->CB; addr < end; addr++) {
+		if (inTable[addr]) {
+			current = -1;
+			continue;
+		}
+		if (current < 0 || leader[addr]) {
+			if (current >= 0)
+				blockEnd[current] = addr;
+			current = program->blocks.size();
+			program->blocks.push_back(new IRBlock(addr));
+			blockEnd.push_back(end);
+			blockAt[addr] = current;
+		}
+		if (isTerminator(&mach->code[addr])) {
+			blockEnd[current] = addr + 1;
+			current = -1;
+		}
+	}
+	if (current >= 0)
+		blockEnd[current] = end;
+
+	for (int b = 0; b < (signed) program->blocks.size(); b++) {
+		Instruction* last = &mach->code[blockEnd[b] - 1];
+		if ((!isTerminator(last) || last->op == mach->JUMPIFop) && blockEnd[b] < end)
+			program->blocks[b]->fallthrough = blockAt[blockEnd[b]];
+	}
+}
+
+bool IRBuilder::successors (int b, vector<int>& succ) {
+	for (int addr = program->blocks[b]->address; addr < blockEnd[b]; addr++) {
+		Instruction* instr = &mach->code[addr];
+		if ((instr->op == mach->JUMPop || instr->op == mach->JUMPIFop) && instr->r == mach->CBr) {
+			if (instr->d < mach->CB || instr->d >= end || blockAt[instr->d] < 0)
+				return fail("jump to a code address outside any block");
+			succ.push_back(blockAt[instr->d]);
+		}
+		if (instr->op == mach->LOADAop && instr->r == mach->CBr && instr->n > 0) {
+			if (mach->code[blockEnd[b] - 1].op != mach->JUMPIop)
+				return fail("jump table not followed by JUMPI");
+			for (int i = 0; i < instr->n; i++) {
+				int target = mach->code[instr->d + i].d;
+				if (target < mach->CB || target >= end || blockAt[target] < 0)
+					return fail("jump table entry outside any block");
+				succ.push_back(blockAt[target]);
+			}
+		}
+	}
+	if (program->blocks[b]->fallthrough >= 0)
+		succ.push_back(program->blocks[b]->fallthrough);
+	return true;
+}
+
+// Gives each routine the blocks reachable from its entry without
+// following calls, and takes its argument and result sizes from its
+// RETURN instructions. Blocks no routine reaches are dead and left out.
+
+bool IRBuilder::assignBlocks () {
+	vector<int> owner(program->blocks.size(), -1);
+
+	for (int k = 0; k < (signed) program->routines.size(); k++) {
+		IRRoutine* routine = program->routines[k];
+		bool returns = false;
+		vector<int> work;
+		work.push_back(blockAt[routine->entry]);
+		while (!work.empty()) {
+			int b = work.back();
+			work.pop_back();
+			if (owner[b] == k)
+				continue;
+			if (owner[b] >= 0)
+				return fail("code shared between routines");
+			owner[b] = k;
+
+			Instruction* last = &mach->code[blockEnd[b] - 1];
+			if (last->op == mach->RETURNop) {
+				if (returns && (last->n != routine->resultSize || last->d != routine->argsSize))
+					return fail("routine returns with different sizes");
+				routine->resultSize = last->n;
+				routine->argsSize = last->d;
+				returns = true;
+			}
+			if (!successors(b, work))
+				return false;
+		}
+		if (!routine->isMain && !returns)
+			return fail("routine that never returns");
+	}
+
+	for (int k = 0; k < (signed) program->routines.size(); k++)
+		program->routines[k]->blocks.push_back(blockAt[program->routines[k]->entry]);
+	for (int b = 0; b < (signed) program->blocks.size(); b++)
+		if (owner[b] >= 0 && b != blockAt[program->routines[owner[b]]->entry])
+			program->routines[owner[b]]->blocks.push_back(b);
+	return true;
+}
+
+// The number of words the instruction at addr takes from the stack and
+// the number it leaves there.
+
+bool IRBuilder::stackEffect (int addr, int& pops, int& pushes) {
+	Instruction* instr = &mach->code[addr];
+	int op = instr->op;
+	pops = 0;
+	pushes = 0;
+
+	if (op == mach->LOADop)
+		pushes = instr->n;
+	else if (op == mach->LOADAop || op == mach->LOADLop)
+		pushes = 1;
+	else if (op == mach->LOADIop) {
+		pops = 1;
+		pushes = instr->n;
+	}
+	else if (op == mach->STOREop)
+		pops = instr->n;
+	else if (op == mach->STOREIop)
+		pops = instr->n + 1;
+	else if (op == mach->CALLop && instr->r == mach->CBr) {
+		IRRoutine* callee = program->routines[routineAt[instr->d]];
+		pops = callee->argsSize;
+		pushes = callee->resultSize;
+	}
+	else if (op == mach->CALLIop) {
+		// The encoder gives a CALLI the sizes of its result and arguments.
+		pops = instr->d + mach->closureSize;
+		pushes = instr->n;
+	}
+	else if (op == mach->CALLop) {
+		int d = instr->d;
+		if (d == mach->eqDisplacement || d == mach->neDisplacement) {
+			Instruction* size = (addr > mach->CB) ? &mach->code[addr - 1] : NULL;
+			if (size == NULL || size->op != mach->LOADLop || blockAt[addr] >= 0)
+				return fail("comparison of unknown size");
+			pops = 2 * size->d + 1;
+			pushes = 1;
+		}
+		else if (d == mach->eolDisplacement || d == mach->eofDisplacement)
+			pushes = 1;
+		else if (d == mach->geteolDisplacement || d == mach->puteolDisplacement)
+			;
+		else if (d == mach->getDisplacement || d == mach->putDisplacement || d == mach->getintDisplacement ||
+				 d == mach->putintDisplacement || d == mach->disposeDisplacement)
+			pops = 1;
+		else if (d == mach->idDisplacement || d == mach->notDisplacement || d == mach->succDisplacement ||
+				 d == mach->predDisplacement || d == mach->negDisplacement || d == mach->newDisplacement) {
+			pops = 1;
+			pushes = 1;
+		}
+		else if (d >= mach->andDisplacement && d <= mach->gtDisplacement) {
+			pops = 2;
+			pushes = 1;
+		}
+		else
+			return fail("call of an unknown primitive");
+	}
+	else if (op == mach->RETURNop)
+		pops = instr->n;
+	else if (op == mach->PUSHop)
+		pushes = instr->d;
+	else if (op == mach->POPop) {
+		pops = instr->n + instr->d;
+		pushes = instr->n;
+	}
+	else if (op == mach->JUMPIFop || op == mach->JUMPIop)
+		pops = 1;
+	else if (op != mach->JUMPop && op != mach->HALTop)
+		return fail("unknown instruction");
+	return true;
+}
+
+bool IRBuilder::computeDepths (IRRoutine* routine) {
+	int entry = blockAt[routine->entry];
+	program->blocks[entry]->entryDepth = routine->isMain ? 0 : mach->linkDataSize;
+
+	vector<int> work;
+	work.push_back(entry);
+	while (!work.empty()) {
+		int b = work.back();
+		work.pop_back();
+		int depth = program->blocks[b]->entryDepth;
+		for (int addr = program->blocks[b]->address; addr < blockEnd[b]; addr++) {
+			int pops, pushes;
+			if (!stackEffect(addr, pops, pushes))
+				return false;
+			if (pops > depth)
+				return fail("stack underflow");
+			depth = depth - pops + pushes;
+		}
+
+		vector<int> succ;
+		successors(b, succ);
+		for (int i = 0; i < (signed) succ.size(); i++) {
+			IRBlock* next = program->blocks[succ[i]];
+			if (next->entryDepth < 0) {
+				next->entryDepth = depth;
+				work.push_back(succ[i]);
+			}
+			else if (next->entryDepth != depth)
+				return fail("stack depth differs where control paths join");
+		}
+	}
+	return true;
+}
+
+// The level of each routine follows from the static link of the calls of
+// it, starting at main. A routine only reached through a closure keeps
+// level -1.
+
+void IRBuilder::findLevels () {
+	vector<int> work;
+	work.push_back(0);
+	while (!work.empty()) {
+		IRRoutine* routine = program->routines[work.back()];
+		work.pop_back();
+		for (int i = 0; i < (signed) routine->blocks.size(); i++) {
+			int b = routine->blocks[i];
+			for (int addr = program->blocks[b]->address; addr < blockEnd[b]; addr++) {
+				Instruction* instr = &mach->code[addr];
+				if (instr->op != mach->CALLop || instr->r != mach->CBr)
+					continue;
+				int k = routineAt[instr->d];
+				if (program->routines[k]->level >= 0)
+					continue;
+				int staticLink = (instr->n == mach->SBr) ? 0 : routine->level - (instr->n - mach->LBr);
+				program->routines[k]->level = staticLink + 1;
+				work.push_back(k);
+			}
+		}
+	}
+}
+
+bool IRBuilder::translate (int b) {
+	IRBlock* block = program->blocks[b];
+	vector<int> stack;
+	for (int slot = 0; slot < block->entryDepth; slot++)
+		stack.push_back(-(slot + 1));
+
+	for (int addr = block->address; addr < blockEnd[b]; addr++) {
+		Instruction* code = &mach->code[addr];
+		IRInstruction* instr = new IRInstruction(code->op, code->n, code->r, code->d);
+		int pops, pushes;
+		stackEffect(addr, pops, pushes);
+
+		instr->uses.assign(stack.end() - pops, stack.end());
+		stack.resize(stack.size() - pops);
+		instr->slot = stack.size();
+		for (int i = 0; i < pushes; i++) {
+			instr->defs.push_back(program->numVregs);
+			stack.push_back(program->numVregs++);
+		}
+
+		if ((code->op == mach->JUMPop || code->op == mach->JUMPIFop) && code->r == mach->CBr)
+			instr->block = blockAt[code->d];
+		else if ((code->op == mach->CALLop && code->r == mach->CBr) ||
+				 (code->op == mach->LOADAop && code->r == mach->CBr && code->n == 0))
+			instr->routine = routineAt[code->d];
+		else if (code->op == mach->LOADAop && code->r == mach->CBr)
+			for (int i = 0; i < code->n; i++)
+				instr->table.push_back(blockAt[mach->code[code->d + i].d]);
+		block->instructions.push_back(instr);
+	}
+	return true;
+}
+
+
+#endif
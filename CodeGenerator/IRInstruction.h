@@ -0,0 +1,64 @@
+#ifndef _IRINSTRUCTION
+#define _IRINSTRUCTION
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// One instruction of the three-address intermediate representation.
+//
+// Each IR instruction stands for one TAM instruction (op, n, r and d keep
+// their TAM meaning), but the values it takes from and leaves on the
+// stack are named: uses are the operands it consumes, defs the virtual
+// registers it produces. A virtual register lives in the stack slot given
+// by its position above the frame base. An operand that was already on
+// the stack when the block was entered is not a virtual register but the
+// stack slot itself, written as -(slot + 1).
+//
+// Code addresses are symbolic: a jump names a block, a call or closure a
+// routine, and a jump table the blocks of its entries.
+
+class IRInstruction {
+
+public:
+	int op;
+	int n;
+	int r;
+	int d;
+
+	vector<int> uses;
+	vector<int> defs;
+	int slot;  // stack slot of the first def
+
+	int block;    // target block of JUMP or JUMPIF, else -1
+	int routine;  // routine called by CALL, or whose closure LOADA takes, else -1
+	vector<int> table;  // target blocks of a jump table loaded by LOADA
+
+	IRInstruction (int op, int n, int r, int d) {
+		this->op = op;
+		this->n = n;
+		this->r = r;
+		this->d = d;
+		slot = 0;
+		block = -1;
+		routine = -1;
+	}
+
+	static bool isSlot (int operand) {
+		return operand < 0;
+	}
+
+	static string operandName (int operand) {
+		char buffer[16];
+		if (isSlot(operand))
+			sprintf(buffer, "s%d", -operand - 1);
+		else
+			sprintf(buffer, "v%d", operand);
+		return buffer;
+	}
+};
+
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef _IRLOWERING
+#define _IRLOWERING
+
+#include <vector>
+#include "../TAM/Instruction.h"
+#include "../TAM/Machine.h"
+#include "IRProgram.h"
+
+using namespace std;
+
+// Generates TAM code from the IR into the code store.
+//
+// Routines are laid out one after the other, main first, each with its
+// blocks in their original order. Operands are expected on the stack in
+// the order the IR names them, so each IR instruction becomes the TAM
+// instruction it stands for, with its code addresses resolved. A jump to
+// the block laid out next is dropped, a missing fall-through gets a JUMP,
+// and a jump table is placed after the block that loads it.
+
+class IRLowering {
+
+	Machine* mach;
+	IRProgram* program;
+	vector<int> order;       // blocks in layout order
+	vector<int> blockAddr;   // block -> its address in the new code
+	vector<int> tableAddr;   // block -> address of the jump table after it, or -1
+
+	bool dropsLastJump (int i);
+	bool needsFallthroughJump (int i);
+	Instruction newInstruction (int op, int n, int r, int d);
+
+public:
+	int size;  // instructions in the code generated by the last lower
+
+	IRLowering (Machine* mach);
+
+	// Replaces the code store contents with code for the program and
+	// returns the new end of the code.
+	int lower (IRProgram* program);
+};
+
+
+IRLowering::IRLowering (Machine* mach) {
+	this->mach = mach;
+	program = NULL;
+	size = 0;
+}
+
+bool IRLowering::dropsLastJump (int i) {
+	IRBlock* block = program->blocks[order[i]];
+	if (block->instructions.empty())
+		return false;
+	IRInstruction* last = block->instructions.back();
+	return last->op == mach->JUMPop && last->block >= 0 &&
+		i + 1 < (signed) order.size() && order[i + 1] == last->block;
+}
+
+bool IRLowering::needsFallthroughJump (int i) {
+	IRBlock* block = program->blocks[order[i]];
+	return block->fallthrough >= 0 && (i + 1 == (signed) order.size() || order[i + 1] != block->fallthrough);
+}
+
+Instruction IRLowering::newInstruction (int op, int n, int r, int d) {
+	Instruction instr;
+	instr.op = op;
+	instr.n = n;
+	instr.r = r;
+	instr.d = d;
+	return instr;
+}
+
+int IRLowering::lower (IRProgram* program) {
+	this->program = program;
+	order.clear();
+	for (int k = 0; k < (signed) program->routines.size(); k++)
+		for (int i = 0; i < (signed) program->routines[k]->blocks.size(); i++)
+			order.push_back(program->routines[k]->blocks[i]);
+
+	// Decide the address of every block and jump table.
+	blockAddr.assign(program->blocks.size(), -1);
+	tableAddr.assign(program->blocks.size(), -1);
+	int addr = mach->CB;
+	for (int i = 0; i < (signed) order.size(); i++) {
+		IRBlock* block = program->blocks[order[i]];
+		blockAddr[order[i]] = addr;
+		addr += block->instructions.size();
+		if (dropsLastJump(i))
+			addr--;
+		if (needsFallthroughJump(i))
+			addr++;
+		for (int j = 0; j < (signed) block->instructions.size(); j++)
+			if (!block->instructions[j]->table.empty()) {
+				tableAddr[order[i]] = addr;
+				addr += block->instructions[j]->table.size();
+			}
+	}
+
+	vector<int> routineAddr;
+	for (int k = 0; k < (signed) program->routines.size(); k++)
+		routineAddr.push_back(blockAddr[program->routines[k]->blocks[0]]);
+
+	// Generate the code.
+	vector<Instruction> code;
+	for (int i = 0; i < (signed) order.size(); i++) {
+		IRBlock* block = program->blocks[order[i]];
+		IRInstruction* table = NULL;
+		int count = block->instructions.size() - (dropsLastJump(i) ? 1 : 0);
+		for (int j = 0; j < count; j++) {
+			IRInstruction* instr = block->instructions[j];
+			int d = instr->d;
+			if (instr->block >= 0)
+				d = blockAddr[instr->block];
+			else if (instr->routine >= 0)
+				d = routineAddr[instr->routine];
+			else if (!instr->table.empty()) {
+				d = tableAddr[order[i]];
+				table = instr;
+			}
+			code.push_back(newInstruction(instr->op, instr->n, instr->r, d));
+		}
+		if (needsFallthroughJump(i))
+			code.push_back(newInstruction(mach->JUMPop, 0, mach->CBr, blockAddr[block->fallthrough]));
+		if (table != NULL)
+			for (int t = 0; t < (signed) table->table.size(); t++)
+				code.push_back(newInstruction(mach->JUMPop, 0, mach->CBr, blockAddr[table->table[t]]));
+	}
+
+	mach->setCodeSize(code.size());
+	for (int a = 0; a < (signed) code.size(); a++)
+		mach->code[mach->CB + a] = code[a];
+	size = code.size();
+	return mach->CB + size;
+}
+
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef _IRPROGRAM
+#define _IRPROGRAM
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "../TAM/Machine.h"
+#include "IRInstruction.h"
+#include "IRBlock.h"
+#include "IRRoutine.h"
+
+using namespace std;
+
+// The intermediate representation of a whole object program: the main
+// program and every routine, each a set of basic blocks of three-address
+// instructions over virtual registers.
+
+class IRProgram {
+
+	string opName (int op);
+	string registerName (int r);
+	string primitiveName (int d);
+
+public:
+	vector<IRBlock*> blocks;
+	vector<IRRoutine*> routines;  // in order of entry address, main first
+	int numVregs;
+
+	IRProgram () {
+		numVregs = 0;
+	}
+
+	// Instructions in the blocks of the routines.
+	int numInstructions ();
+
+	// Renames the virtual registers after blocks have been changed, so
+	// that every value pushed again has its own register. Only the number
+	// of uses and defs of each instruction, and the entry depth of each
+	// block, need to be right beforehand.
+	void renumber ();
+
+	// Prints the IR in a readable form, e.g. for tc --dump-ir.
+	void dump (FILE* out, Machine* mach);
+};
+
+
+int IRProgram::numInstructions () {
+	int count = 0;
+	for (int k = 0; k < (signed) routines.size(); k++)
+		for (int i = 0; i < (signed) routines[k]->blocks.size(); i++)
+			count += blocks[routines[k]->blocks[i]]->instructions.size();
+	return count;
+}
+
+void IRProgram::renumber () {
+	numVregs = 0;
+	for (int k = 0; k < (signed) routines.size(); k++)
+		for (int i = 0; i < (signed) routines[k]->blocks.size(); i++) {
+			IRBlock* block = blocks[routines[k]->blocks[i]];
+			vector<int> stack;
+			for (int slot = 0; slot < block->entryDepth; slot++)
+				stack.push_back(-(slot + 1));
+
+			for (int j = 0; j < (signed) block->instructions.size(); j++) {
+				IRInstruction* instr = block->instructions[j];
+				int pops = instr->uses.size();
+				instr->uses.assign(stack.end() - pops, stack.end());
+				stack.resize(stack.size() - pops);
+				instr->slot = stack.size();
+				for (int v = 0; v < (signed) instr->defs.size(); v++) {
+					instr->defs[v] = numVregs;
+					stack.push_back(numVregs++);
+				}
+			}
+		}
+}
+
+string IRProgram::opName (int op) {
+	static const char* names[] = {"LOAD", "LOADA", "LOADI", "LOADL", "STORE", "STOREI", "CALL", "CALLI",
+		"RETURN", "?", "PUSH", "POP", "JUMP", "JUMPI", "JUMPIF", "HALT"};
+	return (op >= 0 && op < 16) ? names[op] : "?";
+}
+
+string IRProgram::registerName (int r) {
+	static const char* names[] = {"CB", "CT", "PB", "PT", "SB", "ST", "HB", "HT", "LB",
+		"L1", "L2", "L3", "L4", "L5", "L6", "CP"};
+	return (r >= 0 && r < 16) ? names[r] : "?";
+}
+
+string IRProgram::primitiveName (int d) {
+	static const char* names[] = {"?", "id", "not", "and", "or", "succ", "pred", "neg", "add", "sub",
+		"mult", "div", "mod", "lt", "le", "ge", "gt", "eq", "ne", "eol", "eof", "get", "put",
+		"geteol", "puteol", "getint", "putint", "new", "dispose"};
+	return (d >= 0 && d < 29) ? names[d] : "?";
+}
+
+void IRProgram::dump (FILE* out, Machine* mach) {
+	for (int k = 0; k < (signed) routines.size(); k++) {
+		IRRoutine* routine = routines[k];
+		if (routine->isMain)
+			fprintf(out, "main:\n");
+		else
+			fprintf(out, "routine R%d (args %d, result %d):\n", k, routine->argsSize, routine->resultSize);
+
+		for (int i = 0; i < (signed) routine->blocks.size(); i++) {
+			int b = routine->blocks[i];
+			IRBlock* block = blocks[b];
+			fprintf(out, "  B%d [depth %d]:\n", b, block->entryDepth);
+
+			for (int j = 0; j < (signed) block->instructions.size(); j++) {
+				IRInstruction* instr = block->instructions[j];
+				string line = "    ";
+				for (int v = 0; v < (signed) instr->defs.size(); v++)
+					line += (v == 0 ? "" : ", ") + IRInstruction::operandName(instr->defs[v]);
+				if (!instr->defs.empty())
+					line += " = ";
+
+				char fields[64];
+				line += opName(instr->op);
+				if (instr->op == mach->CALLop && instr->r == mach->PBr)
+					line += " " + primitiveName(instr->d);
+				else if (instr->routine >= 0) {
+					sprintf(fields, " R%d", instr->routine);
+					line += fields;
+				}
+				else if (instr->block >= 0) {
+					sprintf(fields, "(%d) B%d", instr->n, instr->block);
+					line += fields;
+				}
+				else if (!instr->table.empty()) {
+					line += " table";
+					for (int t = 0; t < (signed) instr->table.size(); t++) {
+						sprintf(fields, " B%d", instr->table[t]);
+						line += fields;
+					}
+				}
+				else if (instr->op == mach->LOADop || instr->op == mach->LOADAop || instr->op == mach->STOREop) {
+					sprintf(fields, "(%d) %d[%s]", instr->n, instr->d, registerName(instr->r).c_str());
+					line += fields;
+				}
+				else if (instr->op == mach->LOADLop || instr->op == mach->PUSHop) {
+					sprintf(fields, " %d", instr->d);
+					line += fields;
+				}
+				else if (instr->op == mach->POPop || instr->op == mach->RETURNop) {
+					sprintf(fields, "(%d) %d", instr->n, instr->d);
+					line += fields;
+				}
+				else if (instr->op == mach->LOADIop || instr->op == mach->STOREIop) {
+					sprintf(fields, "(%d)", instr->n);
+					line += fields;
+				}
+
+				for (int u = 0; u < (signed) instr->uses.size(); u++)
+					line += (u == 0 ? " " : ", ") + IRInstruction::operandName(instr->uses[u]);
+				fprintf(out, "%s\n", line.c_str());
+			}
+			if (block->fallthrough >= 0)
+				fprintf(out, "    -> B%d\n", block->fallthrough);
+		}
+	}
+}
+
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef _IRROUTINE
+#define _IRROUTINE
+
+#include <vector>
+#include "IRBlock.h"
+
+using namespace std;
+
+// The IR of the main program or of one routine: its blocks, entry block
+// first, and the sizes given by its RETURN instructions.
+
+class IRRoutine {
+
+public:
+	int entry;       // address of the routine in the code it was built from
+	bool isMain;
+	int argsSize;    // words of arguments removed on return
+	int resultSize;  // words of result left on return
+	int level;       // routine level of its frame (0 for main), or -1 if unknown
+	vector<int> blocks;  // indices into IRProgram::blocks
+
+	IRRoutine (int entry, bool isMain) {
+		this->entry = entry;
+		this->isMain = isMain;
+		argsSize = 0;
+		resultSize = 0;
+		level = isMain ? 0 : -1;
+	}
+};
+
+
+#endif
@@ -0,0 +1,306 @@
+#ifndef _INLINER
+#define _INLINER
+
+#include <vector>
+#include "../TAM/Machine.h"
+#include "IRProgram.h"
+
+using namespace std;
+
+// Replaces calls of small, non-recursive routines by copies of their IR.
+//
+// The caller has already pushed the arguments, whatever their parameter
+// mode, so the copy finds them just where the routine would: the copy's
+// frame starts at the caller's stack top, without link data. Addresses in
+// the routine's frame are moved down by the size of the link data, its
+// display registers are replaced by the caller's registers for the same
+// frames, and each RETURN becomes a POP of the frame followed by a jump to
+// the code after the call.
+//
+// Routines are visited callees first, so a routine is inlined with the
+// calls in it already inlined. Routines that are no longer called are
+// removed.
+
+class Inliner {
+
+	Machine* mach;
+	IRProgram* program;
+
+	vector<vector<int> > callees; // routine -> routines it calls
+	vector<bool> recursive;       // routine -> true iff it can call itself
+	vector<int> order;            // routines, callees before callers
+
+	int mapRegister (int r, int calleeLevel, int callerLevel);
+	void findCallGraph ();
+	void visit (int k, vector<bool>& visited);
+	int routineSize (int k);
+	bool canInline (int callee, int callerLevel);
+	void inlineCall (int caller, int position, int j);
+	void removeUncalled ();
+
+public:
+	int budget;  // largest routine inlined, in instructions
+	int callsInlined;
+	int routinesRemoved;
+
+	Inliner (Machine* mach, int budget);
+
+	void run (IRProgram* program);
+};
+
+
+Inliner::Inliner (Machine* mach, int budget) {
+	this->mach = mach;
+	this->budget = budget;
+	program = NULL;
+	callsInlined = 0;
+	routinesRemoved = 0;
+}
+
+// The register that names, in code at callerLevel, the frame that display
+// register r names in the routine at calleeLevel, or -1 if there is none.
+
+int Inliner::mapRegister (int r, int calleeLevel, int callerLevel) {
+	if (r == mach->SBr)
+		return mach->SBr;
+	if (r < mach->LBr || r > mach->L6r)
+		return -1;
+	int target = calleeLevel - (r - mach->LBr);
+	if (target == 0)
+		return mach->SBr;
+	if (target > callerLevel || callerLevel - target > 6)
+		return -1;
+	return mach->LBr + callerLevel - target;
+}
+
+void Inliner::findCallGraph () {
+	int count = program->routines.size();
+	callees.assign(count, vector<int>());
+	for (int k = 0; k < count; k++)
+		for (int i = 0; i < (signed) program->routines[k]->blocks.size(); i++) {
+			IRBlock* block = program->blocks[program->routines[k]->blocks[i]];
+			for (int j = 0; j < (signed) block->instructions.size(); j++)
+				if (block->instructions[j]->routine >= 0)
+					callees[k].push_back(block->instructions[j]->routine);
+		}
+
+	recursive.assign(count, false);
+	for (int k = 0; k < count; k++) {
+		vector<bool> seen(count, false);
+		vector<int> reach(callees[k]);
+		while (!reach.empty() && !recursive[k]) {
+			int c = reach.back();
+			reach.pop_back();
+			if (c == k)
+				recursive[k] = true;
+			else if (!seen[c]) {
+				seen[c] = true;
+				reach.insert(reach.end(), callees[c].begin(), callees[c].end());
+			}
+		}
+	}
+
+	vector<bool> visited(count, false);
+	order.clear();
+	visit(0, visited);
+}
+
+void Inliner::visit (int k, vector<bool>& visited) {
+	visited[k] = true;
+	for (int i = 0; i < (signed) callees[k].size(); i++)
+		if (!visited[callees[k][i]])
+			visit(callees[k][i], visited);
+	order.push_back(k);
+}
+
+int Inliner::routineSize (int k) {
+	int size = 0;
+	for (int i = 0; i < (signed) program->routines[k]->blocks.size(); i++)
+		size += program->blocks[program->routines[k]->blocks[i]]->instructions.size();
+	return size;
+}
+
+bool Inliner::canInline (int callee, int callerLevel) {
+	int calleeLevel = program->routines[callee]->level;
+	if (callee == 0 || recursive[callee] || calleeLevel < 0 || routineSize(callee) > budget)
+		return false;
+	for (int i = 0; i < (signed) program->routines[callee]->blocks.size(); i++) {
+		IRBlock* block = program->blocks[program->routines[callee]->blocks[i]];
+		for (int j = 0; j < (signed) block->instructions.size(); j++) {
+			IRInstruction* instr = block->instructions[j];
+			if (instr->op == mach->CALLop && instr->r == mach->CBr) {
+				// A routine nested in the callee would need its frame as static link.
+				if (instr->n == mach->LBr || mapRegister(instr->n, calleeLevel, callerLevel) < 0)
+					return false;
+			}
+			else if ((instr->op == mach->LOADop || instr->op == mach->LOADAop || instr->op == mach->STOREop) &&
+					 instr->r != mach->CBr) {
+				if (instr->r == mach->LBr) {
+					if (instr->d >= 0 && instr->d < mach->linkDataSize)
+						return false;
+				}
+				else if (mapRegister(instr->r, calleeLevel, callerLevel) < 0)
+					return false;
+			}
+			else if (instr->op == mach->CALLIop)
+				return false;
+		}
+	}
+	return true;
+}
+
+// Inlines the call that is instruction j of the block at the given
+// position in the caller's block list.
+
+void Inliner::inlineCall (int caller, int position, int j) {
+	IRRoutine* routine = program->routines[caller];
+	int b = routine->blocks[position];
+	IRBlock* block = program->blocks[b];
+	IRInstruction* call = block->instructions[j];
+	int callee = call->routine;
+	IRRoutine* body = program->routines[callee];
+	int base = call->slot + body->argsSize;  // the copy's frame, in the caller's frame
+	int frameRegister = (routine->level == 0) ? mach->SBr : mach->LBr;
+
+	// The code after the call goes into a block of its own.
+	int after = program->blocks.size();
+	IRBlock* rest = new IRBlock(block->address);
+	rest->instructions.assign(block->instructions.begin() + j + 1, block->instructions.end());
+	rest->fallthrough = block->fallthrough;
+	rest->entryDepth = call->slot + body->resultSize;
+	program->blocks.push_back(rest);
+	block->instructions.resize(j);
+
+	vector<int> copyOf(program->blocks.size(), -1);
+	vector<int> copies;
+	for (int i = 0; i < (signed) body->blocks.size(); i++) {
+		copyOf[body->blocks[i]] = program->blocks.size();
+		copies.push_back(program->blocks.size());
+		IRBlock* original = program->blocks[body->blocks[i]];
+		IRBlock* copy = new IRBlock(original->address);
+		copy->entryDepth = base + original->entryDepth - mach->linkDataSize;
+		program->blocks.push_back(copy);
+	}
+
+	for (int i = 0; i < (signed) body->blocks.size(); i++) {
+		IRBlock* original = program->blocks[body->blocks[i]];
+		IRBlock* copy = program->blocks[copies[i]];
+		if (original->fallthrough >= 0)
+			copy->fallthrough = copyOf[original->fallthrough];
+
+		for (int k = 0; k < (signed) original->instructions.size(); k++) {
+			IRInstruction* instr = new IRInstruction(*original->instructions[k]);
+			instr->slot = base + instr->slot - mach->linkDataSize;
+			if (instr->block >= 0)
+				instr->block = copyOf[instr->block];
+			for (int t = 0; t < (signed) instr->table.size(); t++)
+				instr->table[t] = copyOf[instr->table[t]];
+
+			if (instr->op == mach->CALLop && instr->r == mach->CBr)
+				instr->n = mapRegister(instr->n, body->level, routine->level);
+			else if ((instr->op == mach->LOADop || instr->op == mach->LOADAop || instr->op == mach->STOREop) &&
+					 instr->r != mach->CBr) {
+				if (instr->r == mach->LBr) {
+					instr->r = frameRegister;
+					instr->d = base + instr->d - (instr->d >= 0 ? mach->linkDataSize : 0);
+				}
+				else
+					instr->r = mapRegister(instr->r, body->level, routine->level);
+			}
+			else if (instr->op == mach->RETURNop) {
+				// Pop everything from the arguments up, keeping the result.
+				instr->op = mach->POPop;
+				instr->d = instr->slot - call->slot;
+				instr->slot = call->slot;
+				instr->uses.assign(instr->n + instr->d, 0);
+				instr->defs.assign(instr->n, 0);
+				copy->instructions.push_back(instr);
+				instr = new IRInstruction(mach->JUMPop, 0, mach->CBr, 0);
+				instr->block = after;
+			}
+			copy->instructions.push_back(instr);
+		}
+	}
+
+	block->fallthrough = copies[0];
+	copies.push_back(after);
+	routine->blocks.insert(routine->blocks.begin() + position + 1, copies.begin(), copies.end());
+	callsInlined++;
+}
+
+// Removes the routines that main no longer reaches through calls or
+// closures, renumbering the others.
+
+void Inliner::removeUncalled () {
+	int count = program->routines.size();
+	vector<bool> reached(count, false);
+	vector<int> work;
+	reached[0] = true;
+	work.push_back(0);
+	while (!work.empty()) {
+		int k = work.back();
+		work.pop_back();
+		for (int i = 0; i < (signed) program->routines[k]->blocks.size(); i++) {
+			IRBlock* block = program->blocks[program->routines[k]->blocks[i]];
+			for (int j = 0; j < (signed) block->instructions.size(); j++) {
+				int r = block->instructions[j]->routine;
+				if (r >= 0 && !reached[r]) {
+					reached[r] = true;
+					work.push_back(r);
+				}
+			}
+		}
+	}
+
+	vector<int> index(count, -1);
+	vector<IRRoutine*> kept;
+	for (int k = 0; k < count; k++)
+		if (reached[k]) {
+			index[k] = kept.size();
+			kept.push_back(program->routines[k]);
+		}
+		else
+			routinesRemoved++;
+	program->routines = kept;
+
+	for (int k = 0; k < (signed) kept.size(); k++)
+		for (int i = 0; i < (signed) kept[k]->blocks.size(); i++) {
+			IRBlock* block = program->blocks[kept[k]->blocks[i]];
+			for (int j = 0; j < (signed) block->instructions.size(); j++)
+				if (block->instructions[j]->routine >= 0)
+					block->instructions[j]->routine = index[block->instructions[j]->routine];
+		}
+}
+
+void Inliner::run (IRProgram* program) {
+	this->program = program;
+	callsInlined = 0;
+	routinesRemoved = 0;
+	if (program->routines.empty() || budget <= 0)
+		return;
+
+	findCallGraph();
+	for (int o = 0; o < (signed) order.size(); o++) {
+		int caller = order[o];
+		IRRoutine* routine = program->routines[caller];
+		if (routine->level < 0)
+			continue;
+		for (int i = 0; i < (signed) routine->blocks.size(); i++) {
+			IRBlock* block = program->blocks[routine->blocks[i]];
+			for (int j = 0; j < (signed) block->instructions.size(); j++) {
+				IRInstruction* instr = block->instructions[j];
+				if (instr->op == mach->CALLop && instr->r == mach->CBr && instr->routine != caller &&
+					canInline(instr->routine, routine->level)) {
+					inlineCall(caller, i, j);
+					break;  // the rest of the block has moved to a new block
+				}
+			}
+		}
+	}
+
+	removeUncalled();
+	program->renumber();
+}
+
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef _LAYOUTTABLE
+#define _LAYOUTTABLE
+
+#include "../import_headers.h"
+#include "TypeRepresentation.h"
+#include <map>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+// Remembers every array and record type whose layout has been decided,
+// so that a structurally equal type met later can share the same
+// TypeRepresentation (and Field offsets) instead of being laid out again.
+
+class LayoutTable {
+
+	map<string, TypeDenoter*> laidOut;  // canonical form -> type laid out
+
+public:
+	// Held while a type's representation is decided, since the routines
+	// generated in parallel share types. Recursive, as a type is laid out
+	// after the types of its elements or fields.
+	recursive_mutex lock;
+
+	LayoutTable () {}
+
+	// Returns an already laid-out type equal to T, or NULL if there is none.
+	TypeDenoter* find (TypeDenoter* T) {
+		map<string, TypeDenoter*>::iterator it = laidOut.find(canonical(T));
+		return (it == laidOut.end()) ? NULL : it->second;
+	}
+
+	void enter (TypeDenoter* T) {
+		laidOut[canonical(T)] = T;
+	}
+
+	// The canonical form of T: structurally equal types, which have the
+	// same layout, have the same form, e.g. "[10]{x:I,y:C}" for an array
+	// of 10 records with an Integer x and a Char y.
+	static string canonical (TypeDenoter* T) {
+		string type = T->class_type();
+		if (type == "INTTYPEDENOTER")
+			return "I";
+		if (type == "BOOLTYPEDENOTER")
+			return "B";
+		if (type == "CHARTYPEDENOTER")
+			return "C";
+		if (type == "ARRAYTYPEDENOTER")
+			return "[" + ((ArrayTypeDenoter*) T)->IL->spelling + "]" + canonical(((ArrayTypeDenoter*) T)->T);
+		if (type != "RECORDTYPEDENOTER")
+			return type;
+		string form = "{";
+		FieldTypeDenoter* FT = ((RecordTypeDenoter*) T)->FT;
+		while (FT != NULL) {
+			if (FT->class_type() == "MULTIPLEFIELDTYPEDENOTER") {
+				MultipleFieldTypeDenoter* field = (MultipleFieldTypeDenoter*) FT;
+				form += field->I->spelling + ":" + canonical(field->T) + ",";
+				FT = field->FT;
+			}
+			else {
+				SingleFieldTypeDenoter* field = (SingleFieldTypeDenoter*) FT;
+				form += field->I->spelling + ":" + canonical(field->T);
+				FT = NULL;
+			}
+		}
+		return form + "}";
+	}
+
+	// Gives T the representation of the equal type canon. For records the
+	// field entities are shared as well, since their offsets are identical.
+	void share (TypeDenoter* canon, TypeDenoter* T) {
+		T->entity = canon->entity;
+		if (T->class_type() == "RECORDTYPEDENOTER")
+			shareFields(((RecordTypeDenoter*) canon)->FT, ((RecordTypeDenoter*) T)->FT);
+	}
+
+	void shareFields (FieldTypeDenoter* canon, FieldTypeDenoter* FT) {
+		while (FT != NULL && canon != NULL) {
+			FT->entity = canon->entity;
+			if (FT->class_type() == "MULTIPLEFIELDTYPEDENOTER") {
+				canon = ((MultipleFieldTypeDenoter*) canon)->FT;
+				FT = ((MultipleFieldTypeDenoter*) FT)->FT;
+			}
+			else
+				FT = NULL;
+		}
+	}
+};
+
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef _LINKER
+#define _LINKER
+
+#include <map>
+#include <set>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "../ErrorReporter.h"
+#include "../TAM/Machine.h"
+#include "ObjectUnit.h"
+
+using namespace std;
+
+// Links separately compiled units into one object program in the code
+// store.
+//
+// The unit with the main program is placed first, at CB, and the modules
+// after it in the order they were added. Each unit's own code addresses
+// are moved by the address at which it is placed, and each call or
+// closure of a routine of another unit gets the address of the routine
+// exported under that name, which must have the signature the importing
+// unit was compiled against. The constants a unit was compiled with must
+// have the values their unit exports.
+
+class Linker {
+
+	Machine* mach;
+	ErrorReporter* reporter;
+	vector<ObjectUnit*> units;
+
+	void error (string message, string name);
+
+public:
+	// The union of the units' exposed words.
+	set<pair<int, int> > exposedWords;
+
+	Linker (Machine* mach, ErrorReporter* reporter);
+
+	// Reads the named unit; returns false, reporting why, if it can't be.
+	bool add (string objectName);
+
+	// Places the units in the code store and returns the end of the code;
+	// reports an error, and returns -1, if they do not make a program.
+	int link ();
+};
+
+
+Linker::Linker (Machine* mach, ErrorReporter* reporter) {
+	this->mach = mach;
+	this->reporter = reporter;
+}
+
+void Linker::error (string message, string name) {
+	printf("ERROR: ");
+	for (int p = 0; p < (signed) message.length(); p++)
+		if (message[p] == '%')
+			printf("%s", name.c_str());
+		else
+			printf("%c", message[p]);
+	printf("\n");
+	reporter->numErrors++;
+}
+
+bool Linker::add (string objectName) {
+	ObjectUnit* unit = new ObjectUnit();
+	string problem = unit->read(objectName);
+	if (problem != "") {
+		error("% " + problem, objectName);
+		return false;
+	}
+	units.push_back(unit);
+	return true;
+}
+
+int Linker::link () {
+	vector<int> order;
+	for (int u = 0; u < (signed) units.size(); u++)
+		if (units[u]->hasMain)
+			order.push_back(u);
+	if (order.size() != 1) {
+		error(order.empty() ? "no unit has a main program" : "more than one unit has a main program", "");
+		return -1;
+	}
+	for (int u = 0; u < (signed) units.size(); u++)
+		if (!units[u]->hasMain)
+			order.push_back(u);
+
+	// Place the units, and find the address of every exported routine.
+	vector<int> base(units.size());
+	map<string, int> exports;
+	map<string, string> signatures;
+	map<string, int> constants;
+	int addr = mach->CB;
+	for (int i = 0; i < (signed) order.size(); i++) {
+		ObjectUnit* unit = units[order[i]];
+		base[order[i]] = addr;
+		for (int e = 0; e < (signed) unit->exportAddrs.size(); e++) {
+			if (exports.count(unit->exportNames[e]) > 0)
+				error("% is exported by more than one unit", unit->exportNames[e]);
+			exports[unit->exportNames[e]] = addr + unit->exportAddrs[e];
+			signatures[unit->exportNames[e]] = unit->exportSignatures[e];
+		}
+		for (int c = 0; c < (signed) unit->constantNames.size(); c++) {
+			if (constants.count(unit->constantNames[c]) > 0)
+				error("constant % is exported by more than one unit", unit->constantNames[c]);
+			constants[unit->constantNames[c]] = unit->constantValues[c];
+		}
+		addr += unit->code.size();
+	}
+
+	mach->setCodeSize(addr - mach->CB);
+	set<string> missing, mismatched;
+	for (int u = 0; u < (signed) units.size(); u++) {
+		ObjectUnit* unit = units[u];
+		for (int i = 0; i < (signed) unit->relocated.size(); i++)
+			unit->code[unit->relocated[i]].d += base[u];
+		for (int i = 0; i < (signed) unit->importAddrs.size(); i++) {
+			if (exports.count(unit->importNames[i]) == 0) {
+				if (missing.insert(unit->importNames[i]).second)
+					error("% is not exported by any unit", unit->importNames[i]);
+			}
+			else if (signatures[unit->importNames[i]] != unit->importSignatures[i]) {
+				if (mismatched.insert(unit->importNames[i]).second)
+					error("% is imported with parameters or a result that differ from its export", unit->importNames[i]);
+			}
+			else
+				unit->code[unit->importAddrs[i]].d = exports[unit->importNames[i]];
+		}
+		for (int c = 0; c < (signed) unit->importedConstantNames.size(); c++) {
+			string name = unit->importedConstantNames[c];
+			if (constants.count(name) == 0) {
+				if (missing.insert(name).second)
+					error("constant % is not exported by any unit", name);
+			}
+			else if (constants[name] != unit->importedConstantValues[c]) {
+				if (mismatched.insert(name).second)
+					error("constant % is imported with a value that differs from its export", name);
+			}
+		}
+		copy(unit->code.begin(), unit->code.end(), mach->code.begin() + base[u]);
+		exposedWords.insert(unit->exposedWords.begin(), unit->exposedWords.end());
+	}
+	return reporter->numErrors == 0 ? addr : -1;
+}
+
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef _OBJECTUNIT
+#define _OBJECTUNIT
+
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+#include "../TAM/Instruction.h"
+
+using namespace std;
+
+// A separately compiled program or module, as held in a .tamo file,
+// before linking.
+//
+// Code addresses in the code are relative to the start of the unit; the
+// instructions whose operands are such addresses are listed in relocated.
+// Calls and closures of routines in other units have operand 0 and are
+// listed in importAddrs, with the names of the routines in importNames.
+// The routines the unit exports are listed by name, with their addresses.
+// Each routine exported or imported has its signature (see
+// Encoder::routineSignature), so that the linker can tell whether a unit
+// was compiled against a different version of the routine.
+// The constants of a module are compiled into the units that import it,
+// so the unit lists the constants it exports and the constants of other
+// units it was compiled with, each with its value, and the linker checks
+// that the values agree.
+// Only a program, not a module, has a main program, which starts the
+// code.
+//
+// The file starts with a header of eleven big-endian words: the magic
+// number, the format version, 1 iff there is a main program, and the
+// number of instructions, wide operands, relocations, exports, imports,
+// exposed words, exported constants and imported constants. The
+// instructions follow, packed as in .tam files, then the tables in that
+// order. An export or import is an address, a name and a signature; a
+// constant is a name and a value. A name or signature is a word holding
+// its length, followed by its characters.
+
+class ObjectUnit {
+
+	vector<unsigned char> bytes;
+	int pos;
+
+	void putWord (int word);
+	void putName (string name);
+	int getWord ();
+	string getName ();
+
+public:
+	static const int unitMagic = 0x54414D4F;  // "TAMO"
+	static const int unitVersion = 4;
+	static const int headerSize = 44;         // bytes
+
+	bool hasMain;
+	vector<Instruction> code;
+	vector<int> relocated;
+	vector<int> importAddrs;
+	vector<string> importNames;
+	vector<string> importSignatures;
+	vector<int> exportAddrs;
+	vector<string> exportNames;
+	vector<string> exportSignatures;
+	set<pair<int, int> > exposedWords;  // see Encoder::exposedWords
+	vector<string> constantNames;
+	vector<int> constantValues;
+	vector<string> importedConstantNames;
+	vector<int> importedConstantValues;
+
+	ObjectUnit ();
+
+	void write (string objectName);
+
+	// Reads the named file, and returns "" or what is wrong with it.
+	string read (string objectName);
+};
+
+
+ObjectUnit::ObjectUnit () {
+	hasMain = false;
+	pos = 0;
+}
+
+void ObjectUnit::putWord (int word) {
+	bytes.resize(pos + 4);
+	Instruction::putWord(&bytes[pos], word);
+	pos += 4;
+}
+
+void ObjectUnit::putName (string name) {
+	putWord(name.size());
+	bytes.insert(bytes.end(), name.begin(), name.end());
+	pos += name.size();
+}
+
+int ObjectUnit::getWord () {
+	int word = Instruction::getWord(&bytes[pos]);
+	pos += 4;
+	return word;
+}
+
+string ObjectUnit::getName () {
+	int length = getWord();
+	if (length < 0 || pos + length > (signed) bytes.size())
+		return "";
+	string name(bytes.begin() + pos, bytes.begin() + pos + length);
+	pos += length;
+	return name;
+}
+
+void ObjectUnit::write (string objectName) {
+	vector<int> wide;
+	for (int addr = 0; addr < (signed) code.size(); addr++)
+		if (code[addr].isWide())
+			wide.push_back(addr);
+
+	bytes.clear();
+	pos = 0;
+	putWord(unitMagic);
+	putWord(unitVersion);
+	putWord(hasMain ? 1 : 0);
+	putWord(code.size());
+	putWord(wide.size());
+	putWord(relocated.size());
+	putWord(exportAddrs.size());
+	putWord(importAddrs.size());
+	putWord(exposedWords.size());
+	putWord(constantNames.size());
+	putWord(importedConstantNames.size());
+
+	bytes.resize(pos + 4 * code.size());
+	for (int addr = 0; addr < (signed) code.size(); addr++, pos += 4)
+		code[addr].encode(&bytes[pos]);
+	for (int w = 0; w < (signed) wide.size(); w++) {
+		putWord(wide[w]);
+		putWord(code[wide[w]].d);
+	}
+	for (int i = 0; i < (signed) relocated.size(); i++)
+		putWord(relocated[i]);
+	for (int i = 0; i < (signed) exportAddrs.size(); i++) {
+		putWord(exportAddrs[i]);
+		putName(exportNames[i]);
+		putName(exportSignatures[i]);
+	}
+	for (int i = 0; i < (signed) importAddrs.size(); i++) {
+		putWord(importAddrs[i]);
+		putName(importNames[i]);
+		putName(importSignatures[i]);
+	}
+	for (set<pair<int, int> >::iterator w = exposedWords.begin(); w != exposedWords.end(); w++) {
+		putWord(w->first);
+		putWord(w->second);
+	}
+	for (int i = 0; i < (signed) constantNames.size(); i++) {
+		putName(constantNames[i]);
+		putWord(constantValues[i]);
+	}
+	for (int i = 0; i < (signed) importedConstantNames.size(); i++) {
+		putName(importedConstantNames[i]);
+		putWord(importedConstantValues[i]);
+	}
+
+	std::ofstream objectStream(objectName.c_str(), ios_base::binary);
+	objectStream.write((char*) &bytes[0], bytes.size());
+}
+
+string ObjectUnit::read (string objectName) {
+	std::ifstream objectStream(objectName.c_str(), ios_base::binary);
+	if (!objectStream.good())
+		return "can't be opened";
+	objectStream.seekg(0, ios_base::end);
+	int size = (int) objectStream.tellg();
+	objectStream.seekg(0, ios_base::beg);
+	bytes.assign(size + 1, 0);
+	objectStream.read((char*) &bytes[0], size);
+	bytes.resize(size);
+
+	pos = 0;
+	if (size < headerSize || getWord() != unitMagic)
+		return "is not a TAM object unit";
+	if (getWord() != unitVersion)
+		return "has an unsupported object unit version";
+	hasMain = (getWord() == 1);
+	int count = getWord();
+	int wide = getWord();
+	int relocations = getWord();
+	int exports = getWord();
+	int imports = getWord();
+	int exposed = getWord();
+	int constants = getWord();
+	int importedConstants = getWord();
+
+	// Every entry takes at least a word, so the counts can be checked
+	// before anything is read.
+	if (count < 0 || wide < 0 || relocations < 0 || exports < 0 || imports < 0 || exposed < 0 ||
+		constants < 0 || importedConstants < 0 ||
+		(long) size < headerSize + 4L * count + 8L * wide + 4L * relocations + 12L * exports +
+		12L * imports + 8L * exposed + 8L * constants + 8L * importedConstants)
+		return "is truncated";
+
+	code.assign(count, Instruction());
+	for (int addr = 0; addr < count; addr++, pos += 4)
+		code[addr].decode(&bytes[pos]);
+	for (int w = 0; w < wide; w++) {
+		int addr = getWord();
+		int d = getWord();
+		if (addr < 0 || addr >= count)
+			return "is corrupt";
+		code[addr].d = d;
+	}
+	for (int i = 0; i < relocations; i++)
+		relocated.push_back(getWord());
+	for (int i = 0; i < exports && pos + 12 <= size; i++) {
+		int addr = getWord();
+		string name = getName();
+		if (pos + 4 > size)
+			break;
+		exportAddrs.push_back(addr);
+		exportNames.push_back(name);
+		exportSignatures.push_back(getName());
+	}
+	for (int i = 0; i < imports && pos + 12 <= size; i++) {
+		int addr = getWord();
+		string name = getName();
+		if (pos + 4 > size)
+			break;
+		importAddrs.push_back(addr);
+		importNames.push_back(name);
+		importSignatures.push_back(getName());
+	}
+	for (int i = 0; i < exposed && pos + 8 <= size; i++) {
+		int level = getWord();
+		exposedWords.insert(make_pair(level, getWord()));
+	}
+	for (int i = 0; i < constants && pos + 8 <= size; i++) {
+		string name = getName();
+		if (pos + 4 > size)
+			break;
+		constantNames.push_back(name);
+		constantValues.push_back(getWord());
+	}
+	for (int i = 0; i < importedConstants && pos + 8 <= size; i++) {
+		string name = getName();
+		if (pos + 4 > size)
+			break;
+		importedConstantNames.push_back(name);
+		importedConstantValues.push_back(getWord());
+	}
+	if ((signed) exportAddrs.size() != exports || (signed) importAddrs.size() != imports ||
+		(signed) exposedWords.size() != exposed || (signed) constantNames.size() != constants ||
+		(signed) importedConstantNames.size() != importedConstants)
+		return "is truncated";
+
+	for (int i = 0; i < relocations; i++)
+		if (relocated[i] < 0 || relocated[i] >= count)
+			return "is corrupt";
+	for (int i = 0; i < exports; i++)
+		if (exportAddrs[i] < 0 || exportAddrs[i] >= count)
+			return "is corrupt";
+	for (int i = 0; i < imports; i++)
+		if (importAddrs[i] < 0 || importAddrs[i] >= count)
+			return "is corrupt";
+	return "";
+}
+
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef _PEEPHOLE
+#define _PEEPHOLE
+
+#include <string>
+#include <vector>
+#include "../TAM/Instruction.h"
+#include "../TAM/Machine.h"
+#include "Relocator.h"
+
+using namespace std;
+
+// Peephole optimization of the object code in the TAM code store.
+//
+// Each rule rewrites a short instruction pattern into a shorter one:
+//   succ      LOADL 1; CALL add   =>  CALL succ   (likewise sub => pred)
+//   addzero   LOADL 0; CALL add   =>  (nothing)   (likewise sub)
+//   emptystack  PUSH 0  and  POP(0) 0  =>  (nothing)
+//   loadstore LOAD(n) d[r]; STORE(n) d[r]  =>  (nothing)
+//   jumpnext  JUMP to the instruction that follows  =>  (nothing)
+// A pattern is only rewritten when no jump lands inside it, and jump
+// table entries are never removed. Deleted
+// instructions are squeezed out of the code store by a Relocator.
+
+class Peephole {
+
+	Machine* mach;
+	Relocator* relocator;
+
+	// Addresses of instructions that control can enter other than by
+	// falling through from the instruction before.
+	vector<bool> target;
+	vector<bool> tableEntry;
+
+	bool isPrimitiveCall (Instruction* instr, int displacement);
+	void findTargets (int end);
+
+public:
+	static const int SUCC = 1;
+	static const int ADDZERO = 2;
+	static const int EMPTYSTACK = 4;
+	static const int LOADSTORE = 8;
+	static const int JUMPNEXT = 16;
+	static const int ALL = 31;
+
+	int rules;    // the rules enabled, a set of the flags above
+	int removed;  // instructions removed by the last optimize
+
+	Peephole (Machine* mach, int rules);
+
+	// Optimizes the code from CB up to end, repeating until no rule
+	// applies, and returns the new end of the code.
+	int optimize (int end);
+
+	// Parses a comma-separated list of rule names into a set of rules,
+	// or returns -1 if a name is not known.
+	static int parseRules (string names);
+};
+
+
+Peephole::Peephole (Machine* mach, int rules) {
+	this->mach = mach;
+	this->rules = rules;
+	relocator = new Relocator(mach);
+	removed = 0;
+}
+
+bool Peephole::isPrimitiveCall (Instruction* instr, int displacement) {
+	return instr->op == mach->CALLop && instr->r == mach->PBr && instr->d == displacement;
+}
+
+void Peephole::findTargets (int end) {
+	target.assign(end + 1, false);
+	tableEntry.assign(end + 1, false);
+	target[mach->CB] = true;
+	for (int addr = mach->CB; addr < end; addr++) {
+		Instruction* instr = &mach->code[addr];
+		if (relocator->isCodeAddress(instr) && instr->d >= mach->CB && instr->d <= end)
+			target[instr->d] = true;
+		if (relocator->isJumpTable(instr))
+			for (int entry = 0; entry < instr->n && instr->d + entry < end; entry++)
+				target[instr->d + entry] = tableEntry[instr->d + entry] = true;
+	}
+}
+
+int Peephole::optimize (int end) {
+	int start = end;
+	bool changed = true;
+
+	while (changed) {
+		changed = false;
+		findTargets(end);
+		for (int addr = mach->CB; addr < end; addr++) {
+			Instruction* instr = &mach->code[addr];
+			Instruction* next = (addr + 1 < end) ? &mach->code[addr + 1] : NULL;
+			bool pair = (next != NULL && !target[addr + 1]);
+
+			if ((rules & SUCC) && pair && instr->op == mach->LOADLop && instr->d == 1 &&
+				(isPrimitiveCall(next, mach->addDisplacement) || isPrimitiveCall(next, mach->subDisplacement))) {
+				next->d = (next->d == mach->addDisplacement) ? mach->succDisplacement : mach->predDisplacement;
+				relocator->remove(addr);
+				addr++;
+				changed = true;
+			}
+			else if ((rules & ADDZERO) && pair && instr->op == mach->LOADLop && instr->d == 0 &&
+				(isPrimitiveCall(next, mach->addDisplacement) || isPrimitiveCall(next, mach->subDisplacement))) {
+				relocator->remove(addr);
+				relocator->remove(addr + 1);
+				addr++;
+				changed = true;
+			}
+			else if ((rules & EMPTYSTACK) &&
+				((instr->op == mach->PUSHop && instr->d == 0) ||
+				 (instr->op == mach->POPop && instr->n == 0 && instr->d == 0))) {
+				relocator->remove(addr);
+				changed = true;
+			}
+			else if ((rules & LOADSTORE) && pair && instr->op == mach->LOADop && next->op == mach->STOREop &&
+				instr->n == next->n && instr->r == next->r && instr->d == next->d) {
+				relocator->remove(addr);
+				relocator->remove(addr + 1);
+				addr++;
+				changed = true;
+			}
+			else if ((rules & JUMPNEXT) && instr->op == mach->JUMPop && instr->r == mach->CBr &&
+				instr->d == addr + 1 && !tableEntry[addr]) {
+				relocator->remove(addr);
+				changed = true;
+			}
+		}
+		if (changed)
+			end = relocator->compact(end);
+	}
+	removed = start - end;
+	return end;
+}
+
+int Peephole::parseRules (string names) {
+	int rules = 0;
+	names += ",";
+	for (size_t from = 0, comma; (comma = names.find(',', from)) != string::npos; from = comma + 1) {
+		string name = names.substr(from, comma - from);
+		if (name == "succ")
+			rules |= SUCC;
+		else if (name == "addzero")
+			rules |= ADDZERO;
+		else if (name == "emptystack")
+			rules |= EMPTYSTACK;
+		else if (name == "loadstore")
+			rules |= LOADSTORE;
+		else if (name == "jumpnext")
+			rules |= JUMPNEXT;
+		else if (name != "")
+			return -1;
+	}
+	return rules;
+}
+
+
+#endif
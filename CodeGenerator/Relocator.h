@@ -0,0 +1,77 @@
+#ifndef _RELOCATOR
+#define _RELOCATOR
+
+#include <vector>
+#include "../TAM/Instruction.h"
+#include "../TAM/Machine.h"
+
+using namespace std;
+
+// Removes deleted instructions from the TAM code store and relocates the
+// code addresses that remain. The optimizers over the emitted code mark an
+// instruction deleted by calling remove.
+
+class Relocator {
+
+	Machine* mach;
+	vector<bool> deleted;  // address -> true iff marked deleted
+
+public:
+
+	Relocator (Machine* mach) {
+		this->mach = mach;
+	}
+
+	void remove (int addr) {
+		if (addr >= (signed) deleted.size())
+			deleted.resize(addr + 1, false);
+		deleted[addr] = true;
+	}
+
+	// True iff the d-field of instr is an address in the code store.
+	bool isCodeAddress (Instruction* instr) {
+		return instr->r == mach->CBr &&
+			(instr->op == mach->JUMPop || instr->op == mach->JUMPIFop ||
+			 instr->op == mach->CALLop || instr->op == mach->LOADAop ||
+			 (instr->op == mach->FUSEDop && instr->n >= mach->callJumpKind && instr->n < mach->indexLoadKind));
+	}
+
+	// True iff instr loads the address of a jump table: a run of JUMPs,
+	// as many as its n-field, that is entered only by a JUMPI.
+	bool isJumpTable (Instruction* instr) {
+		return instr->op == mach->LOADAop && instr->r == mach->CBr && instr->n > 0;
+	}
+
+	// True iff instr calls, or makes a closure of, the routine starting at
+	// its d-field.
+	bool isRoutineAddress (Instruction* instr) {
+		return instr->r == mach->CBr && (instr->op == mach->CALLop || instr->op == mach->LOADAop) &&
+			!isJumpTable(instr);
+	}
+
+	// Squeezes the deleted instructions out of the code from CB up to end
+	// and returns the new end. An address of a deleted instruction is
+	// relocated to the next instruction kept.
+	int compact (int end) {
+		vector<int> newAddr(end + 1);
+		int next = mach->CB;
+		for (int addr = mach->CB; addr < end; addr++) {
+			newAddr[addr] = next;
+			if (addr >= (signed) deleted.size() || !deleted[addr])
+				mach->code[next++] = mach->code[addr];
+		}
+		newAddr[end] = next;
+		deleted.clear();
+		mach->setCodeSize(next - mach->CB);
+
+		for (int addr = mach->CB; addr < next; addr++) {
+			Instruction* instr = &mach->code[addr];
+			if (isCodeAddress(instr) && instr->d >= mach->CB && instr->d <= end)
+				instr->d = newAddr[instr->d];
+		}
+		return next;
+	}
+};
+
+
+#endif
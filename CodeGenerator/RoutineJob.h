@@ -0,0 +1,37 @@
+#ifndef _ROUTINEJOB
+#define _ROUTINEJOB
+
+#include "../import_headers.h"
+#include "../ErrorReporter.h"
+
+using namespace std;
+
+// A routine declared in the main program, whose code is generated by one
+// of the encoder's workers into the segment made for it. The routines
+// nested in it go into segments that the worker numbers after the main
+// encoder's, from firstNested up to endNested, until the segments of all
+// the workers are put together (see Encoder::encodeDeferredRoutines).
+
+class RoutineJob {
+
+public:
+	Declaration* routine;
+	int segment;
+	ErrorReporter* reporter;  // holds the restrictions met in the routine
+	int worker;
+	int firstNested;
+	int endNested;
+
+	RoutineJob (Declaration* routine, int segment) {
+		this->routine = routine;
+		this->segment = segment;
+		reporter = new ErrorReporter();
+		reporter->holding = true;
+		worker = 0;
+		firstNested = 0;
+		endNested = 0;
+	}
+};
+
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _SEGMENT
+#define _SEGMENT
+
+#include <string>
+#include <vector>
+#include "../TAM/Instruction.h"
+
+using namespace std;
+
+// The code of one routine, or of the main program, generated apart from
+// the rest. Code addresses in it are relative to the start of a segment:
+// each instruction whose operand is a code address is listed in
+// relocations, with the segment that address is in, so that linking can
+// add the address at which that segment is placed. A segment standing
+// for a routine of another unit has no code: only the routine's name and
+// signature, which the linker of units resolves and checks.
+
+class Segment {
+
+public:
+	vector<Instruction> code;
+	vector<int> relocations;  // instructions whose operand is a code address
+	vector<int> targets;      // relocation -> segment its address is in
+	int address;              // where the segment is placed, once linked
+	string symbol;            // the name of a routine of another unit, or ""
+	string signature;         // and its signature (see Encoder::routineSignature)
+
+	Segment () {
+		address = -1;
+	}
+};
+
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef _STACKDEPTH
+#define _STACKDEPTH
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+#include "../TAM/Instruction.h"
+#include "../TAM/Machine.h"
+#include "Relocator.h"
+
+using namespace std;
+
+// Finds, for each routine in the object code, how far the stack can grow
+// above the routine's LB while it runs: its frame's link data, locals and
+// the words it pushes, but not the frames of the routines it calls. The
+// depths are written to the object file, so that the interpreter need
+// only check for space when a routine is called.
+//
+// The code from a routine's entry to the next routine's entry is taken to
+// be the routine. The height of the stack, ST - LB, is followed through
+// it from the entry; where paths meet, or a height can't be known exactly
+// (after an eq or ne whose size isn't a literal), the greatest possible is
+// taken, so each height found is a bound. A CALLI carries the sizes of its
+// result and arguments (see Encoder::visitIdentifier). A routine whose
+// heights can't be bounded, because control leaves it other than by a
+// call or return or a height grows round a loop, gets no depth.
+
+class StackDepth {
+
+	Machine* mach;
+	Relocator* relocator;
+	int end;
+
+	vector<bool> target;          // address -> true iff jumped to
+	map<int, int> returnChange;   // routine entry -> greatest change in ST made by calling it
+	map<int, vector<int> > jumpTables;  // routine entry -> the jump table entries in it
+
+	int primitiveChange (int addr, int p, bool literalSize);
+	int measure (int from, int to);
+
+public:
+	// The depth of a routine whose stack can't be bounded; a greater depth
+	// than maxDepth is taken to be unbounded.
+	static const int unbounded = -1;
+	static const int maxDepth = 65536;
+
+	vector<int> entries;  // routine entries, in address order; the first is CB
+	vector<int> depths;   // the depth of the routine at each entry, or unbounded
+
+	StackDepth (Machine* mach);
+
+	// Finds the routines in the code from CB up to end, and their depths.
+	void analyze (int end);
+};
+
+
+StackDepth::StackDepth (Machine* mach) {
+	this->mach = mach;
+	relocator = new Relocator(mach);
+	end = 0;
+}
+
+// The change in ST made by the primitive at displacement p, called by the
+// instruction at addr, or the most it can be. The size that eq and ne take
+// from the stack is known if it was pushed by a LOADL just before, or
+// (literalSize) by the superinstruction at addr.
+int StackDepth::primitiveChange (int addr, int p, bool literalSize) {
+	if (p == mach->eqDisplacement || p == mach->neDisplacement) {
+		Instruction* instr = &mach->code[addr];
+		if (literalSize)
+			return -2 * instr->d;
+		Instruction* before = &mach->code[addr - 1];
+		if (addr > mach->CB && !target[addr] && before->op == mach->LOADLop && before->d >= 0)
+			return -2 * before->d;
+		return 0;
+	}
+	if (p == mach->eolDisplacement || p == mach->eofDisplacement)
+		return 1;
+	if (p == mach->andDisplacement || p == mach->orDisplacement ||
+		(p >= mach->addDisplacement && p <= mach->gtDisplacement) ||
+		p == mach->getDisplacement || p == mach->putDisplacement || p == mach->getintDisplacement ||
+		p == mach->putintDisplacement || p == mach->disposeDisplacement)
+		return -1;
+	return 0;
+}
+
+// The depth of the routine from .. to - 1, or unbounded.
+int StackDepth::measure (int from, int to) {
+	int base = (from == mach->CB) ? 0 : mach->linkDataSize;
+	vector<int> height(to - from, -1);
+	height[0] = base;
+	int depth = base;
+	vector<int> work(1, from);
+	while (!work.empty()) {
+		int addr = work.back();
+		work.pop_back();
+		Instruction* instr = &mach->code[addr];
+		int op = instr->op, n = instr->n, r = instr->r, d = instr->d;
+		int at = height[addr - from], peak = at;
+		bool fallsThrough = true;
+		vector<int> next;
+		if (op == mach->LOADop)
+			at += n;
+		else if (op == mach->LOADAop || op == mach->LOADLop)
+			at += 1;
+		else if (op == mach->LOADIop)
+			at += n - 1;
+		else if (op == mach->STOREop)
+			at -= n;
+		else if (op == mach->STOREIop)
+			at -= n + 1;
+		else if (op == mach->CALLop && r == mach->PBr)
+			at += primitiveChange(addr, d, false);
+		else if (op == mach->CALLop && r == mach->CBr && returnChange.count(d) > 0)
+			at += returnChange[d];
+		else if (op == mach->CALLop && r == mach->CBr)
+			fallsThrough = false;  // the routine never returns
+		else if (op == mach->CALLIop)
+			at += n - d - mach->closureSize;
+		else if (op == mach->PUSHop)
+			at += d;
+		else if (op == mach->POPop)
+			at -= d;
+		else if (op == mach->JUMPop && r == mach->CBr) {
+			next.push_back(d);
+			fallsThrough = false;
+		}
+		else if (op == mach->JUMPIop && !jumpTables[from].empty()) {
+			next = jumpTables[from];
+			at -= 1;
+			fallsThrough = false;
+		}
+		else if (op == mach->JUMPIFop && r == mach->CBr) {
+			next.push_back(d);
+			at -= 1;
+		}
+		else if (op == mach->RETURNop || op == mach->HALTop)
+			fallsThrough = false;
+		else if (op == mach->FUSEDop && n < mach->loadCallKind) {
+			peak = at + 1;
+			at += 1 + primitiveChange(addr, n - mach->literalCallKind, true);
+		}
+		else if (op == mach->FUSEDop && n < mach->loadLoadCallKind) {
+			peak = at + 1;
+			at += 1 + primitiveChange(addr, n - mach->loadCallKind, false);
+		}
+		else if (op == mach->FUSEDop && n < mach->callJumpKind) {
+			peak = at + 2;
+			at += 2 + primitiveChange(addr, n - mach->loadLoadCallKind, false);
+		}
+		else if (op == mach->FUSEDop && n < mach->indexLoadKind) {
+			next.push_back(d);
+			at += primitiveChange(addr, (n - mach->callJumpKind) % 32, false) - 1;
+		}
+		else if (op == mach->FUSEDop && n == mach->loadLoadKind)
+			at += 2;
+		else if (!(op == mach->FUSEDop && n == mach->indexLoadKind))
+			return unbounded;
+		if (fallsThrough)
+			next.push_back(addr + 1);
+
+		depth = max(depth, max(peak, at));
+		if (depth > maxDepth)
+			return unbounded;
+		for (int i = 0; i < (signed) next.size(); i++) {
+			int s = next[i];
+			if (s < from || s >= to)
+				return unbounded;
+			if (at > height[s - from]) {
+				height[s - from] = at;
+				work.push_back(s);
+			}
+		}
+	}
+	return depth;
+}
+
+void StackDepth::analyze (int end) {
+	this->end = end;
+	target.assign(end + 1, false);
+	returnChange.clear();
+	jumpTables.clear();
+
+	set<int> starts;
+	starts.insert(mach->CB);
+	for (int addr = mach->CB; addr < end; addr++) {
+		Instruction* instr = &mach->code[addr];
+		if (relocator->isRoutineAddress(instr) && instr->d >= mach->CB && instr->d < end)
+			starts.insert(instr->d);
+		else if (relocator->isCodeAddress(instr) && instr->d >= mach->CB && instr->d <= end)
+			target[instr->d] = true;
+	}
+	entries.assign(starts.begin(), starts.end());
+
+	for (int k = 0; k < (signed) entries.size(); k++) {
+		int from = entries[k], to = (k + 1 < (signed) entries.size()) ? entries[k + 1] : end;
+		for (int addr = from; addr < to; addr++) {
+			Instruction* instr = &mach->code[addr];
+			if (relocator->isJumpTable(instr))
+				for (int e = 0; e < instr->n && instr->d + e <= end; e++) {
+					target[instr->d + e] = true;
+					jumpTables[from].push_back(instr->d + e);
+				}
+			if (instr->op == mach->RETURNop) {
+				int change = instr->n - instr->d;
+				returnChange[from] = (returnChange.count(from) > 0) ? max(returnChange[from], change) : change;
+			}
+		}
+	}
+
+	depths.clear();
+	for (int k = 0; k < (signed) entries.size(); k++)
+		depths.push_back(measure(entries[k], (k + 1 < (signed) entries.size()) ? entries[k + 1] : end));
+}
+
+
+#endif
@@ -0,0 +1,595 @@
+#ifndef _STRENGTHREDUCTION
+#define _STRENGTHREDUCTION
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+#include "../TAM/Machine.h"
+#include "IRProgram.h"
+
+using namespace std;
+
+// Reduces the strength of array indexing in loops.
+//
+// An induction variable is a frame word that the loop changes only by
+// adding a constant to it, in one place. Where the loop body computes
+// i * elemSize + address of a, from an induction variable i, the value is
+// instead kept in a stack temporary below the loop's working stack. The
+// temporary is computed from i on every edge into the loop. It is bumped
+// by step * elemSize right after i is stepped, and popped on every edge
+// out of the loop. Frame addresses above the temporary move up by one
+// word inside the loop.
+//
+// A loop that calls a routine is left alone, as is a variable that
+// exposedWords says may be changed through its address.
+//
+// Loops are found from the immediate dominators of each routine's blocks,
+// computed once for the routine and kept up to date as the blocks on the
+// edges into and out of a reduced loop are added.
+
+class StrengthReduction {
+
+	Machine* mach;
+	IRProgram* program;
+	set<pair<int, int> >* exposedWords;
+
+	IRRoutine* routine;
+	int frameRegister;      // SB in the main program, LB in routines
+
+	// The routine's blocks are numbered from 0, in the order they are
+	// first seen, for the tables below.
+	vector<int> position;   // block -> its number in the routine, or -1
+	vector<int> blockOf;    // number -> block
+	vector<vector<int> > predecessors;  // number -> numbers of its predecessors
+	vector<int> idom;       // number -> its immediate dominator's, or -1 if unreachable
+	vector<long> order;     // number -> a number greater than its immediate dominator's
+	vector<bool> inLoop;    // number -> true iff in the loop being reduced
+	vector<int> loopBlocks; // numbers of the blocks in the loop being reduced
+	bool stale;             // true iff idom and order must be found again
+	int depth;              // stack depth on entry to the loop
+
+	// The induction variable, its step, and the derived value elemSize * i
+	// (+ the address loaded by LOADA base, if hasBase).
+	int varRegister, varDisplacement, step;
+	int elemSize;
+	bool hasBase;
+	int baseRegister, baseDisplacement;
+
+	void successors (IRBlock* block, vector<int>& succ);
+	int addBlock (int b);
+	void findDominators ();
+	bool dominates (int a, int b);
+	int commonDominator (int a, int b);
+	void splitEdges (int e, int target, vector<int>& from);
+	void findSlots (IRBlock* block);
+	bool findLoop (int header, int tail);
+	bool findInductionVariable (int r, int d);
+	int matchUse (IRBlock* block, int j, int& size, bool& base, int& br, int& bd);
+	bool reduceLoop (int header, int tail);
+	void redirect (IRBlock* from, int target, int replacement);
+	IRInstruction* newInstruction (int op, int n, int r, int d, int uses, int defs);
+
+public:
+	int reduced;  // index multiplications removed from loops
+
+	StrengthReduction (Machine* mach, set<pair<int, int> >& exposedWords);
+
+	void run (IRProgram* program);
+};
+
+
+StrengthReduction::StrengthReduction (Machine* mach, set<pair<int, int> >& exposedWords) {
+	this->mach = mach;
+	this->exposedWords = &exposedWords;
+	program = NULL;
+	routine = NULL;
+	frameRegister = 0;
+	depth = 0;
+	stale = false;
+	reduced = 0;
+}
+
+IRInstruction* StrengthReduction::newInstruction (int op, int n, int r, int d, int uses, int defs) {
+	IRInstruction* instr = new IRInstruction(op, n, r, d);
+	instr->uses.assign(uses, 0);
+	instr->defs.assign(defs, 0);
+	return instr;
+}
+
+void StrengthReduction::successors (IRBlock* block, vector<int>& succ) {
+	for (int j = 0; j < (signed) block->instructions.size(); j++) {
+		IRInstruction* instr = block->instructions[j];
+		if (instr->block >= 0)
+			succ.push_back(instr->block);
+		succ.insert(succ.end(), instr->table.begin(), instr->table.end());
+	}
+	if (block->fallthrough >= 0)
+		succ.push_back(block->fallthrough);
+}
+
+// Gives the block b a number in the routine's tables.
+
+int StrengthReduction::addBlock (int b) {
+	if (b >= (signed) position.size())
+		position.resize(b + 1, -1);
+	position[b] = blockOf.size();
+	blockOf.push_back(b);
+	predecessors.push_back(vector<int>());
+	idom.push_back(-1);
+	order.push_back(0);
+	inLoop.push_back(false);
+	return position[b];
+}
+
+// Finds the immediate dominators of the routine's blocks by the method of
+// Cooper, Harvey and Kennedy, over the blocks in reverse postorder. The
+// order of a block is its place in that order, spaced so that blocks
+// added later can be fitted in between.
+
+void StrengthReduction::findDominators () {
+	int count = blockOf.size();
+	int entry = position[routine->blocks[0]];
+	vector<int> postorder, next(count, 0);
+	vector<bool> seen(count, false);
+	vector<vector<int> > succ(count);
+	vector<int> stack(1, entry);
+	seen[entry] = true;
+	successors(program->blocks[blockOf[entry]], succ[entry]);
+	while (!stack.empty()) {
+		int b = stack.back();
+		if (next[b] < (signed) succ[b].size()) {
+			int s = position[succ[b][next[b]++]];
+			if (!seen[s]) {
+				seen[s] = true;
+				successors(program->blocks[blockOf[s]], succ[s]);
+				stack.push_back(s);
+			}
+		}
+		else {
+			postorder.push_back(b);
+			stack.pop_back();
+		}
+	}
+
+	vector<int> rpo(count, -1);  // number -> place in reverse postorder
+	for (int k = 0; k < (signed) postorder.size(); k++)
+		rpo[postorder[postorder.size() - 1 - k]] = k;
+	idom.assign(count, -1);
+	idom[entry] = entry;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int k = (signed) postorder.size() - 2; k >= 0; k--) {
+			int b = postorder[k], dom = -1;
+			for (int p = 0; p < (signed) predecessors[b].size(); p++) {
+				int a = predecessors[b][p];
+				if (idom[a] < 0)
+					continue;
+				if (dom < 0) {
+					dom = a;
+					continue;
+				}
+				while (a != dom) {
+					while (rpo[a] > rpo[dom])
+						a = idom[a];
+					while (rpo[dom] > rpo[a])
+						dom = idom[dom];
+				}
+			}
+			if (dom != idom[b]) {
+				idom[b] = dom;
+				changed = true;
+			}
+		}
+	}
+	for (int b = 0; b < count; b++)
+		order[b] = (rpo[b] + 1) * 1024L;
+}
+
+// True iff block number a dominates block number b; no block dominates
+// an unreachable one.
+
+bool StrengthReduction::dominates (int a, int b) {
+	if (idom[a] < 0 || idom[b] < 0)
+		return false;
+	while (order[b] > order[a])
+		b = idom[b];
+	return a == b;
+}
+
+int StrengthReduction::commonDominator (int a, int b) {
+	set<int> above;
+	for (above.insert(a); idom[a] != a; a = idom[a])
+		above.insert(idom[a]);
+	while (above.count(b) == 0)
+		b = idom[b];
+	return b;
+}
+
+// Records that the edges from the blocks numbered in from to the block
+// numbered target now go through the new block numbered e. The dominators
+// of the other blocks are unchanged, but that e may now dominate target.
+
+void StrengthReduction::splitEdges (int e, int target, vector<int>& from) {
+	vector<int>& into = predecessors[target];
+	for (int p = 0; p < (signed) from.size(); p++)
+		into.erase(remove(into.begin(), into.end(), from[p]), into.end());
+	into.push_back(e);
+	predecessors[e] = from;
+
+	int dom = -1;
+	for (int p = 0; p < (signed) from.size(); p++)
+		if (idom[from[p]] >= 0)
+			dom = (dom < 0) ? from[p] : commonDominator(dom, from[p]);
+	idom[e] = dom;
+	if (dom < 0)
+		return;
+	order[e] = order[dom] + 1;
+	if (idom[target] == target)
+		return;
+	for (int p = 0; p < (signed) into.size(); p++)
+		if (into[p] != e && idom[into[p]] >= 0)
+			return;
+
+	// Every way into target is now through e.
+	long below = order[idom[target]], above = order[target];
+	idom[target] = e;
+	if (above - below >= 2)
+		order[e] = below + (above - below) / 2;
+	else
+		stale = true;
+}
+
+// Sets the stack slot of each instruction of the block.
+
+void StrengthReduction::findSlots (IRBlock* block) {
+	int height = block->entryDepth;
+	for (int j = 0; j < (signed) block->instructions.size(); j++) {
+		IRInstruction* instr = block->instructions[j];
+		height -= instr->uses.size();
+		instr->slot = height;
+		height += instr->defs.size();
+	}
+}
+
+// Finds the blocks of the loop closed by the edge from tail to header,
+// and checks that a temporary can be kept below its working stack.
+
+bool StrengthReduction::findLoop (int header, int tail) {
+	for (int i = 0; i < (signed) loopBlocks.size(); i++)
+		inLoop[loopBlocks[i]] = false;
+	loopBlocks.assign(1, header);
+	inLoop[header] = true;
+	vector<int> work;
+	if (!inLoop[tail]) {
+		inLoop[tail] = true;
+		loopBlocks.push_back(tail);
+		work.push_back(tail);
+	}
+	while (!work.empty()) {
+		int b = work.back();
+		work.pop_back();
+		for (int p = 0; p < (signed) predecessors[b].size(); p++)
+			if (!inLoop[predecessors[b][p]]) {
+				inLoop[predecessors[b][p]] = true;
+				loopBlocks.push_back(predecessors[b][p]);
+				work.push_back(predecessors[b][p]);
+			}
+	}
+	if (inLoop[position[routine->blocks[0]]])
+		return false;
+
+	depth = program->blocks[blockOf[header]]->entryDepth;
+	for (int i = 0; i < (signed) loopBlocks.size(); i++) {
+		int b = loopBlocks[i];
+		IRBlock* block = program->blocks[blockOf[b]];
+		for (int p = 0; p < (signed) predecessors[b].size(); p++)
+			if (!inLoop[predecessors[b][p]] && block->entryDepth != depth)
+				return false;
+		vector<int> succ;
+		successors(block, succ);
+		for (int s = 0; s < (signed) succ.size(); s++)
+			if (!inLoop[position[succ[s]]] && program->blocks[succ[s]]->entryDepth < depth)
+				return false;
+
+		if (block->entryDepth < depth)
+			return false;
+		for (int j = 0; j < (signed) block->instructions.size(); j++) {
+			IRInstruction* instr = block->instructions[j];
+			if (instr->slot < depth || !instr->table.empty() || instr->op == mach->CALLIop ||
+				(instr->op == mach->CALLop && instr->r == mach->CBr))
+				return false;
+		}
+	}
+	return true;
+}
+
+// True iff the word d[r] is an induction variable of the loop, setting
+// step.
+
+bool StrengthReduction::findInductionVariable (int r, int d) {
+	int level = (r == mach->SBr) ? 0 : routine->level - (r - mach->LBr);
+	if (exposedWords->count(make_pair(level, d)) > 0 || (r == frameRegister && d >= depth))
+		return false;
+
+	int increments = 0;
+	for (int i = 0; i < (signed) loopBlocks.size(); i++) {
+		IRBlock* block = program->blocks[blockOf[loopBlocks[i]]];
+		for (int j = 0; j < (signed) block->instructions.size(); j++) {
+			IRInstruction* instr = block->instructions[j];
+			if (instr->op != mach->STOREop || instr->r != r || d < instr->d || d >= instr->d + instr->n)
+				continue;
+
+			// Only d[r] := d[r] + c, d[r] := d[r] - c, succ and pred.
+			vector<IRInstruction*>& code = block->instructions;
+			int c = 0;
+			bool matched = false;
+			if (instr->n == 1 && j >= 2 && code[j - 2]->op == mach->LOADop && code[j - 2]->n == 1 &&
+				code[j - 2]->r == r && code[j - 2]->d == d && code[j - 1]->op == mach->CALLop &&
+				code[j - 1]->r == mach->PBr &&
+				(code[j - 1]->d == mach->succDisplacement || code[j - 1]->d == mach->predDisplacement)) {
+				c = (code[j - 1]->d == mach->succDisplacement) ? 1 : -1;
+				matched = true;
+			}
+			else if (instr->n == 1 && j >= 3 && code[j - 1]->op == mach->CALLop && code[j - 1]->r == mach->PBr &&
+					 (code[j - 1]->d == mach->addDisplacement || code[j - 1]->d == mach->subDisplacement)) {
+				IRInstruction* a = code[j - 3];
+				IRInstruction* b = code[j - 2];
+				bool aVar = a->op == mach->LOADop && a->n == 1 && a->r == r && a->d == d;
+				bool bVar = b->op == mach->LOADop && b->n == 1 && b->r == r && b->d == d;
+				if (aVar && b->op == mach->LOADLop) {
+					c = (code[j - 1]->d == mach->addDisplacement) ? b->d : -b->d;
+					matched = true;
+				}
+				else if (bVar && a->op == mach->LOADLop && code[j - 1]->d == mach->addDisplacement) {
+					c = a->d;
+					matched = true;
+				}
+			}
+			if (!matched || ++increments > 1)
+				return false;
+			step = c;
+		}
+	}
+	return increments == 1;
+}
+
+// If instruction j of the block starts i * elemSize (+ base address)
+// with i the induction variable, returns the number of instructions and
+// sets the element size and base; else returns 0.
+
+int StrengthReduction::matchUse (IRBlock* block, int j, int& size, bool& base, int& br, int& bd) {
+	vector<IRInstruction*>& code = block->instructions;
+	int count = code.size();
+	IRInstruction* load = code[j];
+	if (load->op != mach->LOADop || load->n != 1 || load->r != varRegister || load->d != varDisplacement)
+		return 0;
+
+	int length;
+	if (j + 2 < count && code[j + 1]->op == mach->LOADLop && code[j + 2]->op == mach->CALLop &&
+		code[j + 2]->r == mach->PBr && code[j + 2]->d == mach->multDisplacement) {
+		size = code[j + 1]->d;
+		length = 3;
+	}
+	else {
+		size = 1;
+		length = 1;
+	}
+	base = (j + length + 1 < count && code[j + length]->op == mach->LOADAop && code[j + length]->n == 0 &&
+			code[j + length]->r != mach->CBr && code[j + length + 1]->op == mach->CALLop &&
+			code[j + length + 1]->r == mach->PBr && code[j + length + 1]->d == mach->addDisplacement);
+	if (base) {
+		br = code[j + length]->r;
+		bd = code[j + length]->d;
+		length += 2;
+	}
+	return (length > 1) ? length : 0;
+}
+
+void StrengthReduction::redirect (IRBlock* from, int target, int replacement) {
+	for (int j = 0; j < (signed) from->instructions.size(); j++)
+		if (from->instructions[j]->block == target)
+			from->instructions[j]->block = replacement;
+	if (from->fallthrough == target)
+		from->fallthrough = replacement;
+}
+
+bool StrengthReduction::reduceLoop (int header, int tail) {
+	if (!findLoop(position[header], position[tail]))
+		return false;
+
+	// Choose the induction variable and derived value used most.
+	map<vector<int>, int> uses;
+	for (int i = 0; i < (signed) loopBlocks.size(); i++) {
+		IRBlock* block = program->blocks[blockOf[loopBlocks[i]]];
+		for (int j = 0; j < (signed) block->instructions.size(); j++) {
+			IRInstruction* instr = block->instructions[j];
+			if (instr->op != mach->LOADop || instr->n != 1 ||
+				(instr->r != mach->SBr && (instr->r < mach->LBr || instr->r > mach->L6r)))
+				continue;
+			varRegister = instr->r;
+			varDisplacement = instr->d;
+			int size, br = 0, bd = 0;
+			bool base;
+			if (matchUse(block, j, size, base, br, bd) == 0)
+				continue;
+			int key[] = {instr->r, instr->d, size, base, br, bd};
+			uses[vector<int>(key, key + 6)]++;
+		}
+	}
+
+	vector<int> best;
+	int bestCount = 0;
+	for (map<vector<int>, int>::iterator u = uses.begin(); u != uses.end(); u++)
+		if (u->second > bestCount && findInductionVariable(u->first[0], u->first[1])) {
+			best = u->first;
+			bestCount = u->second;
+		}
+	if (bestCount == 0)
+		return false;
+	varRegister = best[0];
+	varDisplacement = best[1];
+	findInductionVariable(varRegister, varDisplacement);
+	elemSize = best[2];
+	hasBase = best[3];
+	baseRegister = best[4];
+	baseDisplacement = best[5];
+
+	// Rewrite the loop with the temporary at depth.
+	for (int i = 0; i < (signed) loopBlocks.size(); i++) {
+		IRBlock* block = program->blocks[blockOf[loopBlocks[i]]];
+		vector<IRInstruction*> code;
+		for (int j = 0; j < (signed) block->instructions.size(); j++) {
+			IRInstruction* instr = block->instructions[j];
+			int size, br = 0, bd = 0;
+			bool base;
+			int length = matchUse(block, j, size, base, br, bd);
+			if (length > 0 && size == elemSize && base == hasBase && (!base || (br == baseRegister && bd == baseDisplacement))) {
+				code.push_back(newInstruction(mach->LOADop, 1, frameRegister, depth, 0, 1));
+				j += length - 1;
+				reduced++;
+				continue;
+			}
+
+			if (instr->r == frameRegister && instr->d >= depth &&
+				(instr->op == mach->LOADop || instr->op == mach->LOADAop || instr->op == mach->STOREop))
+				instr->d++;
+			code.push_back(instr);
+			if (instr->op == mach->STOREop && instr->r == varRegister && instr->d == varDisplacement) {
+				code.push_back(newInstruction(mach->LOADop, 1, frameRegister, depth, 0, 1));
+				code.push_back(newInstruction(mach->LOADLop, 0, 0, step * elemSize, 0, 1));
+				code.push_back(newInstruction(mach->CALLop, mach->SBr, mach->PBr, mach->addDisplacement, 2, 1));
+				code.push_back(newInstruction(mach->STOREop, 1, frameRegister, depth, 1, 0));
+			}
+		}
+		block->instructions = code;
+		block->entryDepth++;
+		findSlots(block);
+	}
+
+	// Compute the temporary on the way in, and pop it on the way out. The
+	// edges are taken in the order of their sources in the routine.
+	vector<bool> entering(blockOf.size(), false);
+	for (int i = 0; i < (signed) loopBlocks.size(); i++)
+		for (int p = 0; p < (signed) predecessors[loopBlocks[i]].size(); p++)
+			entering[predecessors[loopBlocks[i]][p]] = true;
+	vector<int> blocks = routine->blocks;
+	map<int, int> entries, exits;
+	vector<int> edgeTargets;
+	map<int, vector<int> > edgeSources;  // edge block -> numbers of the blocks redirected to it
+	for (int i = 0; i < (signed) blocks.size(); i++) {
+		int b = blocks[i];
+		if (!inLoop[position[b]] && !entering[position[b]])
+			continue;
+		vector<int> succ;
+		successors(program->blocks[b], succ);
+		for (int s = 0; s < (signed) succ.size(); s++) {
+			int target = succ[s];
+			bool out = inLoop[position[b]];
+			if (out == inLoop[position[target]])
+				continue;
+			map<int, int>& edges = out ? exits : entries;
+			if (edges.count(target) == 0) {
+				IRBlock* edge = new IRBlock(program->blocks[target]->address);
+				edges[target] = program->blocks.size();
+				program->blocks.push_back(edge);
+				addBlock(edges[target]);
+				edgeTargets.push_back(target);
+				int at = find(routine->blocks.begin(), routine->blocks.end(), out ? target : b) -
+					routine->blocks.begin();
+				routine->blocks.insert(routine->blocks.begin() + (out ? at : at + 1), edges[target]);
+
+				if (out) {
+					int above = program->blocks[target]->entryDepth - depth;
+					edge->entryDepth = program->blocks[target]->entryDepth + 1;
+					edge->instructions.push_back(newInstruction(mach->POPop, above, 0, 1, above + 1, above));
+					edge->fallthrough = target;
+				}
+				else {
+					edge->entryDepth = depth;
+					edge->instructions.push_back(newInstruction(mach->LOADop, 1, varRegister, varDisplacement, 0, 1));
+					if (elemSize != 1) {
+						edge->instructions.push_back(newInstruction(mach->LOADLop, 0, 0, elemSize, 0, 1));
+						edge->instructions.push_back(newInstruction(mach->CALLop, mach->SBr, mach->PBr, mach->multDisplacement, 2, 1));
+					}
+					if (hasBase) {
+						edge->instructions.push_back(newInstruction(mach->LOADAop, 0, baseRegister, baseDisplacement, 0, 1));
+						edge->instructions.push_back(newInstruction(mach->CALLop, mach->SBr, mach->PBr, mach->addDisplacement, 2, 1));
+					}
+					IRInstruction* jump = newInstruction(mach->JUMPop, 0, mach->CBr, 0, 0, 0);
+					jump->block = target;
+					edge->instructions.push_back(jump);
+				}
+				findSlots(edge);
+			}
+			redirect(program->blocks[b], target, edges[target]);
+			vector<int>& sources = edgeSources[edges[target]];
+			if (sources.empty() || sources.back() != position[b])
+				sources.push_back(position[b]);
+		}
+	}
+
+	stale = false;
+	for (int i = 0; i < (signed) edgeTargets.size(); i++) {
+		int target = edgeTargets[i];
+		int edge = inLoop[position[target]] ? entries[target] : exits[target];
+		splitEdges(position[edge], position[target], edgeSources[edge]);
+	}
+	if (stale)
+		findDominators();
+	return true;
+}
+
+void StrengthReduction::run (IRProgram* program) {
+	this->program = program;
+	reduced = 0;
+	position.assign(program->blocks.size(), -1);
+	for (int k = 0; k < (signed) program->routines.size(); k++) {
+		routine = program->routines[k];
+		if (routine->level < 0)
+			continue;
+		frameRegister = routine->isMain ? mach->SBr : mach->LBr;
+
+		blockOf.clear();
+		predecessors.clear();
+		idom.clear();
+		order.clear();
+		inLoop.clear();
+		loopBlocks.clear();
+		for (int i = 0; i < (signed) routine->blocks.size(); i++)
+			addBlock(routine->blocks[i]);
+		for (int i = 0; i < (signed) routine->blocks.size(); i++) {
+			vector<int> succ;
+			successors(program->blocks[routine->blocks[i]], succ);
+			for (int s = 0; s < (signed) succ.size(); s++)
+				predecessors[position[succ[s]]].push_back(i);
+		}
+		findDominators();
+
+		// Reduce loop by loop, each closed by an edge to a block that
+		// dominates its source.
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (int i = 0; i < (signed) routine->blocks.size() && !changed; i++) {
+				int b = routine->blocks[i];
+				vector<int> succ;
+				successors(program->blocks[b], succ);
+				for (int s = 0; s < (signed) succ.size() && !changed; s++)
+					if (dominates(position[succ[s]], position[b]) && reduceLoop(succ[s], b))
+						changed = true;
+			}
+		}
+		for (int i = 0; i < (signed) blockOf.size(); i++)
+			position[blockOf[i]] = -1;
+	}
+
+	// The instructions' slots were kept up to date as the loops were
+	// rewritten; their virtual registers are numbered once, at the end.
+	if (reduced > 0)
+		program->renumber();
+}
+
+
+#endif
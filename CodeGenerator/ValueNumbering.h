@@ -0,0 +1,252 @@
+#ifndef _VALUENUMBERING
+#define _VALUENUMBERING
+
+#include <map>
+#include <vector>
+#include "../TAM/Machine.h"
+#include "IRProgram.h"
+
+using namespace std;
+
+// Eliminates common subexpressions within the basic blocks of the IR,
+// chiefly the index and address arithmetic that is generated again for
+// every use of a subscripted or dotted v-name.
+//
+// Values are numbered by operation and operand numbers. A load is only
+// the same value as an earlier one if no store could have changed the
+// word in between. When a value computed by several instructions is
+// computed again later in the block, the first result is kept on the
+// stack as a temporary: a copy of it is loaded for its first use and for
+// every later one, in place of the code that computed it again, and the
+// temporary is popped after the last. Frame addresses above the
+// temporary move up by one word while it is kept.
+
+class ValueNumbering {
+
+	Machine* mach;
+	IRProgram* program;
+
+	IRBlock* block;
+	int frameRegister;        // SB in the main program, LB in routines
+	vector<int> valueOf;      // instruction -> number of its value, or -1
+	vector<int> treeStart;    // instruction -> first instruction computing its value, or -1
+
+	bool isPure (IRInstruction* instr);
+	void numberValues ();
+	bool keepable (int first, int end);
+	bool eliminateOne ();
+	void keepValue (int first, vector<int>& reuses);
+
+public:
+	int eliminated;  // computations replaced by a load of a kept value
+
+	ValueNumbering (Machine* mach);
+
+	void run (IRProgram* program);
+};
+
+
+ValueNumbering::ValueNumbering (Machine* mach) {
+	this->mach = mach;
+	program = NULL;
+	block = NULL;
+	frameRegister = 0;
+	eliminated = 0;
+}
+
+// True iff the instruction computes one word from its operands and
+// memory, and nothing else.
+
+bool ValueNumbering::isPure (IRInstruction* instr) {
+	if (instr->defs.size() != 1)
+		return false;
+	int op = instr->op;
+	if (op == mach->LOADLop || op == mach->LOADIop)
+		return true;
+	if (op == mach->LOADop || op == mach->LOADAop)
+		return instr->r != mach->CBr;
+	if (op == mach->CALLop && instr->r == mach->PBr) {
+		int d = instr->d;
+		return (d >= mach->notDisplacement && d <= mach->neDisplacement) || d == mach->idDisplacement;
+	}
+	return false;
+}
+
+void ValueNumbering::numberValues () {
+	int count = block->instructions.size();
+	valueOf.assign(count, -1);
+	treeStart.assign(count, -1);
+
+	map<vector<int>, int> numbers;
+	map<int, int> defAt;           // vreg -> instruction defining it
+	map<pair<int, int>, int> version;  // frame word -> stores to it so far
+	int stores = 0;                // stores of any kind so far
+	int calls = 0;                 // stores through addresses, and calls, so far
+
+	for (int j = 0; j < count; j++) {
+		IRInstruction* instr = block->instructions[j];
+		for (int v = 0; v < (signed) instr->defs.size(); v++)
+			defAt[instr->defs[v]] = j;
+
+		if (isPure(instr)) {
+			vector<int> key;
+			key.push_back(instr->op);
+			key.push_back(instr->n);
+			key.push_back(instr->r);
+			key.push_back(instr->d);
+			if (instr->op == mach->LOADop) {
+				key.push_back(calls);
+				key.push_back(version[make_pair(instr->r, instr->d)]);
+			}
+			else if (instr->op == mach->LOADIop)
+				key.push_back(stores);
+
+			// The operands must be values computed just before, in order.
+			bool tree = true;
+			int end = j;
+			for (int u = instr->uses.size() - 1; u >= 0 && tree; u--) {
+				int operand = instr->uses[u];
+				if (IRInstruction::isSlot(operand) || defAt.count(operand) == 0 ||
+					defAt[operand] != end - 1 || valueOf[end - 1] < 0 || treeStart[end - 1] < 0)
+					tree = false;
+				else {
+					key.push_back(valueOf[end - 1]);
+					end = treeStart[end - 1];
+				}
+			}
+			if (tree) {
+				if (numbers.count(key) == 0) {
+					int number = numbers.size();
+					numbers[key] = number;
+				}
+				valueOf[j] = numbers[key];
+				treeStart[j] = end;
+			}
+		}
+
+		if (instr->op == mach->STOREop) {
+			for (int w = 0; w < instr->n; w++)
+				version[make_pair(instr->r, instr->d + w)]++;
+			stores++;
+		}
+		else if (instr->op == mach->STOREIop || (instr->op == mach->CALLop && !isPure(instr)) ||
+				 instr->op == mach->CALLIop) {
+			stores++;
+			calls++;
+		}
+	}
+}
+
+// True iff the value defined by instruction first can be kept on the
+// stack until instruction end: nothing in between takes words from below
+// it or calls a routine that could address the frame above it.
+
+bool ValueNumbering::keepable (int first, int end) {
+	int slot = block->instructions[first]->slot;
+	for (int j = first + 1; j <= end; j++) {
+		IRInstruction* instr = block->instructions[j];
+		if (instr->slot < slot || (instr->op == mach->CALLop && instr->r == mach->CBr) ||
+			instr->op == mach->CALLIop)
+			return false;
+	}
+	return true;
+}
+
+// Finds the repeated value whose elimination saves most instructions in
+// the block, and eliminates it. Returns false if there is none.
+
+bool ValueNumbering::eliminateOne () {
+	numberValues();
+	int count = block->instructions.size();
+	int bestFirst = -1;
+	int bestSaving = 0;
+	vector<int> bestReuses;
+
+	for (int first = 0; first < count; first++) {
+		if (valueOf[first] < 0 || first - treeStart[first] < 1)
+			continue;
+		bool earlier = false;
+		for (int k = 0; k < first && !earlier; k++)
+			earlier = (valueOf[k] == valueOf[first]);
+		if (earlier)
+			continue;
+
+		// Later computations of the value, while it can still be kept.
+		vector<int> reuses;
+		int saving = -2;  // the copy of the first value, and the final POP
+		for (int j = first + 1; j < count; j++)
+			if (valueOf[j] == valueOf[first] && treeStart[j] > first) {
+				if (!keepable(first, treeStart[j] - 1))
+					break;
+				reuses.push_back(j);
+				saving += j - treeStart[j];
+			}
+		if (!reuses.empty() && saving > bestSaving) {
+			bestFirst = first;
+			bestSaving = saving;
+			bestReuses = reuses;
+		}
+	}
+
+	if (bestFirst < 0)
+		return false;
+	keepValue(bestFirst, bestReuses);
+	eliminated += bestReuses.size();
+	return true;
+}
+
+void ValueNumbering::keepValue (int first, vector<int>& reuses) {
+	int slot = block->instructions[first]->slot;
+	int last = reuses.back();
+	vector<IRInstruction*> code;
+	int r = 0;
+
+	for (int j = 0; j < (signed) block->instructions.size(); j++) {
+		IRInstruction* instr = block->instructions[j];
+		if (r < (signed) reuses.size() && j >= treeStart[reuses[r]] && j <= reuses[r]) {
+			if (j < reuses[r])
+				continue;
+			// The value is loaded from the temporary instead.
+			IRInstruction* load = new IRInstruction(mach->LOADop, 1, frameRegister, slot);
+			load->defs.push_back(0);
+			code.push_back(load);
+			if (j == last) {
+				int above = instr->slot + 1 - slot;
+				IRInstruction* pop = new IRInstruction(mach->POPop, above, 0, 1);
+				pop->uses.assign(above + 1, 0);
+				pop->defs.assign(above, 0);
+				code.push_back(pop);
+			}
+			r++;
+			continue;
+		}
+
+		if (j > first && j <= last && instr->r == frameRegister && instr->d >= slot &&
+			(instr->op == mach->LOADop || instr->op == mach->LOADAop || instr->op == mach->STOREop))
+			instr->d++;
+		code.push_back(instr);
+		if (j == first) {
+			IRInstruction* copy = new IRInstruction(mach->LOADop, 1, frameRegister, slot);
+			copy->defs.push_back(0);
+			code.push_back(copy);
+		}
+	}
+	block->instructions = code;
+}
+
+void ValueNumbering::run (IRProgram* program) {
+	this->program = program;
+	eliminated = 0;
+	for (int k = 0; k < (signed) program->routines.size(); k++) {
+		IRRoutine* routine = program->routines[k];
+		frameRegister = routine->isMain ? mach->SBr : mach->LBr;
+		for (int i = 0; i < (signed) routine->blocks.size(); i++) {
+			block = program->blocks[routine->blocks[i]];
+			while (eliminateOne())
+				program->renumber();
+		}
+	}
+}
+
+
+#endif
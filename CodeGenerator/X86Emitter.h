@@ -0,0 +1,524 @@
+#ifndef _X86EMITTER
+#define _X86EMITTER
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../TAM/Instruction.h"
+#include "../TAM/Machine.h"
+#include "Relocator.h"
+
+using namespace std;
+
+// Translates the object program in the TAM code store into x86-64
+// assembly (GNU as syntax), to be linked with the runtime in
+// Runtime/tam_runtime.c into a standalone executable.
+//
+// The TAM data store is the runtime's array tam_data, whose address is
+// kept in %rbx; ST and LB, as word indices into it, are kept in %r12 and
+// %r13, and HT is the runtime's tam_HT. Each TAM instruction becomes a
+// short run of native instructions, labelled with its code address. A
+// TAM call also makes a native call, so that RETURN is a native ret; the
+// frame in the data store is laid out as the interpreter lays it out.
+// Jumps and calls to computed code addresses go through a table of the
+// instructions' labels. The arithmetic and relational primitives are
+// done inline, the others by tam_primitive in the runtime; a relational
+// primitive followed by a JUMPIF becomes a native compare and branch.
+// Failures jump to tam_fail, with the status the interpreter would stop
+// with.
+
+class X86Emitter {
+
+	Machine* mach;
+	FILE* out;
+	int end;
+
+	// Addresses of instructions that control can enter other than by
+	// falling through from the instruction before.
+	vector<bool> target;
+
+	void emit (const char* format, ...);
+	void findTargets ();
+	string operand (int r, int d, const char* scratch);
+	void loadValue (int r, int d, const char* reg);
+	void checkSpace (int n);
+	void copyWords (int n);
+	void indirect (const char* how);
+	void callRuntime (int displacement);
+	void compare (const char* set);
+	int emitPrimitive (int addr, int p, bool singleWords);
+	int emitInstruction (int addr);
+
+public:
+	X86Emitter (Machine* mach);
+
+	// Writes the code from CB up to end, as assembly, into the named file;
+	// returns false if the file can't be written.
+	bool write (string asmName, int end);
+
+	// Assembles the named file into an object file with the system C
+	// compiler; returns false if that fails.
+	static bool assemble (string asmName, string objName);
+};
+
+
+X86Emitter::X86Emitter (Machine* mach) {
+	this->mach = mach;
+	out = NULL;
+	end = 0;
+}
+
+void X86Emitter::emit (const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	fprintf(out, "\t");
+	vfprintf(out, format, args);
+	fprintf(out, "\n");
+	va_end(args);
+}
+
+void X86Emitter::findTargets () {
+	Relocator* relocator = new Relocator(mach);
+	target.assign(end + 1, false);
+	target[mach->CB] = true;
+	for (int addr = mach->CB; addr < end; addr++) {
+		Instruction* instr = &mach->code[addr];
+		if (relocator->isCodeAddress(instr) && instr->d >= mach->CB && instr->d <= end)
+			target[instr->d] = true;
+		if (relocator->isJumpTable(instr))
+			for (int entry = 0; entry < instr->n && instr->d + entry < end; entry++)
+				target[instr->d + entry] = true;
+	}
+}
+
+// The memory operand for the data word at d[r]; for a display register,
+// the code that finds the frame it points to, into scratch, comes first.
+string X86Emitter::operand (int r, int d, const char* scratch) {
+	char text[64];
+	if (r == mach->LBr)
+		sprintf(text, "%d(%%rbx,%%r13,4)", 4 * d);
+	else if (r == mach->STr)
+		sprintf(text, "%d(%%rbx,%%r12,4)", 4 * d);
+	else if (r >= mach->L1r && r <= mach->L6r) {
+		emit("movslq (%%rbx,%%r13,4), %s", scratch);
+		for (int level = mach->L1r; level < r; level++)
+			emit("movslq (%%rbx,%s,4), %s", scratch, scratch);
+		sprintf(text, "%d(%%rbx,%s,4)", 4 * d, scratch);
+	}
+	else if (r == mach->HTr || r == mach->HBr) {
+		emit("movq %s(%%rip), %s", r == mach->HTr ? "tam_HT" : "tam_HB", scratch);
+		sprintf(text, "%d(%%rbx,%s,4)", 4 * d, scratch);
+	}
+	else
+		sprintf(text, "%d(%%rbx)", 4 * d);  // SB, at the start of the data store
+	return text;
+}
+
+// Loads d + content(r) into reg.
+void X86Emitter::loadValue (int r, int d, const char* reg) {
+	if (r == mach->CBr)
+		emit("movq $%d, %s", d + mach->CB, reg);
+	else if (r == mach->CTr)
+		emit("movq $%d, %s", d + end, reg);
+	else if (r == mach->PBr)
+		emit("movq $%d, %s", d + mach->PB, reg);
+	else if (r == mach->PTr)
+		emit("movq $%d, %s", d + mach->PT, reg);
+	else if (r == mach->SBr)
+		emit("movq $%d, %s", d, reg);
+	else {
+		string data = operand(r, d, reg);
+		emit("leaq %s, %s", data.c_str(), reg);
+		emit("subq %%rbx, %s", reg);
+		emit("sarq $2, %s", reg);
+	}
+}
+
+// Fails if the stack can't grow by n words.
+void X86Emitter::checkSpace (int n) {
+	emit("leaq %d(%%r12), %%rax", n);
+	emit("cmpq tam_HT(%%rip), %%rax");
+	emit("ja .Lfull");
+}
+
+// Copies n words, in ascending order, from (%rsi) to (%rdi).
+void X86Emitter::copyWords (int n) {
+	if (n <= 8)
+		for (int i = 0; i < n; i++) {
+			emit("movl %d(%%rsi), %%ecx", 4 * i);
+			emit("movl %%ecx, %d(%%rdi)", 4 * i);
+		}
+	else {
+		emit("movl $%d, %%edx", n);
+		fprintf(out, "1:\n");
+		emit("movl (%%rsi), %%ecx");
+		emit("movl %%ecx, (%%rdi)");
+		emit("addq $4, %%rsi");
+		emit("addq $4, %%rdi");
+		emit("decl %%edx");
+		emit("jnz 1b");
+	}
+}
+
+// Jumps to, or calls, the instruction whose offset from CB is in %rax.
+void X86Emitter::indirect (const char* how) {
+	emit("cmpq $%d, %%rax", end - mach->CB);
+	emit("jae .Laddress");
+	emit("leaq .Ltable(%%rip), %%rdx");
+	emit("movslq (%%rdx,%%rax,4), %%rax");
+	emit("addq %%rdx, %%rax");
+	emit("%s *%%rax", how);
+}
+
+// Calls tam_primitive for the primitive routine at displacement.
+void X86Emitter::callRuntime (int displacement) {
+	emit("movl $%d, %%edi", displacement);
+	emit("movq %%r12, %%rsi");
+	emit("call .Lprimitive");
+	emit("movq %%rax, %%r12");
+}
+
+// Compares the two words on top of the stack, popping them and pushing
+// the truth value that the condition set leaves in %al.
+void X86Emitter::compare (const char* set) {
+	emit("movl -8(%%rbx,%%r12,4), %%eax");
+	emit("cmpl -4(%%rbx,%%r12,4), %%eax");
+	emit("%s %%al", set);
+	emit("movzbl %%al, %%eax");
+	emit("decq %%r12");
+	emit("movl %%eax, -4(%%rbx,%%r12,4)");
+}
+
+// Emits the call of the primitive routine at displacement p by the
+// instruction at addr, and returns the number of instructions used: a
+// following JUMPIF on the result of a comparison is taken as well.
+// singleWords is true iff eq and ne compare values of one word.
+int X86Emitter::emitPrimitive (int addr, int p, bool singleWords) {
+	static const char* conditions[] = {"l", "le", "ge", "g", "e", "ne"};
+	static const char* inverses[] = {"ge", "g", "l", "le", "ne", "e"};
+	int relation = -1;
+	if (p >= mach->ltDisplacement && p <= mach->gtDisplacement)
+		relation = p - mach->ltDisplacement;
+	else if (singleWords && (p == mach->eqDisplacement || p == mach->neDisplacement))
+		relation = (p == mach->eqDisplacement) ? 4 : 5;
+
+	Instruction* next = (addr + 1 < end && !target[addr + 1]) ? &mach->code[addr + 1] : NULL;
+	if (relation >= 0 && next != NULL && next->op == mach->JUMPIFop && next->r == mach->CBr &&
+		next->d >= mach->CB && next->d < end && (next->n == mach->trueRep || next->n == mach->falseRep)) {
+		emit("movl -8(%%rbx,%%r12,4), %%eax");
+		emit("subq $2, %%r12");
+		emit("cmpl 4(%%rbx,%%r12,4), %%eax");
+		emit("j%s .L%d", next->n == mach->trueRep ? conditions[relation] : inverses[relation], next->d);
+		return 2;
+	}
+
+	if (p == mach->idDisplacement)
+		;
+	else if (p == mach->notDisplacement) {
+		emit("cmpl $%d, -4(%%rbx,%%r12,4)", mach->trueRep);
+		emit("setne %%al");
+		emit("movzbl %%al, %%eax");
+		emit("movl %%eax, -4(%%rbx,%%r12,4)");
+	}
+	else if (p == mach->andDisplacement || p == mach->orDisplacement) {
+		emit("cmpl $%d, -8(%%rbx,%%r12,4)", mach->trueRep);
+		emit("sete %%al");
+		emit("cmpl $%d, -4(%%rbx,%%r12,4)", mach->trueRep);
+		emit("sete %%cl");
+		emit("%s %%cl, %%al", p == mach->andDisplacement ? "andb" : "orb");
+		emit("movzbl %%al, %%eax");
+		emit("decq %%r12");
+		emit("movl %%eax, -4(%%rbx,%%r12,4)");
+	}
+	else if (p >= mach->succDisplacement && p <= mach->multDisplacement && p != mach->negDisplacement) {
+		if (p == mach->succDisplacement || p == mach->predDisplacement) {
+			emit("movslq -4(%%rbx,%%r12,4), %%rax");
+			emit(p == mach->succDisplacement ? "incq %%rax" : "decq %%rax");
+		}
+		else {
+			emit("movslq -8(%%rbx,%%r12,4), %%rax");
+			emit("movslq -4(%%rbx,%%r12,4), %%rcx");
+			emit(p == mach->addDisplacement ? "addq %%rcx, %%rax" :
+				p == mach->subDisplacement ? "subq %%rcx, %%rax" : "imulq %%rcx, %%rax");
+			emit("decq %%r12");
+		}
+		emit("leaq %d(%%rax), %%rcx", mach->maxintRep);
+		emit("cmpq $%d, %%rcx", 2 * mach->maxintRep);
+		emit("ja .Loverflow");
+		emit("movl %%eax, -4(%%rbx,%%r12,4)");
+	}
+	else if (p == mach->negDisplacement)
+		emit("negl -4(%%rbx,%%r12,4)");
+	else if (p == mach->divDisplacement || p == mach->modDisplacement) {
+		emit("movslq -4(%%rbx,%%r12,4), %%rcx");
+		emit("testq %%rcx, %%rcx");
+		emit("jz .Lzero");
+		emit("movslq -8(%%rbx,%%r12,4), %%rax");
+		emit("cqto");
+		emit("idivq %%rcx");
+		emit("decq %%r12");
+		emit("movl %s, -4(%%rbx,%%r12,4)", p == mach->divDisplacement ? "%eax" : "%edx");
+	}
+	else if (relation >= 0)
+		compare((string("set") + conditions[relation]).c_str());
+	else
+		callRuntime(p);
+	return 1;
+}
+
+// Emits the instruction at addr, and returns the number of instructions
+// used.
+int X86Emitter::emitInstruction (int addr) {
+	Instruction* instr = &mach->code[addr];
+	int op = instr->op, n = instr->n, r = instr->r, d = instr->d;
+	string data;
+
+	if (op == mach->LOADop) {
+		checkSpace(n);
+		data = operand(r, d, "%rax");
+		if (n == 1) {
+			emit("movl %s, %%ecx", data.c_str());
+			emit("movl %%ecx, (%%rbx,%%r12,4)");
+		}
+		else {
+			emit("leaq %s, %%rsi", data.c_str());
+			emit("leaq (%%rbx,%%r12,4), %%rdi");
+			copyWords(n);
+		}
+		emit("addq $%d, %%r12", n);
+	}
+	else if (op == mach->LOADAop) {
+		checkSpace(1);
+		loadValue(r, d, "%rax");
+		emit("movl %%eax, (%%rbx,%%r12,4)");
+		emit("incq %%r12");
+	}
+	else if (op == mach->LOADIop) {
+		emit("decq %%r12");
+		checkSpace(n);
+		emit("movslq (%%rbx,%%r12,4), %%rax");
+		emit("leaq (%%rbx,%%rax,4), %%rsi");
+		emit("leaq (%%rbx,%%r12,4), %%rdi");
+		copyWords(n);
+		emit("addq $%d, %%r12", n);
+	}
+	else if (op == mach->LOADLop) {
+		Instruction* next = (addr + 1 < end && !target[addr + 1]) ? &mach->code[addr + 1] : NULL;
+		checkSpace(1);
+		if (d == 1 && next != NULL && next->op == mach->CALLop && next->r == mach->PBr &&
+			(next->d == mach->eqDisplacement || next->d == mach->neDisplacement)) {
+			// Equality of single words needs no call of the runtime.
+			return emitPrimitive(addr + 1, next->d, true) + 1;
+		}
+		emit("movl $%d, (%%rbx,%%r12,4)", d);
+		emit("incq %%r12");
+	}
+	else if (op == mach->STOREop) {
+		emit("subq $%d, %%r12", n);
+		data = operand(r, d, "%rax");
+		if (n == 1) {
+			emit("movl (%%rbx,%%r12,4), %%ecx");
+			emit("movl %%ecx, %s", data.c_str());
+		}
+		else {
+			emit("leaq (%%rbx,%%r12,4), %%rsi");
+			emit("leaq %s, %%rdi", data.c_str());
+			copyWords(n);
+		}
+	}
+	else if (op == mach->STOREIop) {
+		emit("movslq -4(%%rbx,%%r12,4), %%rax");
+		emit("subq $%d, %%r12", n + 1);
+		emit("leaq (%%rbx,%%r12,4), %%rsi");
+		emit("leaq (%%rbx,%%rax,4), %%rdi");
+		copyWords(n);
+	}
+	else if (op == mach->CALLop) {
+		if (r == mach->PBr)
+			return emitPrimitive(addr, d, false);
+		if (r != mach->CBr || d < mach->CB || d >= end) {
+			emit("jmp .Linstruction");
+			return 1;
+		}
+		checkSpace(3);
+		loadValue(n, 0, "%rax");
+		emit("movl %%eax, (%%rbx,%%r12,4)");
+		emit("movl %%r13d, 4(%%rbx,%%r12,4)");
+		emit("movl $%d, 8(%%rbx,%%r12,4)", addr + 1);
+		emit("movq %%r12, %%r13");
+		emit("addq $3, %%r12");
+		emit("call .L%d", d);
+	}
+	else if (op == mach->CALLIop) {
+		emit("subq $2, %%r12");
+		emit("movslq 4(%%rbx,%%r12,4), %%rax");
+		if (mach->CB != 0)
+			emit("subq $%d, %%rax", mach->CB);
+		emit("cmpq $%d, %%rax", mach->PB - mach->CB);
+		emit("jb 1f");
+		emit("leaq %d(%%rax), %%rdi", mach->CB - mach->PB);
+		emit("movq %%r12, %%rsi");
+		emit("call .Lprimitive");
+		emit("movq %%rax, %%r12");
+		emit("jmp .L%d", addr + 1);
+		fprintf(out, "1:\n");
+		emit("cmpq $%d, %%rax", end - mach->CB);
+		emit("jae .Laddress");
+		emit("movl %%r13d, 4(%%rbx,%%r12,4)");
+		emit("movl $%d, 8(%%rbx,%%r12,4)", addr + 1);
+		emit("movq %%r12, %%r13");
+		emit("addq $3, %%r12");
+		indirect("call");
+	}
+	else if (op == mach->RETURNop) {
+		emit("leaq %d(%%r13), %%rdi", -d);
+		emit("movslq 4(%%rbx,%%r13,4), %%r13");
+		emit("leaq %d(%%rbx,%%r12,4), %%rsi", -4 * n);
+		emit("leaq (%%rbx,%%rdi,4), %%rax");
+		emit("leaq %d(%%rdi), %%r12", n);
+		emit("movq %%rax, %%rdi");
+		copyWords(n);
+		emit("ret");
+	}
+	else if (op == mach->PUSHop) {
+		checkSpace(d);
+		emit("addq $%d, %%r12", d);
+	}
+	else if (op == mach->POPop) {
+		if (d != 0) {
+			emit("leaq %d(%%rbx,%%r12,4), %%rsi", -4 * n);
+			emit("leaq %d(%%rbx,%%r12,4), %%rdi", -4 * (n + d));
+			copyWords(n);
+			emit("subq $%d, %%r12", d);
+		}
+	}
+	else if (op == mach->JUMPop) {
+		if (r == mach->CBr && d >= mach->CB && d < end)
+			emit("jmp .L%d", d);
+		else {
+			loadValue(r, d - mach->CB, "%rax");
+			indirect("jmp");
+		}
+	}
+	else if (op == mach->JUMPIop) {
+		emit("decq %%r12");
+		emit("movslq (%%rbx,%%r12,4), %%rax");
+		if (mach->CB != 0)
+			emit("subq $%d, %%rax", mach->CB);
+		indirect("jmp");
+	}
+	else if (op == mach->JUMPIFop) {
+		emit("decq %%r12");
+		emit("cmpl $%d, (%%rbx,%%r12,4)", n);
+		if (r == mach->CBr && d >= mach->CB && d < end)
+			emit("je .L%d", d);
+		else {
+			emit("jne 2f");
+			loadValue(r, d - mach->CB, "%rax");
+			indirect("jmp");
+			fprintf(out, "2:\n");
+		}
+	}
+	else if (op == mach->HALTop)
+		emit("jmp .Lhalt");
+	else
+		emit("jmp .Linstruction");
+	return 1;
+}
+
+bool X86Emitter::write (string asmName, int end) {
+	this->end = end;
+	out = fopen(asmName.c_str(), "w");
+	if (out == NULL)
+		return false;
+	findTargets();
+
+	fprintf(out, "# Translated from TAM code by the Triangle compiler.\n");
+	emit(".text");
+	emit(".globl tam_run");
+	emit(".type tam_run, @function");
+	fprintf(out, "tam_run:\n");
+	emit("pushq %%rbx");
+	emit("pushq %%r12");
+	emit("pushq %%r13");
+	emit("pushq %%rbp");
+	emit("subq $8, %%rsp");
+	emit("movq %%rsp, tam_saved_sp(%%rip)");
+	emit("leaq tam_data(%%rip), %%rbx");
+	emit("xorl %%r12d, %%r12d");
+	emit("xorl %%r13d, %%r13d");
+	emit("jmp .L%d", mach->CB);
+	fprintf(out, ".Lhalt:\n");
+	emit("movq tam_saved_sp(%%rip), %%rsp");
+	emit("addq $8, %%rsp");
+	emit("popq %%rbp");
+	emit("popq %%r13");
+	emit("popq %%r12");
+	emit("popq %%rbx");
+	emit("ret");
+
+	// The runtime is called with the native stack aligned, as the ABI
+	// requires, whatever the depth of TAM calls.
+	fprintf(out, ".Lprimitive:\n");
+	emit("pushq %%rbp");
+	emit("movq %%rsp, %%rbp");
+	emit("andq $-16, %%rsp");
+	emit("call tam_primitive@PLT");
+	emit("movq %%rbp, %%rsp");
+	emit("popq %%rbp");
+	emit("ret");
+
+	// The labels of the instructions taken with the one before are kept
+	// for the table, although no jump goes to them.
+	for (int addr = mach->CB; addr < end; ) {
+		fprintf(out, ".L%d:\n", addr);
+		int used = emitInstruction(addr);
+		for (int a = addr + 1; a < addr + used; a++)
+			fprintf(out, ".L%d:\n", a);
+		addr += used;
+	}
+	fprintf(out, ".L%d:\n", end);
+	emit("jmp .Laddress");
+
+	const char* failures[] = {"full", "address", "instruction", "overflow", "zero"};
+	for (int f = 0; f < 5; f++) {
+		fprintf(out, ".L%s:\n", failures[f]);
+		emit("movl $%d, %%edi", f + 2);
+		emit("andq $-16, %%rsp");
+		emit("call tam_fail@PLT");
+	}
+
+	emit(".section .rodata");
+	emit(".align 4");
+	fprintf(out, ".Ltable:\n");
+	for (int addr = mach->CB; addr < end; addr++)
+		emit(".long .L%d-.Ltable", addr);
+	emit(".local tam_saved_sp");
+	emit(".comm tam_saved_sp, 8, 8");
+	emit(".section .note.GNU-stack,\"\",@progbits");
+	fclose(out);
+	return true;
+}
+
+bool X86Emitter::assemble (string asmName, string objName) {
+	// The names are passed to cc as they are, not through a shell.
+	const char* argv[] = { "cc", "-c", "-x", "assembler", asmName.c_str(), "-o", objName.c_str(), NULL };
+	pid_t child = fork();
+	if (child < 0)
+		return false;
+	if (child == 0) {
+		execvp("cc", (char* const*) argv);
+		_exit(127);
+	}
+	int status;
+	if (waitpid(child, &status, 0) != child)
+		return false;
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+
+#endif
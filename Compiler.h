@@ -4,8 +4,20 @@
 #include "import_headers.h"
 #include "./ContextualAnalyzer/Checker.h"
 #include "./CodeGenerator/Encoder.h"
+#include "./CodeGenerator/IRBuilder.h"
+#include "./CodeGenerator/IRLowering.h"
+#include "./CodeGenerator/Inliner.h"
+#include "./CodeGenerator/StrengthReduction.h"
+#include "./CodeGenerator/ValueNumbering.h"
+#include "./CodeGenerator/FlowGraph.h"
+#include "./CodeGenerator/Peephole.h"
+#include "./CodeGenerator/Fusion.h"
+#include "./CodeGenerator/X86Emitter.h"
+#include "./CodeGenerator/CEmitter.h"
+#include "./CodeGenerator/Linker.h"
 #include "./PrintVisitor/PVInt.h"
 #include "./PrintVisitor/PrintVisitor.h"
+#include "Statistics.h"
 
 using namespace std;
 
@@ -24,6 +36,65 @@ class Compiler
     //The AST representing the source program.
     Program* theAST;
 public:
+    //Per-phase statistics, collected only when non-NULL (tc --stats).
+    Statistics* stats;
+
+    //When true, a second call to compileProgram keeps the checker and only
+    //re-checks the declarations that changed since the previous call.
+    bool incremental;
+
+    //When true, the object code is rebuilt through the three-address IR;
+    //dumpingIR also prints the IR.
+    bool useIR;
+    bool dumpingIR;
+
+    //Nested routines needing at most this many extra parameters are
+    //lifted to level 0 (-1 turns lifting off).
+    int liftLimit;
+
+    //Number of threads the routines of the main program are generated on.
+    int jobs;
+
+    //Routines of at most this many IR instructions are inlined (0 turns
+    //inlining off).
+    int inlineBudget;
+
+    //When true, index arithmetic on induction variables is reduced to
+    //additions in loops.
+    bool reduceStrength;
+
+    //When true, values computed again within a basic block are reused.
+    bool useCSE;
+
+    //When true, jumps are threaded and unreachable code is removed.
+    bool optimizeFlow;
+
+    //Peephole rules applied to the object code (Peephole::ALL by default,
+    //0 turns the peephole pass off).
+    int peepholeRules;
+
+    //When true, common instruction sequences are fused into
+    //superinstructions (tc --plain-tam turns this off, for code that only
+    //uses the original TAM instructions).
+    bool fuseInstructions;
+
+    //The form the object program is written in: "tam" for TAM code, or,
+    //for tc --emit, "asm" for x86-64 assembly, "obj" for an x86-64
+    //object file or "c" for C source, to be linked with
+    //Runtime/tam_runtime.c.
+    string emitting;
+
+    //Source files of the modules whose declarations the program may use
+    //(tc --import=file); their routines are left for the linker.
+    vector<string> imports;
+
+    //When true, the source is a module: a sequence of declarations whose
+    //routines are exported.
+    bool compilingModule;
+
+    //When true, an object unit (.tamo) is written, to be linked with others
+    //by linkProgram; it is optimized only then.
+    bool compilingUnit;
 
 	Compiler(){
 		scanner = NULL;
@@ -33,6 +104,21 @@ public:
 		reporter = NULL;
 		theAST = NULL;
 		drawer = NULL;
+		stats = NULL;
+		incremental = false;
+		useIR = true;
+		dumpingIR = false;
+		liftLimit = 3;
+		jobs = thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1;
+		inlineBudget = 16;
+		reduceStrength = true;
+		useCSE = true;
+		optimizeFlow = true;
+		peepholeRules = Peephole::ALL;
+		fuseInstructions = true;
+		emitting = "tam";
+		compilingModule = false;
+		compilingUnit = false;
 		}
 
 
@@ -41,6 +127,11 @@ public:
 	{
         printf("********** Triangle Compiler (C Version 2.1) **********\n");
         printf("Syntactic Analysis ...\n");
+        if (stats != NULL)
+        {
+            stats->reset();
+            stats->startPhase("Syntactic Analysis");
+        }
         SourceFile* source = new SourceFile(sourceName);
        
         if (source == NULL) 
@@ -52,23 +143,97 @@ public:
 		Compiler::scanner  = new Scanner(source);
         reporter = new ErrorReporter();
         parser   = new Parser(scanner, reporter);
-        checker  = new Checker(reporter);
+        bool rechecking = (incremental && checker != NULL);
+        if (rechecking)
+            checker->reporter = reporter;
+        else
+            checker  = new Checker(reporter);
         encoder  = new Encoder(reporter,checker);
+        encoder->maxLiftedParameters = liftLimit;
+        encoder->jobs = jobs;
 		drawer	 = new PrintVisitor(xmlName);
         
-        theAST = parser->parseProgram();				// 1st pass
+        long stdNodes = AST::nodeCount;
+        Declaration* moduleAST = NULL;
+        if (compilingModule)
+            {
+            moduleAST = parser->parseModule();				// 1st pass
+            if (moduleAST != NULL)
+                theAST = new Program(new LetCommand(moduleAST, new EmptyCommand(moduleAST->position),
+                                                    moduleAST->position), moduleAST->position);
+            }
+        else
+            theAST = parser->parseProgram();				// 1st pass
+
+        // The declarations of imported modules enclose the program, the
+        // first outermost.
+        vector<Declaration*> importedDecls;
+        for (int i = (signed) imports.size() - 1; i >= 0 && theAST != NULL; i--)
+            {
+            Parser* importParser = new Parser(new Scanner(new SourceFile(imports[i])), reporter);
+            Declaration* importAST = importParser->parseModule();
+            if (importAST == NULL)
+                break;
+            theAST->C = new LetCommand(importAST, theAST->C, importAST->position);
+            encoder->checkModuleDeclarations(importAST);
+            checker->topLevelDeclarations(importAST, importedDecls);
+            }
+        encoder->importedDeclarations.insert(importedDecls.begin(), importedDecls.end());
+        if (moduleAST != NULL)
+            {
+            vector<Declaration*> moduleDecls;
+            encoder->checkModuleDeclarations(moduleAST);
+            checker->topLevelDeclarations(moduleAST, moduleDecls);
+            checker->exported.clear();
+            for (int i = 0; i < (signed) moduleDecls.size(); i++)
+                if (checker->isRoutine(moduleDecls[i]))
+                    checker->exported.push_back(moduleDecls[i]);
+            encoder->exportedDeclarations.insert(checker->exported.begin(), checker->exported.end());
+            for (int i = 0; i < (signed) moduleDecls.size(); i++)
+                if (moduleDecls[i]->class_type() == "CONSTDECLARATION")
+                    encoder->exportedDeclarations.insert(moduleDecls[i]);
+            encoder->compilingModule = true;
+            }
+        count("tokens", scanner->tokenCount);
+        count("ast_nodes", AST::nodeCount - stdNodes);
+        if (stats != NULL)
+            stats->endPhase();
 
 		if (reporter->numErrors == 0) 
 		{        
             printf("Contextual Analysis ...\n");
-            checker->check(theAST);				// 2nd pass
+            long lookupsBefore = checker->idTable->lookups;
+            if (stats != NULL)
+                stats->startPhase("Contextual Analysis");
+            if (rechecking)
+                checker->recheck(theAST);		// 2nd pass, incremental
+            else
+                checker->check(theAST);				// 2nd pass
+            count("id_lookups", checker->idTable->lookups - lookupsBefore);
+            if (rechecking)
+                count("declarations_reused", checker->declarationsReused);
+            if (reporter->numErrors == 0)
+                count("declarations_never_used", checker->unusedDeclarations);
+            if (stats != NULL)
+                stats->endPhase();
             if (showingAST) 
 				drawer->draw(theAST);
 
             if (reporter->numErrors == 0) 
 				{
                 printf("Code Generation ...\n");
+                if (stats != NULL)
+                    stats->startPhase("Code Generation");
                 encoder->encodeRun(theAST, showingTable);	// 3rd pass
+                count("instructions", encoder->nextInstrAddr - encoder->mach->CB);
+                count("routines_pruned", encoder->routinesPruned);
+                count("words_shared", encoder->wordsShared);
+                count("routines_lifted", encoder->routinesLifted);
+                if (stats != NULL)
+                    stats->endPhase();
+
+                if (!compilingUnit)
+                    optimizeProgram();
 			    }
         }
 
@@ -76,14 +241,202 @@ public:
 
         if (successful) 
 			{
-            encoder->saveObjectProgram(objectName2);
-            printf("Compilation was successful.\n");
+            if (compilingUnit)
+                encoder->saveObjectUnit(objectName2);
+            else
+                successful = saveProgram(objectName2);
 			}
 
+        if (successful)
+            printf("Compilation was successful.\n");
 		else {
 			  printf("Compilation was unsuccessful.\n");
 			 }
 
+        if (stats != NULL)
+            stats->report();
+
+        return successful;
+	}
+
+    //Writes the object program in the form chosen by emitting; returns
+    //false, saying why, if it can't be written.
+    bool saveProgram (string objectName2)
+	{
+        if (emitting == "tam")
+            {
+            encoder->saveObjectProgram(objectName2);
+            return true;
+            }
+        if (emitting == "c")
+            {
+            printf("C Code Generation ...\n");
+            if (stats != NULL)
+                stats->startPhase("C Code Generation");
+            CEmitter* cEmitter = new CEmitter(encoder->mach);
+            string problem = cEmitter->write(objectName2, encoder->nextInstrAddr);
+            count("routines_framed", cEmitter->routinesFramed);
+            if (stats != NULL)
+                stats->endPhase();
+            if (problem != "")
+                {
+                printf("Can't translate to C: %s\n", problem.c_str());
+                return false;
+                }
+            return true;
+            }
+        printf("Native Code Generation ...\n");
+        X86Emitter* emitter = new X86Emitter(encoder->mach);
+        string asmName = (emitting == "asm") ? objectName2 : objectName2 + ".s";
+        if (!emitter->write(asmName, encoder->nextInstrAddr))
+            {
+            printf("Can't write %s\n", asmName.c_str());
+            return false;
+            }
+        if (emitting == "obj")
+            {
+            bool assembled = X86Emitter::assemble(asmName, objectName2);
+            remove(asmName.c_str());
+            if (!assembled)
+                {
+                printf("Can't assemble %s\n", objectName2.c_str());
+                return false;
+                }
+            }
+        return true;
+	}
+
+    //Records a figure for the pass under way, if statistics are kept.
+    void count (string name, long value)
+	{
+        if (stats != NULL)
+            stats->count(name, value);
+	}
+
+    //Rebuilds the object code through the IR and optimizes it.
+    void optimizeProgram ()
+	{
+        if (useIR && reporter->numErrors == 0)
+            {
+            printf("IR Construction ...\n");
+            if (stats != NULL)
+                stats->startPhase("IR");
+            IRBuilder* builder = new IRBuilder(encoder->mach);
+            IRProgram* ir = builder->build(encoder->nextInstrAddr);
+            if (ir == NULL)
+                printf("IR not built: %s\n", builder->failure.c_str());
+            else
+                {
+                if (inlineBudget > 0)
+                    {
+                    Inliner* inliner = new Inliner(encoder->mach, inlineBudget);
+                    inliner->run(ir);
+                    count("calls_inlined", inliner->callsInlined);
+                    count("routines_removed", inliner->routinesRemoved);
+                    }
+                if (reduceStrength)
+                    {
+                    StrengthReduction* reduction = new StrengthReduction(encoder->mach, encoder->exposedWords);
+                    reduction->run(ir);
+                    count("multiplications_reduced", reduction->reduced);
+                    }
+                if (useCSE)
+                    {
+                    ValueNumbering* numbering = new ValueNumbering(encoder->mach);
+                    numbering->run(ir);
+                    count("subexpressions_eliminated", numbering->eliminated);
+                    }
+                if (dumpingIR)
+                    ir->dump(stdout, encoder->mach);
+                encoder->nextInstrAddr = (new IRLowering(encoder->mach))->lower(ir);
+                }
+            count("ir_instructions", ir == NULL ? 0 : ir->numInstructions());
+            count("virtual_registers", ir == NULL ? 0 : ir->numVregs);
+            if (stats != NULL)
+                stats->endPhase();
+            }
+
+        if (optimizeFlow && reporter->numErrors == 0)
+            {
+            printf("Control Flow Optimization ...\n");
+            if (stats != NULL)
+                stats->startPhase("Control Flow Optimization");
+            FlowGraph* flow = new FlowGraph(encoder->mach);
+            encoder->nextInstrAddr = flow->optimize(encoder->nextInstrAddr);
+            count("jumps_threaded", flow->threaded);
+            count("instructions_removed", flow->removed);
+            if (stats != NULL)
+                stats->endPhase();
+            }
+
+        if (peepholeRules != 0 && reporter->numErrors == 0)
+            {
+            printf("Peephole Optimization ...\n");
+            if (stats != NULL)
+                stats->startPhase("Peephole Optimization");
+            Peephole* peephole = new Peephole(encoder->mach, peepholeRules);
+            encoder->nextInstrAddr = peephole->optimize(encoder->nextInstrAddr);
+            count("instructions_removed", peephole->removed);
+            if (stats != NULL)
+                stats->endPhase();
+            }
+
+        // Superinstructions only speed up the interpreter; native code is
+        // generated from plain TAM.
+        if (fuseInstructions && emitting == "tam" && reporter->numErrors == 0)
+            {
+            printf("Superinstruction Formation ...\n");
+            if (stats != NULL)
+                stats->startPhase("Superinstruction Formation");
+            Fusion* fusion = new Fusion(encoder->mach);
+            encoder->nextInstrAddr = fusion->optimize(encoder->nextInstrAddr);
+            count("superinstructions_formed", fusion->fused);
+            if (stats != NULL)
+                stats->endPhase();
+            }
+	}
+
+    //Links separately compiled units (tc --link) into the object program
+    //objectName2, and optimizes it as a whole.
+    bool linkProgram (vector<string> unitNames, string objectName2)
+	{
+        printf("********** Triangle Compiler (C Version 2.1) **********\n");
+        printf("Linking ...\n");
+        if (stats != NULL)
+        {
+            stats->reset();
+            stats->startPhase("Linking");
+        }
+        reporter = new ErrorReporter();
+        checker = new Checker(reporter);
+        encoder = new Encoder(reporter, checker);
+        Linker* linker = new Linker(encoder->mach, reporter);
+        for (int i = 0; i < (signed) unitNames.size(); i++)
+            linker->add(unitNames[i]);
+        int end = (reporter->numErrors == 0) ? linker->link() : -1;
+        count("units", unitNames.size());
+        count("instructions", end < 0 ? 0 : end - encoder->mach->CB);
+        if (stats != NULL)
+            stats->endPhase();
+        if (end >= 0)
+            {
+            encoder->nextInstrAddr = end;
+            encoder->exposedWords = linker->exposedWords;
+            optimizeProgram();
+            }
+
+		bool successful = (reporter->numErrors == 0);
+        if (successful)
+			{
+            successful = saveProgram(objectName2);
+			}
+        if (successful)
+            printf("Linking was successful.\n");
+		else
+            printf("Linking was unsuccessful.\n");
+
+        if (stats != NULL)
+            stats->report();
         return successful;
 	}
 
@@ -3,6 +3,7 @@
 
 #include "../import_headers.h"
 #include "IdentificationTable.h"
+#include "Trace.h"
 #include "../AST/Integer.h"
 #include "../StdEnvironment.h"
 
@@ -15,6 +16,37 @@ public:
   SourcePosition* dummyPos;
   StdEnvironment* getvariables;
   ErrorReporter* reporter;
+
+  // The last program checked (still decorated) and whether it was free
+  // of errors; recheck reuses its unchanged top-level declarations.
+  Program* lastAST;
+  bool lastCheckClean;
+  int declarationsReused;
+
+  // Declarations currently being checked, innermost last, with the
+  // identification-table level each was declared at.
+  vector<Declaration*> enclosingDecls;
+  vector<int> enclosingLevels;
+
+  // Declarations named in, and declared in, the main command.
+  vector<Declaration*> mainUses;
+  vector<Declaration*> mainLocals;
+
+  // Routines a module exports, reachable whether or not it calls them.
+  vector<Declaration*> exported;
+
+  // Numbers the checks made; a declaration is reachable in the last one
+  // iff its reachedIn equals checkNumber.
+  int checkNumber;
+
+  // Constants, variables and routines declared in reachable scopes of the
+  // last program checked but never named; the compiler reports the count.
+  int unusedDeclarations;
+
+  // The lets being checked, innermost last, each with the number of the
+  // top-level command of its body being checked, or -1 while its
+  // declarations are.
+  vector<int> letCommands;
 // Commands
 
   // Always returns NULL. Does not use the given object.
@@ -214,10 +246,41 @@ public:
 
   void check(Program* ast);
 
+  // Checks a new version of the last program checked. Top-level
+  // declarations whose text is unchanged, and whose dependencies are
+  // themselves unchanged, are taken over from the old AST with their
+  // decorations instead of being checked again.
+
+  void recheck(Program* ast);
+
+  // Records dependencies of the declarations being checked.
+  void beginDeclaration(Declaration* ast);
+  void endDeclaration();
+  void noteUse(Declaration* binding);
+
+  // Checks the body of a let command, numbering its top-level commands,
+  // and records which of them name each variable; see VarDeclaration.
+  void checkLetBody(Command* ast);
+  void noteVariableUse(VarDeclaration* ast);
+
+  string declaredName(Declaration* ast);
+  void topLevelDeclarations(Declaration* ast, vector<Declaration*>& decls);
+  Declaration* substituteDeclarations(Declaration* ast, vector<Declaration*>& from, vector<Declaration*>& to);
+  bool dependenciesUnchanged(Declaration* old, vector<Declaration*>& oldDecls, vector<Declaration*>& reused,
+                             vector<Declaration*>& newDecls, int position);
+
+  // Finds the declarations reachable from the main command. Routines are
+  // reachable only through calls; constants and variables are elaborated
+  // along with the scope declaring them, but are counted as unused if no
+  // reachable code names them.
+  void markReachable();
+  void reach(Declaration* ast, vector<Declaration*>& reached);
+  bool isRoutine(Declaration* ast);
+  bool isReachable(Declaration* ast);
+
   /////////////////////////////////////////////////////////////////////////////
 
   Checker (ErrorReporter* reporter);
-  void printdetails(Object* obj);
 };
 
 
@@ -225,7 +288,7 @@ public:
 //ErrorReporter* reporter;
 
 Object* Checker::visitAssignCommand(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	AssignCommand* ast = (AssignCommand*)obj;
     TypeDenoter* vType = (TypeDenoter*)ast->V->visit(this, NULL);
     TypeDenoter* eType = (TypeDenoter*)ast->E->visit(this, NULL);
@@ -238,7 +301,7 @@ Object* Checker::visitAssignCommand(Object* obj, Object* o) {
 
 
 Object* Checker::visitCallCommand(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	CallCommand* ast = (CallCommand*)obj;
 
     Declaration* binding = (Declaration*) ast->I->visit(this, NULL);
@@ -262,12 +325,12 @@ Object* Checker::visitCallCommand(Object* obj, Object* o) {
 
 
 Object* Checker::visitEmptyCommand(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
   return NULL;
   }
 
 Object* Checker::visitIfCommand(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	IfCommand* ast = (IfCommand*)obj;
   TypeDenoter* eType = (TypeDenoter*)ast->E->visit(this, NULL);
 
@@ -281,25 +344,39 @@ Object* Checker::visitIfCommand(Object* obj, Object* o) {
   }
 
 Object* Checker::visitLetCommand(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	LetCommand* ast = (LetCommand*)obj;
   idTable->openScope();
+  letCommands.push_back(-1);
   ast->D->visit(this, NULL);
-  ast->C->visit(this, NULL);
+  checkLetBody(ast->C);
+  letCommands.pop_back();
   idTable->closeScope();
   return NULL; 
   }
 
+void Checker::checkLetBody(Command* ast) {
+  if (ast->class_type() == "SEQUENTIALCOMMAND") {
+    Trace::visit(ast);
+    checkLetBody(((SequentialCommand*) ast)->C1);
+    checkLetBody(((SequentialCommand*) ast)->C2);
+  }
+  else {
+    letCommands.back()++;
+    ast->visit(this, NULL);
+  }
+  }
+
 Object* Checker::visitSequentialCommand(Object* obj, Object* o) {
   SequentialCommand* ast = (SequentialCommand*)obj;
-	printdetails(ast);
+	Trace::visit(ast);
 	ast->C1->visit(this, NULL);
   ast->C2->visit(this, NULL);
   return NULL;
   }
 
 Object* Checker::visitWhileCommand(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	WhileCommand* ast = (WhileCommand*)obj;
   TypeDenoter* eType = (TypeDenoter*)ast->E->visit(this, NULL);
 	if (! eType->equals(getvariables->booleanType))
@@ -309,7 +386,7 @@ Object* Checker::visitWhileCommand(Object* obj, Object* o) {
   }
 
 Object* Checker::visitRepeatCommand(Object* obj, Object* o){
-  printdetails(obj);
+  Trace::visit((AST*) obj);
   RepeatCommand* ast = (RepeatCommand*)obj;
   TypeDenoter* eType = (TypeDenoter*) ast->E->visit(this, NULL);
 
@@ -322,7 +399,7 @@ Object* Checker::visitRepeatCommand(Object* obj, Object* o){
   }
 
 Object* Checker::visitForCommand(Object* obj, Object* o){
-  printdetails(obj);
+  Trace::visit((AST*) obj);
   ForCommand* ast = (ForCommand*)obj;
 
   idTable->openScope();
@@ -342,7 +419,7 @@ Object* Checker::visitForCommand(Object* obj, Object* o){
 }
 
 Object* Checker::visitCaseCommand(Object* obj, Object* o){
-  printdetails(obj);
+  Trace::visit((AST*) obj);
   CaseCommand* ast = (CaseCommand*) obj;
 
   TypeDenoter* eType = (TypeDenoter*)ast->E->visit(this, NULL);
@@ -365,17 +442,18 @@ Object* Checker::visitCaseCommand(Object* obj, Object* o){
   // not use the given object.
 
 Object* Checker::visitArrayExpression(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	ArrayExpression* ast = (ArrayExpression*)obj;
     TypeDenoter* elemType = (TypeDenoter*) ast->AA->visit(this, NULL);
     IntegerLiteral* il = new IntegerLiteral((new Integer(ast->AA->elemCount))->tostring(),
                                            ast->position);
     ast->type = new ArrayTypeDenoter(il, elemType, ast->position);
+    Trace::typeDecision(ast, ast->type);
     return ast->type;
   }
 
 Object* Checker::visitBinaryExpression(Object* obj, Object* o) {
-  printdetails(obj);
+  Trace::visit((AST*) obj);
   BinaryExpression* ast = (BinaryExpression*)obj;
   TypeDenoter* e1Type = (TypeDenoter*) ast->E1->visit(this, NULL);
   TypeDenoter* e2Type = (TypeDenoter*) ast->E2->visit(this, NULL);
@@ -413,11 +491,13 @@ Object* Checker::visitBinaryExpression(Object* obj, Object* o) {
   else
     reporter->reportError ("\"%\" is not a binary operator",ast->O->spelling, ast->O->position);
 
+  Trace::typeDecision(ast, ast->type);
+
   return ast->type;
   }
 
 Object* Checker::visitCallExpression(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	CallExpression* ast = (CallExpression*)obj;
     Declaration* binding = (Declaration*) ast->I->visit(this, NULL);
 
@@ -438,25 +518,28 @@ Object* Checker::visitCallExpression(Object* obj, Object* o) {
 	else
       reporter->reportError("\"%\" is not a function identifier",
                            ast->I->spelling, ast->I->position);
+    Trace::typeDecision(ast, ast->type);
     return ast->type;
   }
 
 Object* Checker::visitCharacterExpression(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	CharacterExpression* ast = (CharacterExpression*)obj;
 	ast->type = getvariables->charType;
+    Trace::typeDecision(ast, ast->type);
     return ast->type;
   }
 
 Object* Checker::visitEmptyExpression(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	EmptyExpression* ast = (EmptyExpression*)obj;
     ast->type = NULL;
+    Trace::typeDecision(ast, ast->type);
     return ast->type;
   }
 
 Object* Checker::visitIfExpression(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	IfExpression* ast = (IfExpression*)obj;
     TypeDenoter* e1Type = (TypeDenoter*)ast->E1->visit(this, NULL);
 
@@ -471,36 +554,44 @@ Object* Checker::visitIfExpression(Object* obj, Object* o) {
 
     ast->type = e2Type;
 
+    Trace::typeDecision(ast, ast->type);
+
     return ast->type;
   }
 
 Object* Checker::visitIntegerExpression(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	IntegerExpression* ast = (IntegerExpression*)obj;
 	ast->type = getvariables->integerType;
+    Trace::typeDecision(ast, ast->type);
     return ast->type;
   }
 
 Object* Checker::visitLetExpression(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	LetExpression* ast = (LetExpression*)obj;
     idTable->openScope();
+    letCommands.push_back(-1);
     ast->D->visit(this, NULL);
+    letCommands.back() = 0;
     ast->type = (TypeDenoter*) ast->E->visit(this, NULL);
+    letCommands.pop_back();
     idTable->closeScope();
+    Trace::typeDecision(ast, ast->type);
     return ast->type;
   }
 
 Object* Checker::visitRecordExpression(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	RecordExpression* ast = (RecordExpression*)obj;
     FieldTypeDenoter* rType = (FieldTypeDenoter*) ast->RA->visit(this, NULL);
     ast->type = new RecordTypeDenoter(rType, ast->position);
+    Trace::typeDecision(ast, ast->type);
     return ast->type;
   }
 
 Object* Checker::visitUnaryExpression(Object* obj, Object* o) {
-  printdetails(obj);
+  Trace::visit((AST*) obj);
   UnaryExpression* ast = (UnaryExpression*)obj;
   TypeDenoter* eType = (TypeDenoter*) ast->E->visit(this, NULL);
   Declaration* binding = (Declaration*) ast->O->visit(this, NULL);
@@ -532,13 +623,16 @@ Object* Checker::visitUnaryExpression(Object* obj, Object* o) {
     reporter->reportError ("\"%\" is not a unary operator",ast->O->spelling, ast->O->position);
   }
 
+  Trace::typeDecision(ast, ast->type);
+
   return ast->type;
   }
 
 Object* Checker::visitVnameExpression(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	VnameExpression* ast = (VnameExpression*)obj;
     ast->type = (TypeDenoter*) ast->V->visit(this, NULL);
+    Trace::typeDecision(ast, ast->type);
     return ast->type;
   }
 
@@ -546,26 +640,30 @@ Object* Checker::visitVnameExpression(Object* obj, Object* o) {
 
   // Always returns NULL. Does not use the given object.
 Object* Checker::visitBinaryOperatorDeclaration(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	BinaryOperatorDeclaration* ast = (BinaryOperatorDeclaration*)obj;
     return NULL;
   }
 
 Object* Checker::visitConstDeclaration(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	ConstDeclaration* ast = (ConstDeclaration*)obj;
+    beginDeclaration(ast);
     TypeDenoter* eType = (TypeDenoter*) ast->E->visit(this, NULL);
     idTable->enter(ast->I->spelling, ast);
 
     if (ast->duplicated)
       reporter->reportError ("identifier \"%\" already declared",ast->I->spelling, ast->position);
 
+    endDeclaration();
     return NULL;
   }
 
 Object* Checker::visitFuncDeclaration(Object* obj, Object* o) {
-	  printdetails(obj);
+	  Trace::visit((AST*) obj);
 	  FuncDeclaration* ast = (FuncDeclaration*)obj;
+    beginDeclaration(ast);
+    ast->passed = false;
     ast->T = (TypeDenoter*) ast->T->visit(this, NULL);
     idTable->enter (ast->I->spelling, ast); // permits recursion
 
@@ -578,12 +676,15 @@ Object* Checker::visitFuncDeclaration(Object* obj, Object* o) {
     idTable->closeScope();
     if (! ast->T->equals(eType))
       reporter->reportError ("body of function \"%\" has wrong type", ast->I->spelling, ast->E->position);
+    endDeclaration();
     return NULL;
   }
 
 Object* Checker::visitProcDeclaration(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	ProcDeclaration* ast = (ProcDeclaration*)obj;
+    beginDeclaration(ast);
+    ast->passed = false;
     idTable->enter (ast->I->spelling, ast); // permits recursion
 
     if (ast->duplicated)
@@ -594,11 +695,12 @@ Object* Checker::visitProcDeclaration(Object* obj, Object* o) {
     ast->C->visit(this, NULL);
     idTable->closeScope();
 
+    endDeclaration();
     return NULL;
   }
 
 Object* Checker::visitSequentialDeclaration(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	SequentialDeclaration* ast= (SequentialDeclaration*)obj;
     ast->D1->visit(this, NULL);
     ast->D2->visit(this, NULL);
@@ -606,38 +708,47 @@ Object* Checker::visitSequentialDeclaration(Object* obj, Object* o) {
   }
 
 Object* Checker::visitTypeDeclaration(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	TypeDeclaration* ast = (TypeDeclaration*)obj;
+    beginDeclaration(ast);
     ast->T = (TypeDenoter*) ast->T->visit(this, NULL);
     idTable->enter (ast->I->spelling, ast);
 
 	if (ast->duplicated)
       reporter->reportError ("identifier \"%\" already declared",ast->I->spelling, ast->position);
+    endDeclaration();
     return NULL;
   }
 
 Object* Checker::visitUnaryOperatorDeclaration(Object* obj, Object* o) {
-	  printdetails(obj);
+	  Trace::visit((AST*) obj);
 	  UnaryOperatorDeclaration* ast = (UnaryOperatorDeclaration*)obj;
     return NULL;
   }
 
 Object* Checker::visitVarDeclaration(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	VarDeclaration* ast = (VarDeclaration*)obj;
+    beginDeclaration(ast);
     ast->T = (TypeDenoter*) ast->T->visit(this, NULL);
     idTable->enter (ast->I->spelling, ast);
+    ast->letDepth = letCommands.size() - 1;
+    ast->firstUse = 0;
+    ast->lastUse = -1;
+    ast->pinned = letCommands.empty();
 
     if (ast->duplicated)
 		reporter->reportError ("identifier \"%\" already declared",ast->I->spelling, ast->position);
 
+    endDeclaration();
     return NULL;
   }
 
 Object* Checker::visitInitVarDeclaration(Object* obj, Object* o){
-  printdetails(obj);
+  Trace::visit((AST*) obj);
 
   InitVarDeclaration* ast = (InitVarDeclaration*) obj;
+  beginDeclaration(ast);
 
   ast->T = (TypeDenoter*) ast->E->visit(this, NULL);
 
@@ -646,12 +757,14 @@ Object* Checker::visitInitVarDeclaration(Object* obj, Object* o){
   if (ast->duplicated)
     reporter->reportError ("identifier \"%\" already declared",ast->I->spelling, ast->position);
 
+  endDeclaration();
   return NULL;
 }
 
 Object* Checker::visitUserUnaryOperatorDeclaration(Object* obj, Object* o){
-  printdetails(obj);
+  Trace::visit((AST*) obj);
   UserUnaryOperatorDeclaration* ast = (UserUnaryOperatorDeclaration*)obj;
+  beginDeclaration(ast);
   // cout << "hello\n";
   ast->T = (TypeDenoter*) ast->T->visit(this, NULL);
   idTable->enter(ast->O->spelling, ast);
@@ -665,12 +778,14 @@ Object* Checker::visitUserUnaryOperatorDeclaration(Object* obj, Object* o){
   idTable->closeScope();
   if (! ast->T->equals(eType))
     reporter->reportError ("body of operator \"%\" has wrong type", ast->O->spelling, ast->E->position);
+  endDeclaration();
   return NULL;
 }
 
 Object* Checker::visitUserBinaryOperatorDeclaration(Object* obj, Object* o){
-  printdetails(obj);
+  Trace::visit((AST*) obj);
   UserBinaryOperatorDeclaration* ast = (UserBinaryOperatorDeclaration*)obj;
+  beginDeclaration(ast);
   // cout << "hello\n";
   ast->T = (TypeDenoter*) ast->T->visit(this, NULL);
   idTable->enter(ast->O->spelling, ast);
@@ -684,6 +799,7 @@ Object* Checker::visitUserBinaryOperatorDeclaration(Object* obj, Object* o){
   idTable->closeScope();
   if (! ast->T->equals(eType))
     reporter->reportError ("body of operator \"%\" has wrong type", ast->O->spelling, ast->E->position);
+  endDeclaration();
   return NULL;
 }
 
@@ -693,7 +809,7 @@ Object* Checker::visitUserBinaryOperatorDeclaration(Object* obj, Object* o){
   // given object.
 
 Object* Checker::visitMultipleArrayAggregate(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	MultipleArrayAggregate* ast = (MultipleArrayAggregate*)obj;
     TypeDenoter* eType = (TypeDenoter*) ast->E->visit(this, NULL);
     TypeDenoter* elemType = (TypeDenoter*) ast->AA->visit(this, NULL);
@@ -706,7 +822,7 @@ Object* Checker::visitMultipleArrayAggregate(Object* obj, Object* o) {
   }
 
 Object* Checker::visitSingleArrayAggregate(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	SingleArrayAggregate* ast = (SingleArrayAggregate*)obj;
     TypeDenoter* elemType = (TypeDenoter*) ast->E->visit(this, NULL);
     ast->elemCount = 1;
@@ -719,7 +835,7 @@ Object* Checker::visitSingleArrayAggregate(Object* obj, Object* o) {
   // given object.
 
 Object* Checker::visitMultipleRecordAggregate(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	MultipleRecordAggregate* ast = (MultipleRecordAggregate*)obj;
     TypeDenoter* eType = (TypeDenoter*) ast->E->visit(this, NULL);
     FieldTypeDenoter* rType = (FieldTypeDenoter*) ast->RA->visit(this, NULL);
@@ -730,14 +846,17 @@ Object* Checker::visitMultipleRecordAggregate(Object* obj, Object* o) {
 
     ast->type = new MultipleFieldTypeDenoter(ast->I, eType, rType, ast->position);
 
+    Trace::typeDecision(ast, ast->type);
+
     return ast->type;
   }
 
 Object* Checker::visitSingleRecordAggregate(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	SingleRecordAggregate* ast = (SingleRecordAggregate*)obj;
     TypeDenoter* eType = (TypeDenoter*) ast->E->visit(this, NULL);
     ast->type = new SingleFieldTypeDenoter(ast->I, eType, ast->position);
+    Trace::typeDecision(ast, ast->type);
     return ast->type;
   }
 
@@ -746,7 +865,7 @@ Object* Checker::visitSingleRecordAggregate(Object* obj, Object* o) {
   // Always returns NULL. Does not use the given object.
 
 Object* Checker::visitConstFormalParameter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	ConstFormalParameter* ast = (ConstFormalParameter*)obj;
     ast->T = (TypeDenoter*) ast->T->visit(this, NULL);
     idTable->enter(ast->I->spelling, ast);
@@ -758,7 +877,7 @@ Object* Checker::visitConstFormalParameter(Object* obj, Object* o) {
   }
 
 Object* Checker::visitFuncFormalParameter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
     FuncFormalParameter* ast = (FuncFormalParameter*)obj;
     idTable->openScope();
     ast->FPS->visit(this, NULL);
@@ -772,7 +891,7 @@ Object* Checker::visitFuncFormalParameter(Object* obj, Object* o) {
   }
 
 Object* Checker::visitProcFormalParameter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	ProcFormalParameter* ast = (ProcFormalParameter*)obj;
     idTable->openScope();
     ast->FPS->visit(this, NULL);
@@ -785,7 +904,7 @@ Object* Checker::visitProcFormalParameter(Object* obj, Object* o) {
   }
 
 Object* Checker::visitVarFormalParameter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	VarFormalParameter* ast = (VarFormalParameter*)obj;
   ast->T = (TypeDenoter*) ast->T->visit(this, NULL);
   idTable->enter (ast->I->spelling, ast);
@@ -797,7 +916,7 @@ Object* Checker::visitVarFormalParameter(Object* obj, Object* o) {
   }
 
 Object* Checker::visitResultFormalParameter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	ResultFormalParameter* ast = (ResultFormalParameter*)obj;
   ast->T = (TypeDenoter*) ast->T->visit(this, NULL);
   idTable->enter (ast->I->spelling, ast);
@@ -809,7 +928,7 @@ Object* Checker::visitResultFormalParameter(Object* obj, Object* o) {
   }
 
 Object* Checker::visitValueResultFormalParameter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	ValueResultFormalParameter* ast = (ValueResultFormalParameter*)obj;
   ast->T = (TypeDenoter*) ast->T->visit(this, NULL);
   idTable->enter (ast->I->spelling, ast);
@@ -821,14 +940,14 @@ Object* Checker::visitValueResultFormalParameter(Object* obj, Object* o) {
   }
 
 Object* Checker::visitEmptyFormalParameterSequence(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	EmptyFormalParameterSequence* ast = (EmptyFormalParameterSequence*)obj;
 
     return NULL;
   }
 
 Object* Checker::visitMultipleFormalParameterSequence(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	MultipleFormalParameterSequence* ast = (MultipleFormalParameterSequence*)obj;
     ast->FP->visit(this, NULL);
     ast->FPS->visit(this, NULL);
@@ -836,7 +955,7 @@ Object* Checker::visitMultipleFormalParameterSequence(Object* obj, Object* o) {
   }
 
 Object* Checker::visitSingleFormalParameterSequence(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	SingleFormalParameterSequence* ast = (SingleFormalParameterSequence*)obj;
     ast->FP->visit(this, NULL);
     return NULL;
@@ -847,7 +966,7 @@ Object* Checker::visitSingleFormalParameterSequence(Object* obj, Object* o) {
   // Always returns NULL. Uses the given FormalParameter.
 
 Object* Checker::visitConstActualParameter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	ConstActualParameter* ast = (ConstActualParameter*)obj;
     FormalParameter* fp = (FormalParameter*) o;
     TypeDenoter* eType = (TypeDenoter*) ast->E->visit(this, NULL);
@@ -863,7 +982,7 @@ Object* Checker::visitConstActualParameter(Object* obj, Object* o) {
 
 
 Object* Checker::visitFuncActualParameter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	FuncActualParameter* ast = (FuncActualParameter*)obj;
     FormalParameter* fp = (FormalParameter*) o;
 
@@ -884,6 +1003,7 @@ Object* Checker::visitFuncActualParameter(Object* obj, Object* o) {
 		if (binding->class_type() ==  "FUNCDECLARATION") {
 			FPS = ((FuncDeclaration*) binding)->FPS;
 			T = ((FuncDeclaration*) binding)->T;
+			binding->passed = true;
 			}
 
 		else {
@@ -903,7 +1023,7 @@ Object* Checker::visitFuncActualParameter(Object* obj, Object* o) {
   }
 
 Object* Checker::visitProcActualParameter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	ProcActualParameter* ast = (ProcActualParameter*)obj;
     FormalParameter* fp = (FormalParameter*) o;
 
@@ -920,8 +1040,10 @@ Object* Checker::visitProcActualParameter(Object* obj, Object* o) {
     else {
       FormalParameterSequence* FPS = NULL;
 
-      if (binding->class_type() == "PROCDECLARATION")
+      if (binding->class_type() == "PROCDECLARATION") {
 			FPS = ((ProcDeclaration*) binding)->FPS;
+			binding->passed = true;
+      }
       else
 			FPS = ((ProcFormalParameter*) binding)->FPS;
 
@@ -934,7 +1056,7 @@ Object* Checker::visitProcActualParameter(Object* obj, Object* o) {
   }
 
 Object* Checker::visitVarActualParameter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	VarActualParameter* ast = (VarActualParameter*)obj;
     FormalParameter* fp = (FormalParameter*) o;
 
@@ -953,7 +1075,7 @@ Object* Checker::visitVarActualParameter(Object* obj, Object* o) {
   }
 
 Object* Checker::visitResultActualParameter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	ResultActualParameter* ast = (ResultActualParameter*)obj;
     FormalParameter* fp = (FormalParameter*) o;
 
@@ -972,7 +1094,7 @@ Object* Checker::visitResultActualParameter(Object* obj, Object* o) {
   }
 
 Object* Checker::visitValueResultActualParameter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	ValueResultActualParameter* ast = (ValueResultActualParameter*)obj;
   FormalParameter* fp = (FormalParameter*) o;
 
@@ -992,7 +1114,7 @@ Object* Checker::visitValueResultActualParameter(Object* obj, Object* o) {
 
 
 Object* Checker::visitEmptyActualParameterSequence(Object* obj, Object* o) {
-printdetails(obj);
+Trace::visit((AST*) obj);
 	EmptyActualParameterSequence* ast = (EmptyActualParameterSequence*)obj;
     FormalParameterSequence* fps = (FormalParameterSequence*) o;
 
@@ -1002,7 +1124,7 @@ printdetails(obj);
   }
 
 Object* Checker::visitMultipleActualParameterSequence(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	MultipleActualParameterSequence* ast = (MultipleActualParameterSequence*)obj;
     FormalParameterSequence* fps = (FormalParameterSequence*) o;
 
@@ -1016,7 +1138,7 @@ Object* Checker::visitMultipleActualParameterSequence(Object* obj, Object* o) {
   }
 
 Object* Checker::visitSingleActualParameterSequence(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	SingleActualParameterSequence* ast = (SingleActualParameterSequence*)obj;
     FormalParameterSequence* fps = (FormalParameterSequence*) o;
 
@@ -1035,13 +1157,13 @@ Object* Checker::visitSingleActualParameterSequence(Object* obj, Object* o) {
   // use the given object.
 
 Object* Checker::visitAnyTypeDenoter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	AnyTypeDenoter* ast = (AnyTypeDenoter*)obj;
 	return getvariables->anyType;
   }
 
 Object* Checker::visitArrayTypeDenoter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	ArrayTypeDenoter* ast = (ArrayTypeDenoter*)obj;
     ast->T = (TypeDenoter*) ast->T->visit(this, NULL);
     if ( atoi(ast->IL->spelling.c_str())== 0)
@@ -1050,25 +1172,25 @@ Object* Checker::visitArrayTypeDenoter(Object* obj, Object* o) {
   }
 
 Object* Checker::visitBoolTypeDenoter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	BoolTypeDenoter* ast = (BoolTypeDenoter*)obj;
 	return getvariables->booleanType;
   }
 
 Object* Checker::visitCharTypeDenoter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	CharTypeDenoter* ast = (CharTypeDenoter*)obj;
 	return getvariables->charType;
   }
 
 Object* Checker::visitErrorTypeDenoter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	ErrorTypeDenoter* ast = (ErrorTypeDenoter*)obj;
 	return getvariables->errorType;
   }
 
 Object* Checker::visitSimpleTypeDenoter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	  SimpleTypeDenoter* ast = (SimpleTypeDenoter*)obj;
 
     Declaration* binding = (Declaration*) ast->I->visit(this, NULL);
@@ -1087,20 +1209,20 @@ Object* Checker::visitSimpleTypeDenoter(Object* obj, Object* o) {
   }
 
 Object* Checker::visitIntTypeDenoter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	IntTypeDenoter* ast = (IntTypeDenoter*)obj;
 	return getvariables->integerType;
   }
 
 Object* Checker::visitRecordTypeDenoter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	RecordTypeDenoter* ast = (RecordTypeDenoter*)obj;
     ast->FT = (FieldTypeDenoter*) ast->FT->visit(this, NULL);
     return ast;
   }
 
 Object* Checker::visitMultipleFieldTypeDenoter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	MultipleFieldTypeDenoter* ast = (MultipleFieldTypeDenoter*)obj;
     ast->T = (TypeDenoter*) ast->T->visit(this, NULL);
     ast->FT->visit(this, NULL);
@@ -1108,7 +1230,7 @@ Object* Checker::visitMultipleFieldTypeDenoter(Object* obj, Object* o) {
   }
 
 Object* Checker::visitSingleFieldTypeDenoter(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	SingleFieldTypeDenoter* ast = (SingleFieldTypeDenoter*)obj;
     ast->T = (TypeDenoter*) ast->T->visit(this, NULL);
     return ast;
@@ -1116,32 +1238,36 @@ Object* Checker::visitSingleFieldTypeDenoter(Object* obj, Object* o) {
 
   // Literals, Identifiers and Operators
 Object* Checker::visitCharacterLiteral(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	CharacterLiteral* CL = (CharacterLiteral*)obj;
 	return getvariables->charType;
   }
 
 Object* Checker::visitIdentifier(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	Identifier* I = (Identifier*)obj;
     Declaration* binding = idTable->retrieve(I->spelling);
-    if (binding != NULL)
+    if (binding != NULL) {
       I->decl = binding;
+      noteUse(binding);
+    }
     return binding;
   }
 
 Object* Checker::visitIntegerLiteral(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	IntegerLiteral* IL = (IntegerLiteral*)obj;
 	return getvariables->integerType;
   }
 
 Object* Checker::visitOperator(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	Operator* O = (Operator*)obj;
     Declaration* binding = idTable->retrieve(O->spelling);
-    if (binding != NULL)
+    if (binding != NULL) {
       O->decl = binding;
+      noteUse(binding);
+    }
     return binding;
   }
 
@@ -1167,7 +1293,7 @@ Object* Checker::visitOperator(Object* obj, Object* o) {
   // given object.
 
 Object* Checker::visitDotVname(Object* obj, Object* o) {
-    printdetails(obj);
+    Trace::visit((AST*) obj);
     DotVname* ast = (DotVname*)obj;
     ast->type = NULL;
     TypeDenoter* vType = (TypeDenoter*) ast->V->visit(this, NULL);
@@ -1180,11 +1306,12 @@ Object* Checker::visitDotVname(Object* obj, Object* o) {
         reporter->reportError ("no field \"%\" in this record type",
                               ast->I->spelling, ast->I->position);
     }
+    Trace::typeDecision(ast, ast->type);
     return ast->type;
   }
 
 Object* Checker::visitSimpleVname(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	SimpleVname* ast = (SimpleVname*)obj;
     ast->variable = false;
 	ast->type = getvariables->errorType;
@@ -1199,6 +1326,7 @@ Object* Checker::visitSimpleVname(Object* obj, Object* o) {
 	  else if (binding->class_type() =="VARDECLARATION") {
         ast->type = ((VarDeclaration*) binding)->T;
         ast->variable = true;
+        noteVariableUse((VarDeclaration*) binding);
       }
     else if (binding->class_type() == "INITVARDECLARATION") {
         ast->type = ((InitVarDeclaration*) binding)->T;
@@ -1214,11 +1342,12 @@ Object* Checker::visitSimpleVname(Object* obj, Object* o) {
       } 
 	  else
         reporter->reportError ("\"%\" is not a const or var identifier",ast->I->spelling, ast->I->position);
+    Trace::typeDecision(ast, ast->type);
     return ast->type;
   }
 
 Object* Checker::visitSubscriptVname(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	SubscriptVname* ast = (SubscriptVname*)obj;
     TypeDenoter* vType = (TypeDenoter*) ast->V->visit(this, NULL);
     ast->variable = ast->V->variable;
@@ -1232,13 +1361,14 @@ Object* Checker::visitSubscriptVname(Object* obj, Object* o) {
 		  ast->type = ((ArrayTypeDenoter*) vType)->T;
       }
     }
+    Trace::typeDecision(ast, ast->type);
     return ast->type;
   }
 
   // Programs
 
 Object* Checker::visitProgram(Object* obj, Object* o) {
-	printdetails(obj);
+	Trace::visit((AST*) obj);
 	Program* ast = (Program*)obj;
     ast->C->visit(this, NULL);
     return NULL;
@@ -1254,13 +1384,266 @@ Object* Checker::visitProgram(Object* obj, Object* o) {
   // Types are represented by small ASTs.
 
 void Checker::check(Program* ast) {
+    int errorsBefore = reporter->numErrors;
+    declarationsReused = 0;
+    mainUses.clear();
+    mainLocals.clear();
+    letCommands.clear();
     ast->visit(this, NULL);
+    markReachable();
+    lastAST = ast;
+    lastCheckClean = (reporter->numErrors == errorsBefore);
+  }
+
+void Checker::recheck(Program* ast) {
+    if (lastAST == NULL || !lastCheckClean ||
+        lastAST->C->class_type() != "LETCOMMAND" || ast->C->class_type() != "LETCOMMAND") {
+      check(ast);
+      return;
+    }
+
+    int errorsBefore = reporter->numErrors;
+    LetCommand* oldLet = (LetCommand*) lastAST->C;
+    LetCommand* newLet = (LetCommand*) ast->C;
+    vector<Declaration*> oldDecls;
+    vector<Declaration*> parsedDecls;
+    vector<Declaration*> reused;
+
+    topLevelDeclarations(oldLet->D, oldDecls);
+    topLevelDeclarations(newLet->D, parsedDecls);
+    vector<Declaration*> newDecls = parsedDecls;
+
+    for (int i = 0; i < (signed) newDecls.size(); i++) {
+      Declaration* decl = newDecls[i];
+      for (int j = 0; j < (signed) oldDecls.size(); j++) {
+        Declaration* old = oldDecls[j];
+        if (old->textHash == decl->textHash && old->class_type() == decl->class_type() &&
+            declaredName(old) == declaredName(decl) &&
+            find(reused.begin(), reused.end(), old) == reused.end() &&
+            dependenciesUnchanged(old, oldDecls, reused, newDecls, i)) {
+          newDecls[i] = old;
+          reused.push_back(old);
+          break;
+        }
+      }
+    }
+    newLet->D = substituteDeclarations(newLet->D, parsedDecls, newDecls);
+    declarationsReused = reused.size();
+    mainUses.clear();
+    mainLocals.clear();
+
+    // Equivalent to visiting the let command, except that reused
+    // declarations are only re-entered in the identification table.
+    idTable->openScope();
+    letCommands.clear();
+    letCommands.push_back(-1);
+    for (int i = 0; i < (signed) newDecls.size(); i++) {
+      Declaration* decl = newDecls[i];
+      if (find(reused.begin(), reused.end(), decl) == reused.end())
+        decl->visit(this, NULL);
+      else {
+        idTable->enter(declaredName(decl), decl);
+        mainLocals.push_back(decl);
+        if (decl->duplicated)
+          reporter->reportError ("identifier \"%\" already declared", declaredName(decl), decl->position);
+
+        // The variables it names are not seen again, so are pinned.
+        if (decl->class_type() == "VARDECLARATION") {
+          VarDeclaration* var = (VarDeclaration*) decl;
+          var->firstUse = 0;
+          var->lastUse = -1;
+          var->pinned = false;
+        }
+        for (int k = 0; k < (signed) decl->dependencies.size(); k++)
+          if (decl->dependencies[k]->class_type() == "VARDECLARATION")
+            ((VarDeclaration*) decl->dependencies[k])->pinned = true;
+      }
+    }
+    checkLetBody(newLet->C);
+    letCommands.pop_back();
+    idTable->closeScope();
+    markReachable();
+
+    lastAST = ast;
+    lastCheckClean = (reporter->numErrors == errorsBefore);
+  }
+
+  // A reused declaration must see exactly the declarations it saw before:
+  // every top-level declaration it refers to must itself have been reused,
+  // and no new top-level declaration before it may hide a standard one.
+
+bool Checker::dependenciesUnchanged(Declaration* old, vector<Declaration*>& oldDecls,
+                                    vector<Declaration*>& reused, vector<Declaration*>& newDecls, int position) {
+    for (int k = 0; k < (signed) old->dependencies.size(); k++) {
+      Declaration* dep = old->dependencies[k];
+      if (find(oldDecls.begin(), oldDecls.end(), dep) != oldDecls.end()) {
+        if (find(reused.begin(), reused.end(), dep) == reused.end())
+          return false;
+      }
+      else {
+        for (int i = 0; i < position; i++)
+          if (declaredName(newDecls[i]) == declaredName(dep))
+            return false;
+      }
+    }
+    return true;
+  }
+
+void Checker::beginDeclaration(Declaration* ast) {
+    ast->dependencies.clear();
+    ast->uses.clear();
+    ast->locals.clear();
+    if (enclosingDecls.empty())
+      mainLocals.push_back(ast);
+    else
+      enclosingDecls.back()->locals.push_back(ast);
+    enclosingDecls.push_back(ast);
+    enclosingLevels.push_back(idTable->currentLevel());
+  }
+
+void Checker::endDeclaration() {
+    enclosingDecls.pop_back();
+    enclosingLevels.pop_back();
+  }
+
+  // A binding found at the level of an enclosing declaration, or further
+  // out, is declared outside that declaration and so is a dependency of it.
+
+void Checker::noteUse(Declaration* binding) {
+    for (int k = 0; k < (signed) enclosingDecls.size(); k++) {
+      Declaration* decl = enclosingDecls[k];
+      if (binding != decl && idTable->retrievedLevel <= enclosingLevels[k] &&
+          find(decl->dependencies.begin(), decl->dependencies.end(), binding) == decl->dependencies.end())
+        decl->dependencies.push_back(binding);
+    }
+
+    vector<Declaration*>& uses = enclosingDecls.empty() ? mainUses : enclosingDecls.back()->uses;
+    if (find(uses.begin(), uses.end(), binding) == uses.end())
+      uses.push_back(binding);
+  }
+
+void Checker::markReachable() {
+    vector<Declaration*> reached;
+    checkNumber++;
+    for (int i = 0; i < (signed) mainUses.size(); i++) {
+      mainUses[i]->usedIn = checkNumber;
+      reach(mainUses[i], reached);
+    }
+    for (int i = 0; i < (signed) exported.size(); i++) {
+      exported[i]->usedIn = checkNumber;
+      reach(exported[i], reached);
+    }
+    for (int i = 0; i < (signed) mainLocals.size(); i++)
+      if (!isRoutine(mainLocals[i]))
+        reach(mainLocals[i], reached);
+
+    // Count what is declared in reachable scopes but never named.
+    unusedDeclarations = 0;
+    for (int i = 0; i < (signed) mainLocals.size(); i++)
+      if (mainLocals[i]->usedIn != checkNumber && mainLocals[i]->class_type() != "TYPEDECLARATION")
+        unusedDeclarations++;
+    for (int k = 0; k < (signed) reached.size(); k++) {
+      vector<Declaration*>& locals = reached[k]->locals;
+      for (int i = 0; i < (signed) locals.size(); i++)
+        if (locals[i]->usedIn != checkNumber && locals[i]->class_type() != "TYPEDECLARATION")
+          unusedDeclarations++;
+    }
+  }
+
+void Checker::reach(Declaration* ast, vector<Declaration*>& reached) {
+    if (ast->reachedIn == checkNumber)
+      return;
+    ast->reachedIn = checkNumber;
+    reached.push_back(ast);
+    for (int i = 0; i < (signed) ast->uses.size(); i++) {
+      ast->uses[i]->usedIn = checkNumber;
+      reach(ast->uses[i], reached);
+    }
+    for (int i = 0; i < (signed) ast->locals.size(); i++)
+      if (!isRoutine(ast->locals[i]))
+        reach(ast->locals[i], reached);
+  }
+
+void Checker::noteVariableUse(VarDeclaration* ast) {
+    int command = -1;
+    if (ast->letDepth >= 0 && ast->letDepth < (signed) letCommands.size())
+      command = letCommands[ast->letDepth];
+    if (command < 0)
+      ast->pinned = true;
+    else if (ast->firstUse > ast->lastUse)
+      ast->firstUse = ast->lastUse = command;
+    else
+      ast->lastUse = command;
+  }
+
+bool Checker::isRoutine(Declaration* ast) {
+    string kind = ast->class_type();
+    return kind == "PROCDECLARATION" || kind == "FUNCDECLARATION" ||
+           kind == "USERUNARYOPERATORDECLARATION" || kind == "USERBINARYOPERATORDECLARATION";
+  }
+
+bool Checker::isReachable(Declaration* ast) {
+    return ast->reachedIn == checkNumber;
+  }
+
+string Checker::declaredName(Declaration* ast) {
+    string kind = ast->class_type();
+    if (kind == "CONSTDECLARATION")
+      return ((ConstDeclaration*) ast)->I->spelling;
+    else if (kind == "VARDECLARATION")
+      return ((VarDeclaration*) ast)->I->spelling;
+    else if (kind == "INITVARDECLARATION")
+      return ((InitVarDeclaration*) ast)->I->spelling;
+    else if (kind == "PROCDECLARATION")
+      return ((ProcDeclaration*) ast)->I->spelling;
+    else if (kind == "FUNCDECLARATION")
+      return ((FuncDeclaration*) ast)->I->spelling;
+    else if (kind == "TYPEDECLARATION")
+      return ((TypeDeclaration*) ast)->I->spelling;
+    else if (kind == "USERUNARYOPERATORDECLARATION")
+      return ((UserUnaryOperatorDeclaration*) ast)->O->spelling;
+    else if (kind == "USERBINARYOPERATORDECLARATION")
+      return ((UserBinaryOperatorDeclaration*) ast)->O->spelling;
+    else if (kind == "UNARYOPERATORDECLARATION")
+      return ((UnaryOperatorDeclaration*) ast)->O->spelling;
+    else if (kind == "BINARYOPERATORDECLARATION")
+      return ((BinaryOperatorDeclaration*) ast)->O->spelling;
+    return "";
+  }
+
+  // Lists the single declarations of a declaration sequence, in order.
+
+void Checker::topLevelDeclarations(Declaration* ast, vector<Declaration*>& decls) {
+    if (ast->class_type() == "SEQUENTIALDECLARATION") {
+      topLevelDeclarations(((SequentialDeclaration*) ast)->D1, decls);
+      topLevelDeclarations(((SequentialDeclaration*) ast)->D2, decls);
+    }
+    else
+      decls.push_back(ast);
+  }
+
+Declaration* Checker::substituteDeclarations(Declaration* ast, vector<Declaration*>& from, vector<Declaration*>& to) {
+    if (ast->class_type() == "SEQUENTIALDECLARATION") {
+      SequentialDeclaration* seq = (SequentialDeclaration*) ast;
+      seq->D1 = substituteDeclarations(seq->D1, from, to);
+      seq->D2 = substituteDeclarations(seq->D2, from, to);
+      return seq;
+    }
+    for (int i = 0; i < (signed) from.size(); i++)
+      if (from[i] == ast)
+        return to[i];
+    return ast;
   }
 
   /////////////////////////////////////////////////////////////////////////////
 
 Checker::Checker(ErrorReporter* reporter) {
     this->reporter = reporter;
+    this->lastAST = NULL;
+    this->lastCheckClean = false;
+    this->declarationsReused = 0;
+    this->checkNumber = 0;
+    this->unusedDeclarations = 0;
     this->idTable = new IdentificationTable ();
 	this->dummyPos = new SourcePosition();
 	this->dummyI = new Identifier("",dummyPos);
@@ -1388,9 +1771,6 @@ BinaryOperatorDeclaration* Checker::declareStdBinaryOp(string op, TypeDenoter* a
   // Enters these "declarations" in the identification table.
 
   //private final  Identifier dummyI = new Identifier("", dummyPos);
-void Checker::printdetails(Object* obj){
-//	printf("%s\n",obj->class_type().c_str());
-}
 
 
 void Checker::establishStdEnvironment () {
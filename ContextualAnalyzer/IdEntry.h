@@ -21,21 +21,6 @@ public:
     this->previous = previous;
 	}
 
-  void print(){
-    // if(attr->class_type().compare("INITVARDECLARATION") == 0){
-    //   InitVarDeclaration* temp = (InitVarDeclaration*)attr;
-    //   cout << "id: \'" << id << "\'" << endl;
-    //   cout << "declaration id: " << temp->I->spelling << " type: " << temp->T->class_type() << endl;
-    //   cout << level << endl;
-    // }
-    // if(attr->class_type().compare("VARDECLARATION") == 0){
-    //   VarDeclaration* temp = (VarDeclaration*)attr;
-    //   cout << "var id: \'" << id << "\'" << endl;
-    //   cout << "declaration id: " << temp->I->spelling << " type: " << temp->T->class_type() << endl;
-    //   cout << level << endl;
-    // }
-  }
-
 };
 
 #endif
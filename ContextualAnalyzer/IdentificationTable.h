@@ -1,6 +1,7 @@
 #ifndef _IDENTIFICATION_TABLE
 #define _IDENTIFICATION_TABLE
 #include "IdEntry.h"
+#include "Trace.h"
 #include "../AST/Declaration.h"
 #include <string>
 
@@ -12,17 +13,26 @@ class IdentificationTable {
   IdEntry* latest;
 
 public:
-		
+  int lookups; // number of calls to retrieve
+  int retrievedLevel; // level of the entry found by the last retrieve
+
 IdentificationTable () {
     level = 0;
     latest = NULL;
+    lookups = 0;
+    retrievedLevel = -1;
 	 }
 
   // Opens a new level in the identification table, 1 higher than the
   // current topmost level.
 
+int currentLevel () {
+    return level;
+  }
+
 void openScope () {
     level ++;
+    Trace::openScope(level);
 	}
 
   // Closes the topmost level in the identification table, discarding
@@ -42,6 +52,7 @@ void closeScope () {
 		entry = local->previous;
 		}
 
+    Trace::closeScope(this->level);
     this->level--;
     this->latest = entry;
   }
@@ -75,7 +86,7 @@ void enter (string id, Declaration* attr) {
 
     entry = new IdEntry(id, attr, this->level, this->latest);
     this->latest = entry;
-    entry->print();
+    Trace::enter(id, this->level, present);
 
 
   }
@@ -93,10 +104,11 @@ void enter (string id, Declaration* attr) {
     bool present = false;
 	  bool searching = true;
 
+    lookups++;
+    retrievedLevel = -1;
     entry = this->latest;
     // cout << endl<< "search id: \'" << id << "\'"<<endl<<endl;
     while (searching) {
-      entry->print();
       // cout << "test: "<< (id == "x") << endl;
       if (entry == NULL)
         searching = false;
@@ -105,11 +117,13 @@ void enter (string id, Declaration* attr) {
         present = true;
         searching = false;
         attr = entry->attr;
+        retrievedLevel = entry->level;
         }
       else
         entry = entry->previous;
 		}
 
+    Trace::lookup(id, attr);
     return attr;
   }
 
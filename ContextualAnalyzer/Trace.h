@@ -0,0 +1,71 @@
+#ifndef _TRACE
+#define _TRACE
+
+#include <stdio.h>
+#include <string>
+#include "../AST/AST.h"
+#include "../AST/TypeDenoter.h"
+
+using namespace std;
+
+// Tracing of contextual analysis: scope entries, identifier lookups and
+// the types decided for expressions and v-names.
+//
+// Tracing is chosen at compile time, e.g. g++ -DTRACE_CHECKER=1 main.cpp.
+// When it is off, Tracer<false> is selected; its methods are empty and
+// inline, so the calls and their arguments vanish from the generated code.
+
+#ifndef TRACE_CHECKER
+#define TRACE_CHECKER 0
+#endif
+
+template <bool enabled>
+class Tracer {
+
+public:
+	static void visit (AST*) {}
+	static void enter (const string&, int, bool) {}
+	static void openScope (int) {}
+	static void closeScope (int) {}
+	static void lookup (const string&, AST*) {}
+	static void typeDecision (AST*, TypeDenoter*) {}
+};
+
+template <>
+class Tracer<true> {
+
+public:
+	static void visit (AST* ast) {
+		printf("[trace] visit %s\n", ast->class_type().c_str());
+	}
+
+	static void enter (const string& id, int level, bool duplicated) {
+		printf("[trace] enter \"%s\" at level %d%s\n", id.c_str(), level,
+			duplicated ? " (duplicated)" : "");
+	}
+
+	static void openScope (int level) {
+		printf("[trace] open scope %d\n", level);
+	}
+
+	static void closeScope (int level) {
+		printf("[trace] close scope %d\n", level);
+	}
+
+	static void lookup (const string& id, AST* attr) {
+		if (attr == NULL)
+			printf("[trace] lookup \"%s\": not found\n", id.c_str());
+		else
+			printf("[trace] lookup \"%s\": %s\n", id.c_str(), attr->class_type().c_str());
+	}
+
+	static void typeDecision (AST* ast, TypeDenoter* type) {
+		printf("[trace] %s has type %s\n", ast->class_type().c_str(),
+			type == NULL ? "(none)" : type->class_type().c_str());
+	}
+};
+
+typedef Tracer<TRACE_CHECKER != 0> Trace;
+
+
+#endif
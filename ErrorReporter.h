@@ -22,9 +22,14 @@ class ErrorReporter {
 
 public:
 	 int numErrors;
+  // While holding, restrictions are kept in held instead of being printed,
+  // until release prints them.
+  bool holding;
+  string held;
 ErrorReporter();
   void reportError(string message, string tokenName, SourcePosition* pos);
   void reportRestriction(string message);
+  void release();
 
 };
 
@@ -35,6 +40,7 @@ ErrorReporter();
 
 ErrorReporter::ErrorReporter() {
     numErrors = 0;
+    holding = false;
   }
 
 void ErrorReporter::reportError(string message, string tokenName, SourcePosition* pos) {
@@ -54,7 +60,15 @@ void ErrorReporter::reportError(string message, string tokenName, SourcePosition
 
 void ErrorReporter::reportRestriction(string message) {
 	string temp = "RESTRICTION" + message;
-    printf("%s\n",temp.c_str());
+    if (holding)
+      held += temp + "\n";
+    else
+      printf("%s\n",temp.c_str());
+  }
+
+void ErrorReporter::release() {
+    printf("%s", held.c_str());
+    held = "";
   }
 
 #endif
\ No newline at end of file
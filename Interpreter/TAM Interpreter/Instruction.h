@@ -14,10 +14,10 @@ public:
 
 // Represents TAM instructions.
 
-  int op; // OpCode
-  int r;  // RegisterNumber
-  int n;  // Length
-  int d;  // Operand
+  unsigned char op; // OpCode
+  unsigned char r;  // RegisterNumber
+  unsigned char n;  // Length
+  int d;            // Operand
 
   // The following representations are
   // assumed:
@@ -26,6 +26,10 @@ public:
   //    OpCode = 0..15;  {4 bits unsigned}
   //    Length = 0..255;  {8 bits unsigned}
   //    Operand = -32767..+32767;  {16 bits signed}
+  //
+  // The operand is kept in a full int, as code addresses are no longer
+  // bounded by the size of a fixed code store; wider operands are escaped
+  // in object files.
 
 
 
@@ -40,77 +44,57 @@ public:
 
 
   
-	void write(std::ofstream& mystream){
-
-mystream.write((char*)(&op)+3,1);
-mystream.write((char*)(&op)+2,1);
-mystream.write((char*)(&op)+1,1);
-mystream.write((char*)(&op)+0,1);
-
-mystream.write((char*)(&r)+3,1);
-mystream.write((char*)(&r)+2,1);
-mystream.write((char*)(&r)+1,1);
-mystream.write((char*)(&r)+0,1);
-
-
-mystream.write((char*)(&n)+3,1);
-mystream.write((char*)(&n)+2,1);
-mystream.write((char*)(&n)+1,1);
-mystream.write((char*)(&n)+0,1);
-
-mystream.write((char*)(&d)+3,1);
-mystream.write((char*)(&d)+2,1);
-mystream.write((char*)(&d)+1,1);
-mystream.write((char*)(&d)+0,1);
-
-  }
-
-
-
+	// Object files start with a header of six big-endian words: the
+	// magic number, the format version, the number of instructions, the
+	// entry point (relative to CB), the number of wide operands and the
+	// number of routines. Each instruction follows as one packed word: op
+	// in bits 31-28, r in 27-24, n in 23-16 and d in 15-0, so instructions
+	// can be fetched straight from the file by address. An operand outside
+	// the 16-bit range is written as wideOperand; the wide operands follow
+	// the code as pairs of words, the instruction's address (relative to
+	// CB) and the operand. Last come the routines, in address order, as
+	// pairs of words: the routine's address (relative to CB) and the most
+	// that ST can exceed its LB by while it runs, or -1 if that isn't known.
+
+	static const int objectMagic = 0x54414D00;  // "TAM\0"
+	static const int objectVersion = 4;
+	static const int headerSize = 24;           // bytes
+	static const int wideOperand = -32768;
+
+	static void putWord(unsigned char* bytes, int word) {
+		bytes[0] = (word >> 24) & 0xFF;
+		bytes[1] = (word >> 16) & 0xFF;
+		bytes[2] = (word >> 8) & 0xFF;
+		bytes[3] = word & 0xFF;
+	}
+
+	static int getWord(const unsigned char* bytes) {
+		return (int) (((unsigned) bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3]);
+	}
+
+	bool isWide() {
+		return d < -32767 || d > 32767;
+	}
+
+	// Packs the instruction into the word at bytes.
+	void encode(unsigned char* bytes) {
+		int operand = isWide() ? wideOperand : d;
+		putWord(bytes, ((op & 0xF) << 28) | ((r & 0xF) << 24) | (n << 16) | (operand & 0xFFFF));
+	}
+
+	// Unpacks the word at bytes; d is wideOperand if the operand is in the
+	// table of wide operands.
+	void decode(const unsigned char* bytes) {
+		int word = getWord(bytes);
+		op = (word >> 28) & 0xF;
+		r = (word >> 24) & 0xF;
+		n = (word >> 16) & 0xFF;
+		d = (short) (word & 0xFFFF);
+	}
 
-  static Instruction* read(std::ifstream& input){
-		Instruction* inst = new Instruction();
-        int new_op;
-		int new_r;
-		int new_n;
-		int new_d;
 
-		if(!input.eof()){
-		input.read((char*)(&new_op)+3,1);
-		input.read((char*)(&new_op)+2,1);
-		input.read((char*)(&new_op)+1,1);
-		input.read((char*)(&new_op)+0,1);
 
-		input.read((char*)(&new_r)+3,1);
-		input.read((char*)(&new_r)+2,1);
-		input.read((char*)(&new_r)+1,1);
-		input.read((char*)(&new_r)+0,1);
 
-
-		input.read((char*)(&new_n)+3,1);
-		input.read((char*)(&new_n)+2,1);
-		input.read((char*)(&new_n)+1,1);
-		input.read((char*)(&new_n)+0,1);
-
-		input.read((char*)(&new_d)+3,1);
-		input.read((char*)(&new_d)+2,1);
-		input.read((char*)(&new_d)+1,1);
-		input.read((char*)(&new_d)+0,1);
-
-
-		inst->op = new_op;
-		inst->r = new_r;
-		inst->n = new_n;
-		inst->d = new_d;
-
-		}
-		else
-			inst = NULL;
-
-
-
-		 return inst;
-		}
 };
 
 
@@ -5,7 +5,13 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "Machine.h"
 #include "Instruction.h"
 
@@ -26,6 +32,7 @@ int HB;  // = upper bound of data array + 1
 
 int CT;
 int CP;
+int EP;  // = entry point
 int ST;
 int HT;
 int LB;
@@ -44,6 +51,24 @@ int failedIOError;
 long accumulator;
 Machine* mach;
 
+// The object file is mapped into memory and the code fetched from it, so
+// loading does not depend on the size of the program.
+const unsigned char* image;  // the mapped object file
+size_t imageSize;
+const unsigned char* codeImage;  // the instruction at CB
+// The operands too wide for their words, by code address - CB; empty if
+// the program has none.
+vector<int> wideOperands;
+
+// From the object file's table of routines: the most that ST can exceed
+// LB by in each routine. Space on the stack is then checked once for each
+// routine called, not by each instruction that pushes; checkingEach is true
+// iff the table can't be used for that.
+vector<int> routineEntries;  // code address - CB of each routine, ascending
+vector<int> routineDepths;   // the depth of each routine
+int mainEnd;  // the end of the main program's code
+bool checkingEach;
+
 int currentChar;
 
 //Methods
@@ -56,6 +81,8 @@ int content (int r);
 void dump();
 void showStatus ();
 void checkSpace (int spaceNeeded);
+int frameDepth (int addr);
+int stackLimit ();
 
 bool isTrue (int datum);
 bool equal (int size, int addr1, int addr2);
@@ -70,7 +97,8 @@ int readInt();
 
 void callPrimitive (int primitiveDisplacement);
 void interpretProgram();
-void loadObjectProgram (string objectName);
+template <bool checkEach> void run();
+bool loadObjectProgram (string objectName);
 
 Interpreter(); 
 };
@@ -95,6 +123,11 @@ failedZeroDivide = 6;
 failedIOError = 7;
 
 mach = new Machine();
+image = NULL;
+imageSize = 0;
+codeImage = NULL;
+mainEnd = 0;
+checkingEach = true;
 
 
 
@@ -286,6 +319,29 @@ void Interpreter::checkSpace (int spaceNeeded) {
       status = failedDataStoreFull;
   }
 
+int Interpreter::frameDepth (int addr) {
+    // The depth of the routine that the code address addr is in.
+    // A routine runs from its entry up to the next routine's.
+    if (addr < CB || addr >= CT)
+      return 0;
+    int k = upper_bound(routineEntries.begin(), routineEntries.end(), addr - CB) - routineEntries.begin();
+    return (k > 0) ? routineDepths[k - 1] : 0;
+  }
+
+int Interpreter::stackLimit () {
+    // The highest that ST can reach before the active routines return.
+    // Each frame is found by following the dynamic links from LB, and its
+    // routine from the code address it runs, or will resume, at.
+
+    int limit = max(ST, LB + frameDepth(CP));
+    for (int lb = LB, cp = CP; cp >= mainEnd && cp < CT; ) {
+      cp = *(data+lb + 2);
+      lb = *(data+lb + 1);
+      limit = max(limit, lb + frameDepth(cp));
+    }
+    return limit;
+  }
+
   
 
 bool Interpreter::isTrue (int datum) {
@@ -469,7 +525,10 @@ void Interpreter::callPrimitive (int primitiveDisplacement) {
         }
       else if(primitiveDisplacement ==  mach->newDisplacement){
         size = *(data+ST - 1);
-        checkSpace(size);
+        if (checkingEach)
+          checkSpace(size);
+        else if (HT - size < stackLimit())
+          status = failedDataStoreFull;  // the heap would meet the stack
         HT = HT - size;
         *(data+ST - 1) = HT;
         }
@@ -481,7 +540,18 @@ void Interpreter::callPrimitive (int primitiveDisplacement) {
   void Interpreter::interpretProgram() {
     // Runs the program in code store.
 
-    Instruction* currentInstr;
+    if (checkingEach)
+      run<true>();
+    else
+      run<false>();
+  }
+
+  template <bool checkEach> void Interpreter::run() {
+    // Runs the program in code store; checkEach is true iff space on the
+    // stack is checked by each instruction that pushes, rather than once
+    // for each routine called.
+
+    Instruction currentInstr;
     int op;
 	int r;
 	int n;
@@ -493,22 +563,30 @@ void Interpreter::callPrimitive (int primitiveDisplacement) {
     ST = SB;
     HT = HB;
     LB = SB;
-    CP = CB;
+    CP = EP;
     status = running;
+    if (!checkEach) {
+      checkSpace(frameDepth(EP));
+      if (status != running)
+        return;
+    }
 
     do {
       // Fetch instruction ...
-      currentInstr = mach->code[CP];
+      currentInstr.decode(codeImage + 4 * (CP - CB));
       // Decode instruction ...
-      op = currentInstr->op;
-      r = currentInstr->r;
-      n = currentInstr->n;
-      d = currentInstr->d;
+      op = currentInstr.op;
+      r = currentInstr.r;
+      n = currentInstr.n;
+      d = currentInstr.d;
+      if (d == Instruction::wideOperand)
+        d = wideOperands[CP - CB];
       // Execute instruction ...
     //  printf("%d%d%d%d\n",op,r,n,d);
         if( op ==  mach->LOADop){
           addr = d + content(r);
-          checkSpace(n);
+          if (checkEach)
+            checkSpace(n);
           for (index = 0; index < n; index++)
             *(data+ST + index) = *(data+addr + index);
           ST = ST + n;
@@ -516,7 +594,8 @@ void Interpreter::callPrimitive (int primitiveDisplacement) {
           }
         else if( op ==  mach->LOADAop){
           addr = d + content(r);
-          checkSpace(1);
+          if (checkEach)
+            checkSpace(1);
           *(data+ST) = addr;
           ST = ST + 1;
           CP = CP + 1;
@@ -524,14 +603,16 @@ void Interpreter::callPrimitive (int primitiveDisplacement) {
         else if( op ==  mach->LOADIop){
           ST = ST - 1;
           addr = *(data+ST);
-          checkSpace(n);
+          if (checkEach)
+            checkSpace(n);
           for (index = 0; index < n; index++)
             *(data+ST + index) = *(data+addr + index);
           ST = ST + n;
           CP = CP + 1;
           }
         else if( op ==  mach->LOADLop){
-          checkSpace(1);
+          if (checkEach)
+            checkSpace(1);
           *(data+ST) = d;
           ST = ST + 1;
           CP = CP + 1;
@@ -557,7 +638,7 @@ void Interpreter::callPrimitive (int primitiveDisplacement) {
             callPrimitive(addr - mach->PB);
             CP = CP + 1;
           } else {
-            checkSpace(3);
+            checkSpace(checkEach ? 3 : frameDepth(addr));
             if ((0 <= n) && (n <= 15))
               *(data+ST) = content(n); // static link
             else
@@ -576,6 +657,8 @@ void Interpreter::callPrimitive (int primitiveDisplacement) {
             callPrimitive(addr - mach->PB);
             CP = CP + 1;
           } else {
+            if (!checkEach)
+              checkSpace(frameDepth(addr));
             // *(data+ST] = static link already
             *(data+ST + 1) = LB; // dynamic link
             *(data+ST + 2) = CP + 1; // return address
@@ -594,7 +677,8 @@ void Interpreter::callPrimitive (int primitiveDisplacement) {
           ST = addr + n;
           }
         else if( op ==  mach->PUSHop){
-          checkSpace(d);
+          if (checkEach)
+            checkSpace(d);
           ST = ST + d;
           CP = CP + 1;
           }
@@ -623,6 +707,63 @@ void Interpreter::callPrimitive (int primitiveDisplacement) {
         else if( op ==  mach->HALTop){
           status = halted;
           }
+        else if( op ==  mach->FUSEDop){
+          // A superinstruction, standing for the sequence chosen by n; see
+          // Machine.
+          if (n < mach->loadCallKind) {
+            if (checkEach)
+              checkSpace(1);
+            *(data+ST) = d;
+            ST = ST + 1;
+            callPrimitive(n - mach->literalCallKind);
+            CP = CP + 1;
+            }
+          else if (n < mach->loadLoadCallKind) {
+            if (checkEach)
+              checkSpace(1);
+            *(data+ST) = *(data+d + content(r));
+            ST = ST + 1;
+            callPrimitive(n - mach->loadCallKind);
+            CP = CP + 1;
+            }
+          else if (n < mach->callJumpKind) {
+            addr = content(r);
+            if (checkEach)
+              checkSpace(2);
+            *(data+ST) = *(data+addr + (d >> 8));
+            *(data+ST + 1) = *(data+addr + (signed char) (d & 0xFF));
+            ST = ST + 2;
+            callPrimitive(n - mach->loadLoadCallKind);
+            CP = CP + 1;
+            }
+          else if (n < mach->indexLoadKind) {
+            index = n - mach->callJumpKind;
+            callPrimitive(index % 32);
+            ST = ST - 1;
+            if (*(data+ST) == index / 32)
+              CP = d + content(r);
+            else
+              CP = CP + 1;
+            }
+          else if (n == mach->indexLoadKind) {
+            addr = overflowChecked((long) *(data+ST - 1) + d + content(r));
+            *(data+ST - 1) = *(data+addr);
+            CP = CP + 1;
+            }
+          else if (n == mach->loadLoadKind) {
+            addr = content(r);
+            if (checkEach)
+              checkSpace(2);
+            *(data+ST) = *(data+addr + (d >> 8));
+            *(data+ST + 1) = *(data+addr + (signed char) (d & 0xFF));
+            ST = ST + 2;
+            CP = CP + 1;
+            }
+          else
+            status = failedInvalidInstruction;
+          }
+        else
+          status = failedInvalidInstruction;
    
       if ((CP < CB) || (CP >= CT))
         status = failedInvalidCodeAddress;
@@ -632,30 +773,95 @@ void Interpreter::callPrimitive (int primitiveDisplacement) {
 
 // LOADING
 
-  void Interpreter::loadObjectProgram (string objectName) {
-    // Loads the TAM object program into code store from the named file.
-
-    std::ifstream objectStream(objectName.c_str(),ios_base::binary);
-
-    int addr;
-    bool finished = false;
-
-
-	
-	Instruction* temp_instr = new Instruction();
-
+  bool Interpreter::loadObjectProgram (string objectName) {
+    // Loads the TAM object program into code store from the named file;
+    // returns false, saying why, if it can't.
+
+    // The file is mapped, not read: only its header and its tables of wide
+    // operands and of routines are looked at here.
+
+    mach->setCodeSize(0);
+    CT = CB;
+    EP = CB;
+    image = NULL;
+    imageSize = 0;
+    codeImage = NULL;
+    wideOperands.clear();
+    routineEntries.clear();
+    routineDepths.clear();
+    mainEnd = CB;
+    checkingEach = true;
+
+    int fd = open(objectName.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+      printf("\ncan't open %s\n", objectName.c_str());
+      if (fd >= 0)
+        close(fd);
+      return false;
+    }
+    imageSize = info.st_size;
+    void* mapped = (imageSize > 0) ? mmap(NULL, imageSize, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapped == MAP_FAILED || imageSize < (size_t) Instruction::headerSize ||
+        Instruction::getWord((const unsigned char*) mapped) != Instruction::objectMagic) {
+      printf("\n%s is not a TAM object file\n", objectName.c_str());
+      if (mapped != MAP_FAILED)
+        munmap(mapped, imageSize);
+      return false;
+    }
+    image = (const unsigned char*) mapped;
+
+    int version = Instruction::getWord(image + 4);
+    int count = Instruction::getWord(image + 8);
+    int entry = Instruction::getWord(image + 12);
+    int wide = Instruction::getWord(image + 16);
+    int routines = Instruction::getWord(image + 20);
+    if (version != Instruction::objectVersion) {
+      printf("\n%s has unsupported object format version %d\n", objectName.c_str(), version);
+      return false;
+    }
+    if (count < 0 || wide < 0 || routines < 0 || (count > 0 && (entry < 0 || entry >= count)) ||
+        imageSize < Instruction::headerSize + 4 * (size_t) count + 8 * (size_t) wide + 8 * (size_t) routines) {
+      printf("\n%s is truncated or corrupt\n", objectName.c_str());
+      return false;
+    }
 
-    addr = mach->CB;
-      while (!finished) {
-        mach->code[addr] = temp_instr->read(objectStream);
-		//printf("MADE IT THIS FAR\n");
-        if (mach->code[addr] == NULL)
-          finished = true;
-        else
-          addr = addr + 1;
+    codeImage = image + Instruction::headerSize;
+    const unsigned char* table = codeImage + 4 * count;
+    if (wide > 0)
+      wideOperands.resize(count);
+    for (int w = 0; w < wide; w++) {
+      int addr = Instruction::getWord(table + 8 * w);
+      if (addr < 0 || addr >= count) {
+        printf("\n%s is truncated or corrupt\n", objectName.c_str());
+        return false;
       }
-      CT = addr;  
+      wideOperands[addr] = Instruction::getWord(table + 8 * w + 4);
+    }
 
+    // Each routine runs from its address to the next routine's; the first
+    // is the main program, at the entry point. If any depth is unknown,
+    // space is checked by each instruction instead.
+    table += 8 * wide;
+    checkingEach = (routines == 0 || Instruction::getWord(table) != entry);
+    for (int k = 0; k < routines && !checkingEach; k++) {
+      int from = Instruction::getWord(table + 8 * k);
+      int to = (k + 1 < routines) ? Instruction::getWord(table + 8 * (k + 1)) : count;
+      int depth = Instruction::getWord(table + 8 * k + 4);
+      if (depth < 0 || from < 0 || to <= from || to > count)
+        checkingEach = true;
+      else {
+        routineEntries.push_back(from);
+        routineDepths.push_back(depth);
+      }
+      if (k == 0)
+        mainEnd = CB + to;
+    }
+    mach->setCodeSize(count);
+    CT = CB + count;
+    EP = CB + entry;
+    return true;
   }
 
 
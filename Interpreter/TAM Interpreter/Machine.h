@@ -1,7 +1,6 @@
 #ifndef _TAM_MACHINE
 #define _TAM_MACHINE
 
-#include "Instruction.h"
 
 
 class Machine {
@@ -41,18 +40,36 @@ public:
   int  JUMPIop;
   int  JUMPIFop;
   int  HALTop;
+  int  FUSEDop;
+
+  // Superinstructions: FUSED(n) d[r] stands for the sequence chosen by n,
+  // where p is the displacement of a primitive routine from not to ne,
+  // and d1 and d2 are signed bytes packed into d as d1 * 256 + d2:
+  //   literalCallKind + p        LOADL d; CALL p
+  //   loadCallKind + p           LOAD(1) d[r]; CALL p
+  //   loadLoadCallKind + p       LOAD(1) d1[r]; LOAD(1) d2[r]; CALL p
+  //   callJumpKind + 32 * v + p  CALL p; JUMPIF(v) d[CB], v = 0 or 1
+  //   indexLoadKind              LOADA d[r]; CALL add; LOADI(1)
+  //   loadLoadKind               LOAD(1) d1[r]; LOAD(1) d2[r]
+  int literalCallKind;
+  int loadCallKind;
+  int loadLoadCallKind;
+  int callJumpKind;
+  int indexLoadKind;
+  int loadLoadKind;
 
 
 
 // CODE STORE
 
-Instruction* code[1024];
+// The code itself is not held here: the interpreter fetches it from the
+// object file, which it maps into memory.
 
 
 // CODE STORE REGISTERS
 
  int CB;
- int PB;  // = upper bound of code array + 1
+ int PB;  // = end of the code; the primitive routines follow it
  int PT;  // = PB + 28
 
 // REGISTER NUMBERS
@@ -155,6 +172,14 @@ int maxintRep;
    JUMPIop = 13;
    JUMPIFop = 14;
    HALTop = 15;
+   FUSEDop = 9;
+
+   literalCallKind = 0;
+   loadCallKind = 32;
+   loadLoadCallKind = 64;
+   callJumpKind = 96;
+   indexLoadKind = 160;
+   loadLoadKind = 161;
 
 
 
@@ -166,8 +191,8 @@ int maxintRep;
 // CODE STORE REGISTERS
 
  CB = 0;
- PB = 1024;  // = upper bound of code array + 1
- PT = 1052;  // = PB + 28
+ PB = CB;
+ PT = PB + 28;
 
 // REGISTER NUMBERS
 
@@ -237,6 +262,13 @@ maxintRep = 32767;
  
  
  
+ }
+
+ // Makes the code store hold size instructions from CB, moving PB and PT
+ // up to just after them.
+ void setCodeSize (int size) {
+   PB = CB + size;
+   PT = PB + 28;
  }
 };
 
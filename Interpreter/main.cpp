@@ -22,7 +22,8 @@ int main(int argc, char** argv)
 	Interpreter* interpret = new Interpreter();
 
 	//printf("FILE NAME:%s",tamFileName.c_str());
-    interpret->loadObjectProgram(tamFileName);
+    if (!interpret->loadObjectProgram(tamFileName))
+      return 1;
 
     if (interpret->CT != interpret->CB) {
       interpret->interpretProgram();
@@ -26,6 +26,7 @@ public:
   
   Parser(Scanner* lexer, ErrorReporter* reporter);
   Program* parseProgram();
+  Declaration* parseModule();
   
   void start(SourcePosition* position) ;
   void finish(SourcePosition* position);
@@ -136,6 +137,28 @@ Program* Parser::parseProgram() {
     return programAST;
   }
 
+  // A module is a sequence of declarations, compiled apart from the
+  // programs that import it.
+
+Declaration* Parser::parseModule() {
+
+    Declaration* moduleAST = NULL;
+
+    previousTokenPosition->start = 0;
+    previousTokenPosition->finish = 0;
+    currentToken = lexicalAnalyser->scan();
+
+    try {
+      moduleAST = parseDeclaration();
+	  if (currentToken->kind != Token::EOT) {
+        syntacticError("\"%\" not expected after end of module",currentToken->spelling);
+      }
+
+    }
+    catch (string s) { return NULL; }
+    return moduleAST;
+  }
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // LITERALS
@@ -632,6 +655,7 @@ Declaration* Parser::parseDeclaration() {
 
 Declaration* Parser::parseSingleDeclaration() {
     Declaration* declarationAST = NULL; // in case there's a syntactic error
+    int textStart = lexicalAnalyser->tokenStart;
 
     SourcePosition* declarationPos = new SourcePosition();
     start(declarationPos);
@@ -736,6 +760,9 @@ Declaration* Parser::parseSingleDeclaration() {
       break;
 
     }
+    // Fingerprint of the declaration's text, for incremental re-checking.
+    if (declarationAST != NULL)
+      declarationAST->textHash = lexicalAnalyser->textHash(textStart, lexicalAnalyser->tokenStart);
     return declarationAST;
   }
 
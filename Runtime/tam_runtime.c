@@ -0,0 +1,214 @@
+/* Runtime for Triangle programs compiled to native code (tc --emit=asm
+ * or --emit=obj) or to C (tc --emit=c). It holds the TAM data store, does
+ * the primitive routines that the generated code does not do inline, and
+ * reports failures as the TAM interpreter does. Build a program with
+ *
+ *     tc prog.tri prog.s --emit=asm
+ *     cc -O2 prog.s Runtime/tam_runtime.c -o prog
+ *
+ * or
+ *
+ *     tc prog.tri prog.c --emit=c
+ *     cc -O2 prog.c Runtime/tam_runtime.c -o prog
+ *
+ * The data store has the interpreter's size unless TAM_DATA_SIZE is
+ * defined otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef TAM_DATA_SIZE
+#define TAM_DATA_SIZE 1024
+#endif
+
+#define FALSE_REP 0
+#define TRUE_REP 1
+#define MAXINT_REP 32767
+
+/* Failures, numbered as the interpreter's statuses. */
+#define FAILED_DATA_STORE_FULL 2
+#define FAILED_INVALID_CODE_ADDRESS 3
+#define FAILED_INVALID_INSTRUCTION 4
+#define FAILED_OVERFLOW 5
+#define FAILED_ZERO_DIVIDE 6
+
+int tam_data[TAM_DATA_SIZE];
+long tam_HB = TAM_DATA_SIZE;
+long tam_HT = TAM_DATA_SIZE;
+
+static int currentChar = 0;
+
+/* The translated program, which returns when it halts. */
+extern void tam_run (void);
+
+void tam_fail (int status) {
+    fflush(stdout);
+    switch (status) {
+    case FAILED_DATA_STORE_FULL:
+        fprintf(stderr, "Program has failed due to exhaustion of Data Store.\n");
+        break;
+    case FAILED_INVALID_CODE_ADDRESS:
+        fprintf(stderr, "Program has failed due to an invalid code address.\n");
+        break;
+    case FAILED_INVALID_INSTRUCTION:
+        fprintf(stderr, "Program has failed due to an invalid instruction.\n");
+        break;
+    case FAILED_OVERFLOW:
+        fprintf(stderr, "Program has failed due to overflow.\n");
+        break;
+    case FAILED_ZERO_DIVIDE:
+        fprintf(stderr, "Program has failed due to division by zero.\n");
+        break;
+    }
+    exit(1);
+}
+
+static int overflowChecked (long datum) {
+    if (datum < -MAXINT_REP || datum > MAXINT_REP)
+        tam_fail(FAILED_OVERFLOW);
+    return (int) datum;
+}
+
+static int toInt (int b) {
+    return b ? TRUE_REP : FALSE_REP;
+}
+
+static int equal (int size, long addr1, long addr2) {
+    int index;
+    for (index = 0; index < size; index++)
+        if (tam_data[addr1 + index] != tam_data[addr2 + index])
+            return 0;
+    return 1;
+}
+
+static int readInt (void) {
+    char characters[100];
+    if (fgets(characters, sizeof characters, stdin) == NULL)
+        return 0;
+    return atoi(characters);
+}
+
+/* Does the primitive routine at displacement d with the stack top at st,
+ * and returns the new stack top. */
+long tam_primitive (long d, long st) {
+    int* data = tam_data;
+    long accumulator;
+    int size;
+
+    switch (d) {
+    case 1:   /* id */
+        break;
+    case 2:   /* not */
+        data[st - 1] = toInt(data[st - 1] != TRUE_REP);
+        break;
+    case 3:   /* and */
+        st--;
+        data[st - 1] = toInt(data[st - 1] == TRUE_REP && data[st] == TRUE_REP);
+        break;
+    case 4:   /* or */
+        st--;
+        data[st - 1] = toInt(data[st - 1] == TRUE_REP || data[st] == TRUE_REP);
+        break;
+    case 5:   /* succ */
+        data[st - 1] = overflowChecked((long) data[st - 1] + 1);
+        break;
+    case 6:   /* pred */
+        data[st - 1] = overflowChecked((long) data[st - 1] - 1);
+        break;
+    case 7:   /* neg */
+        data[st - 1] = -data[st - 1];
+        break;
+    case 8:   /* add */
+        st--;
+        data[st - 1] = overflowChecked((long) data[st - 1] + data[st]);
+        break;
+    case 9:   /* sub */
+        st--;
+        data[st - 1] = overflowChecked((long) data[st - 1] - data[st]);
+        break;
+    case 10:  /* mult */
+        st--;
+        data[st - 1] = overflowChecked((long) data[st - 1] * data[st]);
+        break;
+    case 11:  /* div */
+    case 12:  /* mod */
+        st--;
+        if (data[st] == 0)
+            tam_fail(FAILED_ZERO_DIVIDE);
+        accumulator = data[st - 1];
+        data[st - 1] = (int) (d == 11 ? accumulator / data[st] : accumulator % data[st]);
+        break;
+    case 13:  /* lt */
+        st--;
+        data[st - 1] = toInt(data[st - 1] < data[st]);
+        break;
+    case 14:  /* le */
+        st--;
+        data[st - 1] = toInt(data[st - 1] <= data[st]);
+        break;
+    case 15:  /* ge */
+        st--;
+        data[st - 1] = toInt(data[st - 1] >= data[st]);
+        break;
+    case 16:  /* gt */
+        st--;
+        data[st - 1] = toInt(data[st - 1] > data[st]);
+        break;
+    case 17:  /* eq */
+    case 18:  /* ne */
+        size = data[st - 1];
+        st -= 2 * size;
+        data[st - 1] = toInt(equal(size, st - 1, st - 1 + size) == (d == 17));
+        break;
+    case 19:  /* eol */
+        data[st++] = toInt(currentChar == '\n');
+        break;
+    case 20:  /* eof */
+        data[st++] = toInt(currentChar == EOF);
+        break;
+    case 21:  /* get */
+        st--;
+        currentChar = getchar();
+        data[data[st]] = currentChar;
+        break;
+    case 22:  /* put */
+        st--;
+        putchar((char) data[st]);
+        break;
+    case 23:  /* geteol */
+        do
+            currentChar = getchar();
+        while (currentChar != '\n' && currentChar != EOF);
+        break;
+    case 24:  /* puteol */
+        putchar('\n');
+        break;
+    case 25:  /* getint */
+        st--;
+        data[data[st]] = readInt();
+        break;
+    case 26:  /* putint */
+        st--;
+        printf("%d", data[st]);
+        break;
+    case 27:  /* new */
+        size = data[st - 1];
+        if (tam_HT - st < size)
+            tam_fail(FAILED_DATA_STORE_FULL);
+        tam_HT -= size;
+        data[st - 1] = (int) tam_HT;
+        break;
+    case 28:  /* dispose */
+        st--;  /* no action taken at present */
+        break;
+    default:
+        tam_fail(FAILED_INVALID_INSTRUCTION);
+    }
+    return st;
+}
+
+int main (void) {
+    tam_run();
+    return 0;
+}
@@ -26,9 +26,17 @@ class Scanner {
   int scanToken() ;
 
 public:
+  int tokenCount; // number of tokens scanned so far
+
+  // Spellings of all tokens scanned so far, and where the most recent
+  // one starts. Used to fingerprint the text of declarations.
+  string tokenText;
+  int tokenStart;
+
   Scanner(SourceFile* source);
   void enableDebugging();
   Token* scan ();
+  unsigned long textHash(int from, int to);
 };
 
 //##################################################################################################################
@@ -56,6 +64,8 @@ Scanner::Scanner(SourceFile* source) {
     sourceFile = source;
     currentChar = sourceFile->getSource();
     debug = false;
+    tokenCount = 0;
+    tokenStart = 0;
   }
 
 void Scanner::enableDebugging() {
@@ -224,9 +234,24 @@ int Scanner::scanToken() {
 
     pos->finish = sourceFile->getCurrentLine();
     Token* tok= new Token(kind, currentSpelling, pos);
+    tokenCount++;
+    tokenStart = tokenText.length();
+    tokenText += currentSpelling;
+    tokenText += ' ';
     if (debug)
 		printf("%s\n",tok->toString().c_str());
     return tok;
   }
 
+// Returns a hash (FNV-1a) of the token text between offsets from and to.
+
+unsigned long Scanner::textHash(int from, int to) {
+    unsigned long hash = 2166136261UL;
+    for (int i = from; i < to; i++) {
+      hash ^= (unsigned char) tokenText[i];
+      hash *= 16777619UL;
+    }
+    return hash;
+  }
+
 #endif
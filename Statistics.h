@@ -0,0 +1,187 @@
+#ifndef _STATISTICS
+#define _STATISTICS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+using namespace std;
+
+// Number of heap allocations made so far by the whole compiler, on any
+// thread. Counted by the replacement operator new below.
+atomic<long> allocationCount(0);
+
+void* operator new (size_t size) {
+	allocationCount.fetch_add(1, memory_order_relaxed);
+	void* p = malloc(size == 0 ? 1 : size);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete (void* p) noexcept {
+	free(p);
+}
+
+void operator delete (void* p, size_t) noexcept {
+	free(p);
+}
+
+
+// Figures recorded for one compiler pass.
+
+class PhaseStatistics {
+
+public:
+	string name;
+	double wallMillis;
+	long rssGrowthKilobytes;  // how far the process's peak RSS rose during the pass
+	long allocations;
+	vector<string> countNames;  // what each of counts measures in this pass
+	vector<long> counts;
+
+	PhaseStatistics (string name) {
+		this->name = name;
+		wallMillis = 0;
+		rssGrowthKilobytes = 0;
+		allocations = 0;
+	}
+};
+
+
+// Collects per-pass timing and memory figures for "tc --stats", for each
+// program compiled or linked.
+
+class Statistics {
+
+	vector<PhaseStatistics*> phases;
+	double startTime;
+	long startAllocations;
+	long startRSS;
+
+	double now () {
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+	}
+
+	long peakRSS () {
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return usage.ru_maxrss;
+	}
+
+	// The width of the phase name column, wide enough for every name.
+	int nameWidth () {
+		int width = 5;
+		for (int i = 0; i < (signed) phases.size(); i++)
+			if ((signed) phases[i]->name.size() > width)
+				width = phases[i]->name.size();
+		return width;
+	}
+
+public:
+	bool json;
+	string jsonName;  // file the JSON report is written to; stderr if ""
+
+	Statistics (bool json, string jsonName) {
+		this->json = json;
+		this->jsonName = jsonName;
+		startTime = 0;
+		startAllocations = 0;
+		startRSS = 0;
+	}
+
+	// Forgets the passes recorded so far, before the next compilation.
+	void reset () {
+		for (int i = 0; i < (signed) phases.size(); i++)
+			delete phases[i];
+		phases.clear();
+	}
+
+	// Marks the start of a pass.
+	void startPhase (string name) {
+		phases.push_back(new PhaseStatistics(name));
+		startAllocations = allocationCount;
+		startRSS = peakRSS();
+		startTime = now();
+	}
+
+	// Marks the end of the pass started last.
+	void endPhase () {
+		PhaseStatistics* phase = phases.back();
+		phase->wallMillis = now() - startTime;
+		phase->allocations = allocationCount - startAllocations;
+		phase->rssGrowthKilobytes = peakRSS() - startRSS;
+	}
+
+	// Records a pass-specific figure (e.g. tokens read) for the pass
+	// started last.
+	void count (string name, long value) {
+		if (phases.empty())
+			return;
+		phases.back()->countNames.push_back(name);
+		phases.back()->counts.push_back(value);
+	}
+
+	void report () {
+		if (json)
+			reportJSON();
+		else
+			reportText();
+	}
+
+	void reportText () {
+		double totalMillis = 0;
+		long totalAllocations = 0;
+		int width = nameWidth();
+
+		printf("\n===== Compilation statistics =====\n");
+		printf("%-*s %10s %12s %12s\n", width, "Phase", "Wall (ms)", "RSS rise(KB)", "Allocations");
+		for (int i = 0; i < (signed) phases.size(); i++) {
+			PhaseStatistics* p = phases[i];
+			printf("%-*s %10.3f %12ld %12ld\n", width, p->name.c_str(), p->wallMillis,
+				p->rssGrowthKilobytes, p->allocations);
+			totalMillis += p->wallMillis;
+			totalAllocations += p->allocations;
+		}
+		printf("%-*s %10.3f %12s %12ld\n", width, "Total", totalMillis, "", totalAllocations);
+		printf("Peak RSS of the process: %ld KB\n", peakRSS());
+		printf("\n");
+		for (int i = 0; i < (signed) phases.size(); i++) {
+			PhaseStatistics* p = phases[i];
+			for (int j = 0; j < (signed) p->counts.size(); j++)
+				printf("%-*s %ld %s\n", width, p->name.c_str(), p->counts[j], p->countNames[j].c_str());
+		}
+	}
+
+	// Writes the report to jsonName, or to stderr, so that it is not mixed
+	// with the progress messages on stdout.
+	void reportJSON () {
+		FILE* out = (jsonName == "") ? stderr : fopen(jsonName.c_str(), "w");
+		if (out == NULL) {
+			printf("Can't write %s\n", jsonName.c_str());
+			return;
+		}
+		fprintf(out, "{\"phases\": [");
+		for (int i = 0; i < (signed) phases.size(); i++) {
+			PhaseStatistics* p = phases[i];
+			fprintf(out, "%s\n  {\"name\": \"%s\", \"wall_ms\": %.3f, \"rss_growth_kb\": %ld, \"allocations\": %ld",
+				i == 0 ? "" : ",", p->name.c_str(), p->wallMillis, p->rssGrowthKilobytes, p->allocations);
+			for (int j = 0; j < (signed) p->counts.size(); j++)
+				fprintf(out, ", \"%s\": %ld", p->countNames[j].c_str(), p->counts[j]);
+			fprintf(out, "}");
+		}
+		fprintf(out, "\n], \"peak_rss_kb\": %ld}\n", peakRSS());
+		if (out != stderr)
+			fclose(out);
+	}
+};
+
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef _TAM_MACHINE
 #define _TAM_MACHINE
 
+#include <vector>
+#include "Instruction.h"
 
 
 
@@ -41,18 +43,37 @@ public:
   int  JUMPIop;
   int  JUMPIFop;
   int  HALTop;
+  int  FUSEDop;
+
+  // Superinstructions: FUSED(n) d[r] stands for the sequence chosen by n,
+  // where p is the displacement of a primitive routine from not to ne,
+  // and d1 and d2 are signed bytes packed into d as d1 * 256 + d2:
+  //   literalCallKind + p        LOADL d; CALL p
+  //   loadCallKind + p           LOAD(1) d[r]; CALL p
+  //   loadLoadCallKind + p       LOAD(1) d1[r]; LOAD(1) d2[r]; CALL p
+  //   callJumpKind + 32 * v + p  CALL p; JUMPIF(v) d[CB], v = 0 or 1
+  //   indexLoadKind              LOADA d[r]; CALL add; LOADI(1)
+  //   loadLoadKind               LOAD(1) d1[r]; LOAD(1) d2[r]
+  int literalCallKind;
+  int loadCallKind;
+  int loadLoadCallKind;
+  int callJumpKind;
+  int indexLoadKind;
+  int loadLoadKind;
 
 
 
 // CODE STORE
 
-Instruction* code[1024];
+// Instructions are held by value, contiguously from CB, in a store that
+// grows with the code.
+std::vector<Instruction> code;
 
 
 // CODE STORE REGISTERS
 
  int CB;
- int PB;  // = upper bound of code array + 1
+ int PB;  // = end of the code; the primitive routines follow it
  int PT;  // = PB + 28
 
 // REGISTER NUMBERS
@@ -155,6 +176,14 @@ int maxintRep;
    JUMPIop = 13;
    JUMPIFop = 14;
    HALTop = 15;
+   FUSEDop = 9;
+
+   literalCallKind = 0;
+   loadCallKind = 32;
+   loadLoadCallKind = 64;
+   callJumpKind = 96;
+   indexLoadKind = 160;
+   loadLoadKind = 161;
 
 
 
@@ -166,8 +195,8 @@ int maxintRep;
 // CODE STORE REGISTERS
 
  CB = 0;
- PB = 1024;  // = upper bound of code array + 1
- PT = 1052;  // = PB + 28
+ PB = CB;
+ PT = PB + 28;
 
 // REGISTER NUMBERS
 
@@ -237,6 +266,14 @@ maxintRep = 32767;
  
  
  
+ }
+
+ // Makes the code store hold size instructions from CB, moving PB and PT
+ // up to just after them.
+ void setCodeSize (int size) {
+   code.resize(CB + size);
+   PB = CB + size;
+   PT = PB + 28;
  }
 };
 
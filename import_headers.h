@@ -4,6 +4,10 @@
 #include <stdio.h> 
 #include <stdlib.h> 
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <set>
+#include <map>
 
 
 #include "SourceFile.h"
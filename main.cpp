@@ -3,6 +3,8 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "Compiler.h"
 #include "./PrintVisitor/PVInt.h"
 #include "./PrintVisitor/PrintVisitor.h"
@@ -10,28 +12,138 @@ using namespace std;
 
 int main(int argc, char** argv) 
 {
-	if(argc != 2 && argc != 3 && argc !=4)
+	bool compiledOK;
+	Compiler* MiniTriangleCompiler = new Compiler();
+
+	// Options start with "--"; the remaining arguments are positional.
+	vector<string> positional;
+	bool linking = false;
+	bool watching = false;
+	bool failed = false;
+	for (int i = 1; i < argc; i++)
+	{
+		string arg(argv[i]);
+		if (arg == "--stats")
+			MiniTriangleCompiler->stats = new Statistics(false, "");
+		else if (arg == "--stats=json")
+			MiniTriangleCompiler->stats = new Statistics(true, "");
+		else if (arg.compare(0, 13, "--stats=json:") == 0 && arg.size() > 13)
+			MiniTriangleCompiler->stats = new Statistics(true, arg.substr(13));
+		else if (arg == "--no-ir")
+			MiniTriangleCompiler->useIR = false;
+		else if (arg == "--dump-ir")
+			MiniTriangleCompiler->dumpingIR = MiniTriangleCompiler->useIR = true;
+		else if (arg.compare(0, 7, "--jobs=") == 0 && atoi(arg.substr(7).c_str()) >= 1)
+			MiniTriangleCompiler->jobs = atoi(arg.substr(7).c_str());
+		else if (arg == "--no-lift")
+			MiniTriangleCompiler->liftLimit = -1;
+		else if (arg == "--no-inline")
+			MiniTriangleCompiler->inlineBudget = 0;
+		else if (arg.compare(0, 9, "--inline=") == 0 && atoi(arg.substr(9).c_str()) >= 0)
+			MiniTriangleCompiler->inlineBudget = atoi(arg.substr(9).c_str());
+		else if (arg == "--no-strength-reduction")
+			MiniTriangleCompiler->reduceStrength = false;
+		else if (arg == "--no-cse")
+			MiniTriangleCompiler->useCSE = false;
+		else if (arg == "--no-flowopt")
+			MiniTriangleCompiler->optimizeFlow = false;
+		else if (arg == "--no-peephole")
+			MiniTriangleCompiler->peepholeRules = 0;
+		else if (arg.compare(0, 11, "--peephole=") == 0 && Peephole::parseRules(arg.substr(11)) >= 0)
+			MiniTriangleCompiler->peepholeRules = Peephole::parseRules(arg.substr(11));
+		else if (arg == "--plain-tam")
+			MiniTriangleCompiler->fuseInstructions = false;
+		else if (arg == "--emit=tam" || arg == "--emit=asm" || arg == "--emit=obj" || arg == "--emit=c")
+			MiniTriangleCompiler->emitting = arg.substr(7);
+		else if (arg == "--module")
+			MiniTriangleCompiler->compilingModule = true;
+		else if (arg.compare(0, 9, "--import=") == 0 && arg.size() > 9)
+			MiniTriangleCompiler->imports.push_back(arg.substr(9));
+		else if (arg == "--link")
+			linking = true;
+		else if (arg == "--watch")
+			watching = true;
+		else if (arg.compare(0, 2, "--") == 0)
+		{
+			printf("Unknown option %s\n", argv[i]);
+			failed = true;
+			break;
+		}
+		else
+			positional.push_back(argv[i]);
+	}
+
+	if(failed || positional.empty() || (positional.size() > 2 && !linking) || (linking && positional.size() < 2))
 	{
-		printf("Usage: tc filename <tam: filename>\n");
+		printf("Usage: tc filename <tam: filename> [--stats | --stats=json[:filename]]\n");
+		printf("          [--no-ir | --dump-ir] [--no-lift] [--no-inline | --inline=N]\n");
+		printf("          [--no-strength-reduction] [--no-cse] [--no-flowopt]\n");
+		printf("          [--no-peephole | --peephole=succ,addzero,emptystack,loadstore,jumpnext]\n");
+		printf("          [--plain-tam | --emit=tam | --emit=asm | --emit=obj | --emit=c]\n");
+		printf("          [--module] [--import=filename]... [--watch] [--jobs=N]\n");
+		printf("       tc --link <tam: filename> <tamo: filename>... [options]\n");
 		exit(1);
 	}
 
-	bool compiledOK;
-	Compiler* MiniTriangleCompiler = new Compiler();
-	
+	if (linking)
+	{
+		vector<string> units(positional.begin() + 1, positional.end());
+		compiledOK = MiniTriangleCompiler->linkProgram(units, positional[0]);
+		printf("\n");
+		return 0;
+	}
+
 	string objectName = "temp.tam";
-	if(argc == 3)
-		objectName = argv[2];
+	if (MiniTriangleCompiler->emitting != "tam")
+		objectName = "temp." + string(MiniTriangleCompiler->emitting == "asm" ? "s" :
+			MiniTriangleCompiler->emitting == "obj" ? "o" : "c");
+	if(positional.size() >= 2)
+		objectName = positional[1];
+
+	// Modules, and programs importing them, are compiled to object units
+	// (.tamo files), then linked.
+	MiniTriangleCompiler->compilingUnit = objectName.size() > 5 &&
+		objectName.compare(objectName.size() - 5, 5, ".tamo") == 0;
+	if ((MiniTriangleCompiler->compilingModule || !MiniTriangleCompiler->imports.empty()) &&
+		!MiniTriangleCompiler->compilingUnit)
+	{
+		printf("Modules, and programs importing them, must be compiled to .tamo files and linked\n");
+		exit(1);
+	}
+	if (MiniTriangleCompiler->compilingUnit && MiniTriangleCompiler->emitting != "tam")
+	{
+		printf("Native code is generated for whole programs: link the units with --emit\n");
+		exit(1);
+	}
 
 	string xmlName = "temp.xml";
-	if(argc == 3)
-		objectName = argv[2];
 
 
-	string sourceFileName(argv[1]);
+	string sourceFileName(positional[0]);
 
+	// With --watch, the program is compiled again whenever its source
+	// changes, the checker reusing the top-level declarations that haven't,
+	// until the source is removed.
+	MiniTriangleCompiler->incremental = watching;
+	struct stat status;
+	stat(sourceFileName.c_str(), &status);
 	compiledOK = MiniTriangleCompiler->compileProgram(sourceFileName,objectName,true,false,xmlName);
 	printf("\n");
+	while (watching)
+	{
+		time_t lastModified = status.st_mtime;
+		off_t lastSize = status.st_size;
+		printf("Watching %s ...\n", sourceFileName.c_str());
+		fflush(stdout);
+		do
+		{
+			usleep(200000);
+			if (stat(sourceFileName.c_str(), &status) != 0)
+				return 0;
+		} while (status.st_mtime == lastModified && status.st_size == lastSize);
+		compiledOK = MiniTriangleCompiler->compileProgram(sourceFileName,objectName,true,false,xmlName);
+		printf("\n");
+	}
 	// printf("\n\nPress any key to exit\n");
 	// getch();
 	return 0;